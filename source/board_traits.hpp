@@ -0,0 +1,95 @@
+#ifndef BOARD_TRAITS_HPP
+#define BOARD_TRAITS_HPP
+
+#include "panel.hpp"
+
+/**
+ * The size and speed settings of a board, read by the templated parts of PanelTable, PanelData and PanelMatcher.
+ * RuntimeBoard holds any size while FixedBoard makes them compile time constants, so loops over its rows and columns
+ * are unrolled and the settings are folded into the code that reads them.
+ */
+
+/// Calls f(0) to f(N - 1) in order with each index written out, so a loop of N steps is unrolled.
+template <int N> struct Unrolled
+{
+    template <class F> static void each(F& f)
+    {
+        Unrolled<N - 1>::each(f);
+        f(N - 1);
+    }
+};
+
+template <> struct Unrolled<0>
+{
+    template <class F> static void each(F&) {}
+};
+
+/// Speed settings of the difficulties, game_common.cpp starts games with these and PanelTable has engines specialised for them.
+struct EasySpeed
+{
+    static constexpr PanelSpeedSettings settings() {return {3, 11, 1, 46, 25, 9, FALL_ANIMATION_FRAMES};}
+};
+
+struct NormalSpeed
+{
+    static constexpr PanelSpeedSettings settings() {return {3, 11, 1, 38, 20, 8, FALL_ANIMATION_FRAMES};}
+};
+
+struct HardSpeed
+{
+    static constexpr PanelSpeedSettings settings() {return {3, 11, 1, 30, 15, 7, FALL_ANIMATION_FRAMES};}
+};
+
+/// Board whose size and settings are only known at runtime. The settings can be left out by code that only needs the size.
+class RuntimeBoard
+{
+public:
+    RuntimeBoard(int _rows, int _columns, const PanelSpeedSettings* _settings = nullptr) :
+        board_rows(_rows), board_columns(_columns), board_settings(_settings) {}
+
+    int rows() const {return board_rows;}
+    int columns() const {return board_columns;}
+    /// Words of a set of rows with a bit per row.
+    int row_words() const {return (board_rows + 63) / 64;}
+    const PanelSpeedSettings& settings() const {return *board_settings;}
+
+    template <class F> void each_row(F f) const
+    {
+        for (int i = 0; i < board_rows; i++)
+            f(i);
+    }
+    template <class F> void each_column(F f) const
+    {
+        for (int j = 0; j < board_columns; j++)
+            f(j);
+    }
+
+private:
+    int board_rows;
+    int board_columns;
+    const PanelSpeedSettings* board_settings;
+};
+
+/// Board of ROWS x COLUMNS panels with the settings of Speed, which must be the size and settings of the table it is used for.
+template <int ROWS, int COLUMNS, class Speed> class FixedBoard
+{
+public:
+    FixedBoard(int, int, const PanelSpeedSettings* = nullptr) {}
+
+    static constexpr int rows() {return ROWS;}
+    static constexpr int columns() {return COLUMNS;}
+    static constexpr int row_words() {return (ROWS + 63) / 64;}
+    static constexpr PanelSpeedSettings settings() {return Speed::settings();}
+
+    template <class F> static void each_row(F f) {Unrolled<ROWS>::each(f);}
+    template <class F> static void each_column(F f) {Unrolled<COLUMNS>::each(f);}
+};
+
+/// Are two speed settings the same
+inline bool same_settings(const PanelSpeedSettings& a, const PanelSpeedSettings& b)
+{
+    return a.swap == b.swap && a.pending_fall == b.pending_fall && a.falling == b.falling && a.pending_match == b.pending_match &&
+        a.first_removed == b.first_removed && a.subsequent_removed == b.subsequent_removed && a.idle_fell == b.idle_fell;
+}
+
+#endif
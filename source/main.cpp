@@ -9,6 +9,7 @@
 #include <scenes/title_scene.hpp>
 #include <scenes/puzzle_select_scene.hpp>
 #include "puzzle_set.hpp"
+#include "session.hpp"
 #include <util/file_helper.hpp>
 #include <util/sfw.hpp>
 /*#include <vgmstream_player.h>
@@ -18,6 +19,23 @@ extern "C"
 }*/
 
 Scene* current_scene = NULL;
+SessionWriter session_writer(SESSION_FILENAME);
+
+/// No frames run while the app is suspended or closing so the game is saved at once.
+void on_apt_hook(APT_HookType hook, void* param)
+{
+    std::unique_ptr<Scene>& scene = *static_cast<std::unique_ptr<Scene>*>(param);
+    if (hook == APTHOOK_ONSUSPEND || hook == APTHOOK_ONSLEEP || hook == APTHOOK_ONEXIT)
+    {
+        if (scene)
+            scene->suspend();
+        session_writer.finish();
+    }
+    else if ((hook == APTHOOK_ONRESTORE || hook == APTHOOK_ONWAKEUP) && scene)
+    {
+        scene->wake();
+    }
+}
 
 void get_official_puzzle_sets(std::map<std::string, PuzzleSet>& files)
 {
@@ -53,6 +71,9 @@ int main()
     std::unique_ptr<Scene> scene;
     current_scene = new TitleScene();
 
+    aptHookCookie apt_cookie;
+    aptHook(&apt_cookie, on_apt_hook, &scene);
+
     while (aptMainLoop())
     {
         hidScanInput();
@@ -66,6 +87,7 @@ int main()
 
         scene->update();
         scene->draw();
+        session_writer.step();
 
         /*if (scene->music() != current_music)
         {
@@ -74,6 +96,7 @@ int main()
         }*/
     }
 
+    aptUnhook(&apt_cookie);
     //vgmstream_stop();
     //ndspExit();
     sfw_exit();
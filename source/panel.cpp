@@ -1,33 +1,175 @@
 #include "panel.hpp"
 
+#include <algorithm>
+#include <climits>
 
-bool Panel::can_match() const
+void PanelData::resize(int _rows, int _columns)
 {
-    return (is_idle() || is_swapped() || is_fall_end()) && normal();
+    rows = _rows;
+    columns = _columns;
+
+    // Extra row for the next set of panels.
+    size = (rows + 1) * columns;
+    top = 0;
+    type.assign(size, Panel::Type::EMPTY);
+    old.assign(size, Panel::Type::EMPTY);
+    state.assign(size, Panel::State::IDLE);
+    flags.assign(size, 0);
+    countdown.assign(size, 0);
+    match_time.assign(size, 0);
+    remove_time.assign(size, 0);
+    active.assign(size, 0);
+    countdown_keys.resize(size);
+    for (int i = 0; i < size; i++)
+        countdown_keys[i] = key(i, COUNTDOWN, 0);
+    position_keys.resize(size);
+    for (int i = size - 1; i >= 0; i--)
+        position_keys[i] = i >= rows * columns ? key(i - rows * columns, POSITION, 0) : position_keys[i + columns] * ROW_KEY;
+    active_count = 0;
+    chains = 0;
+    activate_all();
+    top_row = 0;
+    row_words = (rows + 63) / 64;
+    column_panels.assign(columns * row_words, 0);
+    row_columns.assign(rows + 1, 0);
+    row_panels.assign(row_words, 0);
+    recount();
+}
+
+void PanelData::recount()
+{
+    busy = 0;
+    std::fill(row_panels.begin(), row_panels.end(), 0);
+    std::fill(column_panels.begin(), column_panels.end(), 0);
+    std::fill(row_columns.begin(), row_columns.end(), 0);
+    for (int i = 0; i < rows * columns; i++)
+    {
+        if (type[slot(i)] != Panel::Type::EMPTY)
+            fill(i, true);
+        busy += state[i] != Panel::State::IDLE && state[i] != Panel::State::IDLE_FELL && state[i] != Panel::State::GARBAGE;
+    }
+
+    // Anything could have been written directly.
+    if (changes)
+    {
+        for (int i = 0; i < size; i++)
+            changes->mark(i);
+    }
+
+    hash = 0;
+    type_hash = type_sum(0, size);
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= key(i, OLD, old[i]) ^ key(i, STATE, state[i]) ^ key(i, FLAGS, flags[i]);
+        hash ^= key(i, MATCH_TIME, match_time[i]) ^ key(i, REMOVE_TIME, remove_time[i]);
+    }
+
+    countdown_hash = 0;
+    for (int i = 0; i < size; i++)
+        countdown_hash += countdown[i] * countdown_keys[i];
+}
+
+uint64_t PanelData::type_sum(int first, int count) const
+{
+    uint64_t sum = 0;
+    for (int i = first; i < first + count; i++)
+        sum += type_key(type[slot(i)]) * position_keys[i];
+    return sum;
+}
+
+void PanelData::activate_all()
+{
+    for (int i = 0; i < rows * columns; i++)
+        active[i] = 1;
+    active_count = rows * columns;
+}
+
+void PanelData::move_down(int top, int bottom)
+{
+    // Only the two ends of the stack change between empty and filled and the chain flags move with it so chains stays the same.
+    fill(bottom + columns, true);
+    fill(top, false);
+    for (int i = bottom + columns; i >= top; i -= columns)
+    {
+        const uint8_t moved_type = i == top ? (uint8_t) Panel::Type::EMPTY : type[slot(i - columns)];
+        const uint8_t moved_flags = i == top ? 0 : flags[i - columns] & ~LOCKED;
+        uint8_t& current = type[slot(i)];
+        if (current != moved_type)
+        {
+            type_hash += (type_key(moved_type) - type_key(current)) * position_keys[i];
+            current = moved_type;
+            if (changes)
+                changes->mark(i);
+        }
+        set_field(i, FLAGS, flags[i], moved_flags);
+        activate(i);
+    }
+}
+
+void ChangeSet::rise(int columns)
+{
+    int kept = 0;
+    for (uint16_t cell : cells)
+    {
+        marked[cell] = 0;
+        if (cell >= columns)
+            cells[kept++] = cell - columns;
+    }
+    cells.resize(kept);
+    for (uint16_t cell : cells)
+        marked[cell] = 1;
+    rose = true;
+}
+
+void Panel::set_chain(bool value)
+{
+    if (value == chain())
+        return;
+
+    if (value)
+    {
+        data->set_flags(index, data->flags[index] | PanelData::CHAIN);
+        data->chains++;
+    }
+    else
+    {
+        data->set_flags(index, data->flags[index] & ~PanelData::CHAIN);
+        data->chains--;
+    }
+}
+
+void Panel::set_locked(bool value)
+{
+    if (value)
+        data->set_flags(index, data->flags[index] | PanelData::LOCKED);
+    else
+        data->set_flags(index, data->flags[index] & ~PanelData::LOCKED);
 }
 
 bool Panel::can_swap() const
 {
-    if (right == nullptr)
+    if (!has_right())
         return false;
 
+    const Panel right = this->right();
+
     // Must not be locked
-    if (locked || right->locked)
+    if (locked() || right.locked())
         return false;
 
     // Must be in these states.
     bool left_state = is_idle() || is_pending_fall() || is_falling() || is_fall_end() || is_swapped();
-    bool right_state = right->is_idle() || is_pending_fall() || right->is_falling() || right->is_fall_end() || right->is_swapped();
+    bool right_state = right.is_idle() || is_pending_fall() || right.is_falling() || right.is_fall_end() || right.is_swapped();
 
     if (!left_state || !right_state)
         return false;
 
     // Next determination if I'm not empty and right is empty then right up must not be in a falling state.
-    if (!empty() && right->empty() && right->up != nullptr && right->up->is_falling_process())
+    if (!empty() && right.empty() && right.has_up() && right.up().is_falling_process())
         return false;
 
     // Vice versa
-    if (empty() && !right->empty() && up != nullptr && up->is_falling_process())
+    if (empty() && !right.empty() && has_up() && up().is_falling_process())
         return false;
 
     return true;
@@ -35,164 +177,184 @@ bool Panel::can_swap() const
 
 void Panel::swap()
 {
-    if (right == nullptr) return;
+    if (!has_right()) return;
+
+    Panel right = this->right();
 
     // Perform the swap immediately.
-    Type temp = type;
-    type = right->type;
-    right->type = temp;
+    Type temp = type();
+    set_type(right.type());
+    right.set_type(temp);
 
-    old = right->type;
-    right->old = type;
+    data->set_old(index, right.type());
+    data->set_old(right.index, type());
 
-    state = State::LEFT_SWAP;
-    right->state = State::RIGHT_SWAP;
+    set_state(State::LEFT_SWAP);
+    right.set_state(State::RIGHT_SWAP);
 
     // Forfeit chain flag if you become empty.
     if (empty())
-        chain = 0;
-    if (right->empty())
-        right->chain = 0;
+        set_chain(false);
+    if (right.empty())
+        right.set_chain(false);
 
-    countdown = right->countdown = settings->swap;
+    set_countdown(data->settings->swap);
+    right.set_countdown(data->settings->swap);
 }
 
-int Panel::match(int index, int total, int types_matched, bool chain)
+void Panel::save(PanelSnapshot& snapshot) const
 {
-    state = State::PENDING_MATCH;
-    match_time = settings->first_removed + index * settings->subsequent_removed;
-    remove_time = settings->first_removed + total * settings->subsequent_removed;
-    countdown = settings->pending_match + (settings->subsequent_removed - 1) * (types_matched - 1);// + chain;
-    return 0;
+    snapshot.types = type() | (data->old[index] << 4);
+    snapshot.flags = state() | (chain() ? SNAPSHOT_CHAIN : 0) | (locked() ? SNAPSHOT_LOCKED : 0);
+    snapshot.countdown = countdown();
+    snapshot.match_time = data->match_time[index];
+    snapshot.remove_time = data->remove_time[index];
 }
 
-void Panel::rise()
+void Panel::load(const PanelSnapshot& snapshot)
 {
-    if (down == nullptr)
-    {
-        type = EMPTY;
-        return;
-    }
-    type = down->type;
-    down->rise();
+    set_type((Type) (snapshot.types & 0xF));
+    data->set_old(index, snapshot.types >> 4);
+    set_state((State) (snapshot.flags & 0xF));
+    set_chain((snapshot.flags & SNAPSHOT_CHAIN) != 0);
+    set_locked((snapshot.flags & SNAPSHOT_LOCKED) != 0);
+    set_countdown(snapshot.countdown);
+    data->set_match_time(index, snapshot.match_time);
+    data->set_remove_time(index, snapshot.remove_time);
 }
 
+bool Panel::can_fall() const
+{
+    const Panel down = this->down();
+    if (empty() || down.is_bottom())
+        return false;
+
+    // Can fall if the panel below you is falling or the panel below you is empty and (idle | swapped | match_end)
+    return down.is_falling_process() || (down.empty() && (down.is_idle() || down.is_swapped() || down.is_match_end()));
+}
 
-bool Panel::update()
+int Panel::quiet_frames() const
 {
-    if (is_swapping())
-    {
-        countdown -= 1;
-        if (countdown <= 0)
-        {
-            old = Type::EMPTY;
-            state = State::SWAPPED;
-        }
-    }
-    else if (is_swapped())
-    {
-        state = State::IDLE;
-    }
-    else if (is_pending_fall())
-    {
-        countdown -= 1;
-        state = FALLING;
-    }
-    else if (is_falling())
-    {
-        countdown -= 1;
-        if (countdown <= 0)
-        {
-            // If below panel is not blocking and non empty panel
-            if (!down->is_bottom() && down->empty() && down->is_idle() && !empty())
-            {
-                down->type = type;
-                down->state = FALLING;
-                down->countdown = settings->falling;
-                down->chain = chain;
-
-                type = EMPTY;
-                state = IDLE;
-                chain = false;
-                locked = false;
-            }
-            // Slip case: Below panel is in fall process
-            else if (!down->is_bottom() && !down->empty() && down->is_falling_process() && !empty())
-            {
-                state = down->state;
-                countdown = down->countdown;
-            }
-            else
-            {
-                state = State::END_FALL;
-            }
-        }
-    }
-    else if (is_fall_end())
-    {
-        state = State::IDLE_FELL;
-        countdown = settings->idle_fell;
-        chain = false;
-    }
-    else if (is_fell_idle())
-    {
-        countdown -= 1;
-        if (countdown <= 0)
-            state = State::IDLE;
-    }
-    else if (is_pending_match())
-    {
-        countdown -= 1;
-        if (countdown <= 0)
-        {
-            state = State::MATCHED;
-            countdown = match_time;
-        }
-    }
-    else if (is_matched())
+    const Transition& transition = transitions[state()];
+    if (is_idle() && can_fall())
+        return 0;
+    if (transition.countdown)
+        return std::max(countdown() - 1, 0);
+    return is_idle() || is_garbage() ? INT_MAX : 0;
+}
+
+const Panel::Transition Panel::transitions[] = {
+    // INVALID
+    {false, false, nullptr},
+    // IDLE
+    {false, false, nullptr},
+    // LEFT_SWAP
+    {true, true, &Panel::swap_end},
+    // RIGHT_SWAP
+    {true, true, &Panel::swap_end},
+    // SWAPPED
+    {false, false, &Panel::swapped},
+    // PENDING_FALL
+    {false, false, &Panel::pending_fall},
+    // FALLING
+    {true, true, &Panel::fall},
+    // END_FALL
+    {false, false, &Panel::fall_end},
+    // IDLE_FELL, can start falling every frame.
+    {true, false, &Panel::fell_idle_end},
+    // PENDING_MATCH
+    {true, true, &Panel::pending_match_end},
+    // MATCHED
+    {true, true, &Panel::matched_end},
+    // REMOVED
+    {true, true, &Panel::removed_end},
+    // END_MATCH
+    {false, false, &Panel::match_end},
+    // BOTTOM
+    {false, false, nullptr},
+    // GARBAGE, PanelTable moves the whole span.
+    {false, false, nullptr},
+};
+
+void Panel::swap_end(const PanelSpeedSettings&, Panel&)
+{
+    data->set_old(index, Type::EMPTY);
+    set_state(State::SWAPPED);
+}
+
+void Panel::swapped(const PanelSpeedSettings&, Panel&)
+{
+    set_state(State::IDLE);
+}
+
+void Panel::pending_fall(const PanelSpeedSettings&, Panel&)
+{
+    set_countdown(countdown() - 1);
+    set_state(FALLING);
+}
+
+void Panel::fall(const PanelSpeedSettings& settings, Panel& down)
+{
+    // If below panel is not blocking and non empty panel
+    if (!down.is_bottom() && down.empty() && down.is_idle() && !empty())
     {
-        countdown -= 1;
-        if (countdown <= 0)
-        {
-            countdown = remove_time - match_time;
-            // last panel in removed will immediately transition to end match since remove_time == match_time.
-            if (countdown == 0)
-                type = Type::EMPTY;
-            state = countdown == 0 ? State::END_MATCH : State::REMOVED;
+        down.set_type(type());
+        down.set_state(FALLING);
+        down.set_countdown(settings.falling);
+        down.set_chain(chain());
 
-        }
+        set_type(EMPTY);
+        set_state(IDLE);
+        set_chain(false);
+        set_locked(false);
     }
-    else if (is_removed())
+    // Slip case: Below panel is in fall process
+    else if (!down.is_bottom() && !down.empty() && down.is_falling_process() && !empty())
     {
-        countdown -= 1;
-        if (countdown <= 0)
-        {
-            type = Type::EMPTY;
-            state = State::END_MATCH;
-        }
+        set_state(down.state());
+        set_countdown(down.countdown());
     }
-    else if (is_match_end())
+    else
     {
-        state = State::IDLE;
-        chain = false;
+        set_state(State::END_FALL);
     }
+}
 
-    // For transitioning to falling
-    // Need to do this if it is swapped to prevent this scenario
-    // PP P
-    // BB B
-    // Swap the P over the empty space and it is matched.
-    if ((is_idle() || is_swapped()) && !empty() && !down->is_bottom())
-    {
-        // Can fall if the panel below you is falling or the panel below you is empty and (idle | swapped | match_end)
-        if (down->is_falling_process() || (down->empty() && (down->is_idle() || down->is_swapped() || down->is_match_end())))
-        {
-            locked = is_swapped();
-            state = PENDING_FALL;
-            countdown = settings->pending_fall + settings->falling;
-            chain = down->is_match_end() || down->chain;
-        }
-    }
+void Panel::fall_end(const PanelSpeedSettings& settings, Panel&)
+{
+    set_state(State::IDLE_FELL);
+    set_countdown(settings.idle_fell);
+    set_chain(false);
+}
 
-    return is_swapped() || is_fall_end();
+void Panel::fell_idle_end(const PanelSpeedSettings&, Panel&)
+{
+    set_state(State::IDLE);
+}
+
+void Panel::pending_match_end(const PanelSpeedSettings&, Panel&)
+{
+    set_state(State::MATCHED);
+    set_countdown(data->match_time[index]);
+}
+
+void Panel::matched_end(const PanelSpeedSettings&, Panel&)
+{
+    set_countdown(data->remove_time[index] - data->match_time[index]);
+    // last panel in removed will immediately transition to end match since remove_time == match_time.
+    if (countdown() == 0)
+        set_type(Type::EMPTY);
+    set_state(countdown() == 0 ? State::END_MATCH : State::REMOVED);
+}
+
+void Panel::removed_end(const PanelSpeedSettings&, Panel&)
+{
+    set_type(Type::EMPTY);
+    set_state(State::END_MATCH);
+}
+
+void Panel::match_end(const PanelSpeedSettings&, Panel&)
+{
+    set_state(State::IDLE);
+    set_chain(false);
 }
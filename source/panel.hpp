@@ -1,6 +1,9 @@
 #ifndef PANEL_HPP
 #define PANEL_HPP
 
+#include <cstdint>
+#include <vector>
+
 #define FALL_ANIMATION_FRAMES 11
 #define FALL_ANIMATION_DELAY 4
 
@@ -15,6 +18,248 @@ struct PanelSpeedSettings
     int idle_fell;
 };
 
+/// Largest board that can be saved, save_state returns false for bigger boards.
+#define SNAPSHOT_MAX_ROWS 12
+#define SNAPSHOT_MAX_COLUMNS 6
+
+/** Trivially copyable copy of the simulation state of a Panel, the times of a board small enough to be saved fit in 16 bits */
+struct PanelSnapshot
+{
+    /** Type in the low nibble, old type in the high nibble */
+    uint8_t types;
+    /** State in the low nibble, chain and locked flags in the high nibble */
+    uint8_t flags;
+    int16_t countdown;
+    int16_t match_time;
+    int16_t remove_time;
+};
+
+/// Bits of PanelSnapshot::flags above the state
+#define SNAPSHOT_CHAIN 0x10
+#define SNAPSHOT_LOCKED 0x20
+
+/** Cells changed by the simulation since the frame started, recorded by PanelData while PanelTable::set_record_changes is on. */
+struct ChangeSet
+{
+    void clear()
+    {
+        for (uint16_t cell : cells)
+            marked[cell] = 0;
+        cells.clear();
+        rose = false;
+        generated = false;
+        done = false;
+    }
+    void mark(int index)
+    {
+        if (!marked[index])
+        {
+            marked[index] = 1;
+            cells.push_back(index);
+        }
+    }
+    /// Moves the cells up a row with the panels, cells that leave the board are dropped.
+    void rise(int columns);
+
+    /// Index of each cell whose type or state changed in the order they first changed, the next set of panels start at rows * columns.
+    std::vector<uint16_t> cells;
+    /// Set for the indexes in cells so a cell is listed once. Sized for the whole board so recording does not allocate.
+    std::vector<uint8_t> marked;
+    /// Every panel moved up a row, cells are at their positions after the rise.
+    bool rose = false;
+    /// A new next set of panels was generated.
+    bool generated = false;
+    /// The frame is over, the next swap or update starts a new set.
+    bool done = false;
+};
+
+/**
+ * Storage for all panels of a PanelTable as a structure of arrays.
+ * Panels are stored row by row, the row after the last row is the next set of panels.
+ * Neighbours are computed from the index.
+ */
+struct PanelData
+{
+    enum Flags
+    {
+        CHAIN = 1,
+        /** Locked from swapping */
+        LOCKED = 2,
+    };
+
+    void resize(int rows, int columns);
+
+    /// Marks the panel and the panel above it as needing an update.
+    void activate(int index)
+    {
+        if (index < rows * columns && !active[index])
+        {
+            active[index] = 1;
+            active_count++;
+        }
+        index -= columns;
+        if (index >= 0 && !active[index])
+        {
+            active[index] = 1;
+            active_count++;
+        }
+    }
+    /// Panel is idle and can't fall so it does not need to be updated.
+    void deactivate(int index)
+    {
+        if (active[index])
+        {
+            active[index] = 0;
+            active_count--;
+        }
+    }
+    /// Marks every panel as needing an update.
+    void activate_all();
+
+    /// Position of a panel in type, the rows of types are a ring buffer starting at top.
+    int slot(int index) const
+    {
+        index += top;
+        return index < size ? index : index - size;
+    }
+    /// Moves every type up a row by recycling the top row as an empty next row. Board has the size of the table, see board_traits.hpp.
+    template <class Board> void rise(const Board& board);
+    /** Moves the panels from top to bottom of a column down a row in one pass, the cell below bottom must be empty.
+      * Their types and chain flags move and every cell is unlocked, top is left empty. States and countdowns are left to the caller. */
+    void move_down(int top, int bottom);
+
+    /// Changes a type keeping the board aggregates up to date.
+    void set_type(int index, uint8_t value);
+    /// Changes a state keeping the count of busy panels up to date.
+    void set_state(int index, uint8_t value);
+    /// Changes a countdown keeping countdown_hash up to date.
+    void set_countdown(int index, int value)
+    {
+        const int32_t current = countdown[index];
+        countdown[index] = value;
+        countdown_hash += (uint64_t) (countdown[index] - current) * countdown_keys[index];
+    }
+    /// Setters for the other fields that keep the hash up to date, countdowns are not part of it.
+    void set_old(int index, uint8_t value) {set_field(index, OLD, old[index], value);}
+    void set_flags(int index, uint8_t value) {set_field(index, FLAGS, flags[index], value);}
+    void set_match_time(int index, int value) {set_field(index, MATCH_TIME, match_time[index], value);}
+    void set_remove_time(int index, int value) {set_field(index, REMOVE_TIME, remove_time[index], value);}
+    /// Recomputes the board aggregates and the hashes after types or states were written directly.
+    void recount();
+
+    /** Fields of a panel that are part of the hash */
+    enum Field
+    {
+        TYPE = 0,
+        OLD = 1,
+        STATE = 2,
+        FLAGS = 3,
+        COUNTDOWN = 4,
+        MATCH_TIME = 5,
+        REMOVE_TIME = 6,
+        /// Keys the columns of position_keys
+        POSITION = 7,
+    };
+    /// Zobrist key of a field of the panel at index having a value, computed instead of stored in a table.
+    static uint64_t key(int index, int field, int value)
+    {
+        return mix((uint32_t) value | (uint64_t) (uint16_t) index << 32 | (uint64_t) field << 48);
+    }
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+    /// Key of a type, multiplied by the position key of the panel holding it.
+    static uint64_t type_key(int value) {return key(0, TYPE, value);}
+    /// Multiplies the position keys of a row to get those of the row above, odd so nothing is lost scaling type_hash.
+    static constexpr uint64_t ROW_KEY = 0xD6E8FEB86659FD93ULL;
+    /// Sum of the keyed types of count panels from index first, taken out of type_hash and added back around writing types directly.
+    uint64_t type_sum(int first, int count) const;
+
+    int rows = 0;
+    int columns = 0;
+    int size = 0;
+    /** Index in type of the first panel of the top row */
+    int top = 0;
+    /** Row in the ring buffer of types of the top row */
+    int top_row = 0;
+    // Owned by panel_table
+    const PanelSpeedSettings* settings = nullptr;
+
+    /** Types move when the table rises so they are stored by slot() */
+    std::vector<uint8_t> type;
+    /** Old type when swapping */
+    std::vector<uint8_t> old;
+    std::vector<uint8_t> state;
+    std::vector<uint8_t> flags;
+    std::vector<int32_t> countdown;
+    std::vector<int32_t> match_time;
+    std::vector<int32_t> remove_time;
+    /** Panels that are not idle or may start falling, only these are updated */
+    std::vector<uint8_t> active;
+    int active_count = 0;
+    /** Number of panels with the chain flag set */
+    int chains = 0;
+
+    /** Board aggregates, the next set of panels are not included. Sets of rows are row_words words long so boards can have any number of rows. */
+    /** Bit i of the words from column_panels[j * row_words] is set if the panel in row i of column j is not empty */
+    std::vector<uint64_t> column_panels;
+    /** Bit j is set if the panel in column j of the row is not empty, indexed by the row in the ring buffer of types */
+    std::vector<uint64_t> row_columns;
+    /** Bit i is set if row i has a panel */
+    std::vector<uint64_t> row_panels;
+    int row_words = 1;
+    /// Is row i in a set of rows.
+    static bool has_row(const uint64_t* bits, int i) {return bits[i >> 6] >> (i & 63) & 1;}
+    /// First row in a set of rows, rows if it is empty.
+    int first_row(const uint64_t* bits) const
+    {
+        for (int w = 0; w < row_words; w++)
+        {
+            if (bits[w])
+                return w * 64 + __builtin_ctzll(bits[w]);
+        }
+        return rows;
+    }
+    /** Number of panels that are not idle */
+    int busy = 0;
+    /** XOR of the keys of every field except the type and the countdown of every panel including the next set of panels */
+    uint64_t hash = 0;
+    /** Types are kept out of hash as the sum of type_key(type) * position_keys[index], including the next set of panels.
+      * The key of a position is its column's key times ROW_KEY once for each row it is below the top row, so rising
+      * scales the sum by ROW_KEY and only the row leaving the top and the new next row are keyed again. */
+    uint64_t type_hash = 0;
+    std::vector<uint64_t> position_keys;
+    /** Countdowns change almost every frame so they are kept out of hash as the sum of countdown * countdown_keys[index].
+      * A countdown step is then one add however many panels count down. */
+    uint64_t countdown_hash = 0;
+    std::vector<uint64_t> countdown_keys;
+    /** Cells whose type or state change are recorded here if set, owned by panel_table */
+    ChangeSet* changes = nullptr;
+
+private:
+    void fill(int index, bool filled);
+    /// Moves every row in a set of rows up a row.
+    template <class Board> void shift_rows(const Board& board, uint64_t* bits)
+    {
+        for (int w = 0; w < board.row_words() - 1; w++)
+            bits[w] = bits[w] >> 1 | bits[w + 1] << 63;
+        bits[board.row_words() - 1] >>= 1;
+    }
+    template <class T> void set_field(int index, int field, T& current, int value)
+    {
+        if (current == value)
+            return;
+        hash ^= key(index, field, current);
+        current = value;
+        hash ^= key(index, field, current);
+    }
+};
+
+/** View of a single panel stored in a PanelData. */
 class Panel
 {
 public:
@@ -59,71 +304,252 @@ public:
         END_MATCH = 12,
         /** State for next set of panels, can't be match swap or fall */
         BOTTOM = 13,
+        /** Cell covered by a garbage span, it moves and shatters with the span instead of by itself */
+        GARBAGE = 14,
     };
 
-    bool empty() const {return type == EMPTY;}
-    bool special() const {return type == SPECIAL;}
-    bool normal() const {return type != EMPTY && type != SPECIAL;}
+    Panel() {}
+    Panel(PanelData* panel_data, int panel_index) : data(panel_data), index(panel_index) {}
 
-    Type get_value() const {return type;}
-    void set_value(Type value) {type = value;}
-    State get_state() const {return state;}
-    bool get_chain() const {return chain;}
-    int get_countdown() const {return countdown;}
+    bool empty() const {return type() == EMPTY;}
+    bool special() const {return type() == SPECIAL;}
+    bool normal() const {return type() != EMPTY && type() != SPECIAL;}
 
-    bool is_idle() const {return state == IDLE || state == IDLE_FELL;}
-    bool is_fell_idle() const {return state == IDLE_FELL;}
+    Type get_value() const {return type();}
+    void set_value(Type value) {set_type(value);}
+    State get_state() const {return state();}
+    bool get_chain() const {return chain();}
+    int get_countdown() const {return data->countdown[index];}
+
+    bool is_idle() const {return state() == IDLE || state() == IDLE_FELL;}
+    bool is_fell_idle() const {return state() == IDLE_FELL;}
     bool is_swapping() const {return is_left_swap() || is_right_swap();}
-    bool is_left_swap() const {return state == LEFT_SWAP;}
-    bool is_right_swap() const {return state == RIGHT_SWAP;}
-    bool is_swapped() const {return state == SWAPPED;}
-    bool is_pending_fall() const {return state == PENDING_FALL;}
-    bool is_falling() const {return state == FALLING;}
-    bool is_fall_end() const {return state == END_FALL;}
+    bool is_left_swap() const {return state() == LEFT_SWAP;}
+    bool is_right_swap() const {return state() == RIGHT_SWAP;}
+    bool is_swapped() const {return state() == SWAPPED;}
+    bool is_pending_fall() const {return state() == PENDING_FALL;}
+    bool is_falling() const {return state() == FALLING;}
+    bool is_fall_end() const {return state() == END_FALL;}
     bool is_falling_process() const {return is_pending_fall() || is_falling() || is_fall_end();}
-    bool is_pending_match() const {return state == PENDING_MATCH;}
-    bool is_matched() const {return state == MATCHED;}
-    bool is_removed() const {return state == REMOVED;}
-    bool is_match_end() const {return state == END_MATCH;}
+    bool is_pending_match() const {return state() == PENDING_MATCH;}
+    bool is_matched() const {return state() == MATCHED;}
+    bool is_removed() const {return state() == REMOVED;}
+    bool is_match_end() const {return state() == END_MATCH;}
     bool is_match_process() const {return is_pending_match() || is_matched() || is_removed() || is_match_end();}
-    bool is_bottom() const {return state == BOTTOM;}
+    bool is_bottom() const {return state() == BOTTOM;}
+    bool is_garbage() const {return state() == GARBAGE;}
 
     /// Can the panel be matched
-    bool can_match() const;
+    bool can_match() const {return (is_idle() || is_swapped() || is_fall_end()) && normal();}
     /// Can the panel be swapped.
     bool can_swap() const;
 
-    /// Start matching panels returns number of panels matched
-    int match(int index, int total, int types_matched, bool chain = false);
+    /// Start matching panels with the settings of the table returns number of panels matched
+    int match(int index, int total, int types_matched, const PanelSpeedSettings& settings);
     /// Swaps panel with the one to its right.
     void swap();
-    /// Rises the panel up one
-    void rise();
 
-    /// Updates the panel, true is returned to trigger a find matches
-    bool update();
+    /// Updates the panel with the settings of the table, true is returned to trigger a find matches.
+    /// An engine specialised for its settings inlines this with them as constants.
+    bool update(const PanelSpeedSettings& settings);
+
+    /// Copies the simulation state of this panel
+    void save(PanelSnapshot& snapshot) const;
+    /// Restores the simulation state from a snapshot
+    void load(const PanelSnapshot& snapshot);
 
 private:
-    /// Mesh panels owned by PanelTable
-    Panel* up = nullptr;
-    Panel* down = nullptr;
-    Panel* left = nullptr;
-    Panel* right = nullptr;
-    // Owned by panel_table
-    const PanelSpeedSettings* settings = nullptr;
+    Type type() const {return (Type) data->type[data->slot(index)];}
+    State state() const {return (State) data->state[index];}
+    bool chain() const {return data->flags[index] & PanelData::CHAIN;}
+    bool locked() const {return data->flags[index] & PanelData::LOCKED;}
+    void set_type(Type value) {data->set_type(index, value);}
+    void set_state(State value) {data->set_state(index, value);}
+    void set_chain(bool value);
+    void set_locked(bool value);
+    int countdown() const {return data->countdown[index];}
+    void set_countdown(int value) {data->set_countdown(index, value);}
+
+    /// Mesh panels computed from the index
+    bool has_up() const {return index >= data->columns;}
+    bool has_right() const {return index % data->columns != data->columns - 1;}
+    Panel up() const {return Panel(data, index - data->columns);}
+    Panel down() const {return Panel(data, index + data->columns);}
+    Panel right() const {return Panel(data, index + 1);}
 
-    State state = IDLE;
-    Type type = EMPTY;
-    /// Old type when swapping
-    Type old = EMPTY;
-    bool chain = false;
-    int match_time = 0;
-    int remove_time = 0;
-    int countdown = 0;
-    // Locked from swapping.
-    bool locked = false;
+    /// Can an idle panel start falling onto the panel below it.
+    bool can_fall() const;
+    /// Number of updates where only the countdown changes before this panel changes state.
+    int quiet_frames() const;
+
+    typedef void (Panel::*Handler)(const PanelSpeedSettings& settings, Panel& down);
+    /** What a panel in a state does every frame */
+    struct Transition
+    {
+        /** The countdown is decremented every frame and the handler is called once it expires, otherwise the handler is called every frame */
+        bool countdown;
+        /** Until the countdown expires only the countdown changes and nothing else reads it, so the table can count these panels down without updating them */
+        bool batch;
+        Handler handler;
+    };
+    /** Indexed by State */
+    static const Transition transitions[GARBAGE + 1];
+
+    /// State handlers
+    void swap_end(const PanelSpeedSettings& settings, Panel& down);
+    void swapped(const PanelSpeedSettings& settings, Panel& down);
+    void pending_fall(const PanelSpeedSettings& settings, Panel& down);
+    void fall(const PanelSpeedSettings& settings, Panel& down);
+    void fall_end(const PanelSpeedSettings& settings, Panel& down);
+    void fell_idle_end(const PanelSpeedSettings& settings, Panel& down);
+    void pending_match_end(const PanelSpeedSettings& settings, Panel& down);
+    void matched_end(const PanelSpeedSettings& settings, Panel& down);
+    void removed_end(const PanelSpeedSettings& settings, Panel& down);
+    void match_end(const PanelSpeedSettings& settings, Panel& down);
+
+    // Owned by panel_table
+    PanelData* data = nullptr;
+    int index = 0;
 
     friend class PanelTable;
 };
 
+inline void PanelData::fill(int index, bool filled)
+{
+    const int i = index / columns;
+    const int j = index - i * columns;
+    int ring_row = i + top_row;
+    if (ring_row > rows)
+        ring_row -= rows + 1;
+    const int word = i >> 6;
+    const uint64_t bit = 1ULL << (i & 63);
+
+    if (filled)
+    {
+        column_panels[j * row_words + word] |= bit;
+        row_columns[ring_row] |= 1ULL << j;
+        row_panels[word] |= bit;
+    }
+    else
+    {
+        column_panels[j * row_words + word] &= ~bit;
+        row_columns[ring_row] &= ~(1ULL << j);
+        if (!row_columns[ring_row])
+            row_panels[word] &= ~bit;
+    }
+}
+
+template <class Board> void PanelData::rise(const Board& board)
+{
+    const int board_size = board.rows() * board.columns();
+
+    // The top row leaves the board, every other type moves up a row.
+    uint64_t left = 0;
+    board.each_column([&](int j) {left += type_key(type[slot(j)]) * position_keys[j];});
+    type_hash -= left;
+
+    // The old top row becomes the next row.
+    row_columns[top_row] = 0;
+    top += board.columns();
+    top_row++;
+    if (top == size)
+    {
+        top = 0;
+        top_row = 0;
+    }
+
+    uint8_t* next_row = &type[slot(board_size)];
+    board.each_column([&](int j) {next_row[j] = Panel::Type::EMPTY;});
+
+    // The old next row becomes the bottom row.
+    shift_rows(board, row_panels.data());
+    const int bottom = board_size - board.columns();
+    board.each_column([&](int j)
+    {
+        shift_rows(board, &column_panels[j * board.row_words()]);
+        if (type[slot(bottom + j)] != Panel::Type::EMPTY)
+            fill(bottom + j, true);
+    });
+
+    uint64_t entered = 0;
+    board.each_column([&](int j) {entered += type_key(type[slot(board_size + j)]) * position_keys[board_size + j];});
+    type_hash = type_hash * ROW_KEY + entered;
+
+    if (changes)
+        changes->rise(board.columns());
+}
+
+inline void PanelData::set_type(int index, uint8_t value)
+{
+    uint8_t& current = type[slot(index)];
+    if ((current == Panel::Type::EMPTY) != (value == Panel::Type::EMPTY) && index < rows * columns)
+        fill(index, value != Panel::Type::EMPTY);
+    if (current != value)
+    {
+        type_hash += (type_key(value) - type_key(current)) * position_keys[index];
+        if (changes)
+            changes->mark(index);
+    }
+    current = value;
+    activate(index);
+}
+
+inline void PanelData::set_state(int index, uint8_t value)
+{
+    if (index < rows * columns)
+    {
+        busy -= state[index] != Panel::State::IDLE && state[index] != Panel::State::IDLE_FELL && state[index] != Panel::State::GARBAGE;
+        busy += value != Panel::State::IDLE && value != Panel::State::IDLE_FELL && value != Panel::State::GARBAGE;
+    }
+    if (state[index] != value)
+    {
+        hash ^= key(index, STATE, state[index]) ^ key(index, STATE, value);
+        if (changes)
+            changes->mark(index);
+    }
+    state[index] = value;
+    activate(index);
+}
+
+inline int Panel::match(int match_index, int total, int types_matched, const PanelSpeedSettings& settings)
+{
+    set_state(State::PENDING_MATCH);
+    data->set_match_time(index, settings.first_removed + match_index * settings.subsequent_removed);
+    data->set_remove_time(index, settings.first_removed + total * settings.subsequent_removed);
+    set_countdown(settings.pending_match + (settings.subsequent_removed - 1) * (types_matched - 1));
+    return 0;
+}
+
+inline bool Panel::update(const PanelSpeedSettings& settings)
+{
+    Panel down = this->down();
+
+    const Transition& transition = transitions[state()];
+    if (transition.countdown)
+    {
+        set_countdown(countdown() - 1);
+        if (countdown() <= 0)
+            (this->*transition.handler)(settings, down);
+    }
+    else if (transition.handler)
+    {
+        (this->*transition.handler)(settings, down);
+    }
+
+    // For transitioning to falling
+    // Need to do this if it is swapped to prevent this scenario
+    // PP P
+    // BB B
+    // Swap the P over the empty space and it is matched.
+    if ((is_idle() || is_swapped()) && can_fall())
+    {
+        set_locked(is_swapped());
+        set_state(PENDING_FALL);
+        set_countdown(settings.pending_fall + settings.falling);
+        set_chain(down.is_match_end() || down.chain());
+    }
+
+    return is_swapped() || is_fall_end();
+}
+
 #endif
@@ -0,0 +1,87 @@
+#include "panel_matcher.hpp"
+#include "board_traits.hpp"
+
+constexpr int PanelMatcher::TYPES;
+
+PanelMatcher::PanelMatcher(int _rows) : rows(_rows), colors(_rows * TYPES), matchable(_rows), remove(_rows), ungrouped(_rows), grouped(_rows)
+{
+
+}
+
+void PanelMatcher::resize(int _rows)
+{
+    rows = _rows;
+    colors.assign(rows * TYPES, 0);
+    matchable.assign(rows, 0);
+    remove.assign(rows, 0);
+    ungrouped.assign(rows, 0);
+    grouped.assign(rows, 0);
+    types = 0;
+    group_type = 0;
+}
+
+void PanelMatcher::clear()
+{
+    for (auto& mask : colors)
+        mask = 0;
+    for (auto& mask : matchable)
+        mask = 0;
+}
+
+int PanelMatcher::find()
+{
+    return find(RuntimeBoard(rows, 0));
+}
+
+Panel::Type PanelMatcher::next_group()
+{
+    for (; group_type < TYPES; group_type++)
+    {
+        const int t = group_type;
+        for (int first = 0; first < rows; first++)
+        {
+            RowMask seed = ungrouped[first] & colors[first * TYPES + t];
+            if (seed == 0)
+                continue;
+
+            // Flood fill from one panel, rows above first have no panels of this type left.
+            for (int i = 0; i < rows; i++)
+                grouped[i] = 0;
+            grouped[first] = seed & -seed;
+
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (int i = first; i < rows; i++)
+                {
+                    const RowMask allowed = ungrouped[i] & colors[i * TYPES + t];
+                    RowMask row = grouped[i];
+                    if (i > first)
+                        row |= grouped[i - 1] & allowed;
+                    if (i + 1 < rows)
+                        row |= grouped[i + 1] & allowed;
+
+                    RowMask last;
+                    do
+                    {
+                        last = row;
+                        row |= ((row << 1) | (row >> 1)) & allowed;
+                    } while (row != last);
+
+                    if (row != grouped[i])
+                    {
+                        grouped[i] = row;
+                        changed = true;
+                    }
+                }
+            }
+
+            for (int i = first; i < rows; i++)
+                ungrouped[i] &= ~grouped[i];
+            return (Panel::Type) t;
+        }
+    }
+
+    return Panel::Type::EMPTY;
+}
@@ -0,0 +1,117 @@
+#ifndef PANEL_MATCHER_HPP
+#define PANEL_MATCHER_HPP
+
+#include "panel.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Finds horizontal and vertical runs of 3 or more panels using bitboards.
+ * Each row is stored as one bitmask per panel type plus a mask of matchable panels,
+ * bit j of a row mask is column j so boards are limited to 64 columns.
+ */
+class PanelMatcher
+{
+public:
+    typedef uint64_t RowMask;
+
+    explicit PanelMatcher(int rows);
+
+    /// Makes room for rows rows, reusing the storage already allocated.
+    void resize(int rows);
+
+    /// Removes all panels from the matcher.
+    void clear();
+    /// Adds the panel at i, j, which must not have been added since the last clear.
+    /// Only matchable panels can be part of a run so unmatchable panels are not recorded.
+    void add(int i, int j, Panel::Type type, bool can_match)
+    {
+        const RowMask bit = RowMask(can_match) << j;
+        colors[i * TYPES + (type & (TYPES - 1))] |= bit;
+        matchable[i] |= bit;
+    }
+
+    /// Finds all runs of 3 or more. Returns the number of panels that are to be removed.
+    int find();
+    /// Same as find with the rows of Board, see board_traits.hpp, so a board of fixed size has its rows unrolled.
+    template <class Board> int find(const Board& board);
+    /// Columns in row i that are to be removed. Valid after find.
+    RowMask removed(int i) const {return remove[i];}
+    /// Number of different panel types that are to be removed. Valid after find.
+    int types_matched() const {return types;}
+
+    /// Takes the next group of connected panels of the same type from the panels to be removed. Returns its type or EMPTY once all groups were taken.
+    Panel::Type next_group();
+    /// Columns in row i of the group taken by next_group.
+    RowMask group(int i) const {return grouped[i];}
+
+private:
+    static constexpr int TYPES = Panel::Type::SPECIAL;
+
+    int rows;
+    /// Per row mask for each panel type, indexed by i * TYPES + type
+    std::vector<RowMask> colors;
+    /// Per row mask of panels that can be matched
+    std::vector<RowMask> matchable;
+    /// Per row mask of panels found by find
+    std::vector<RowMask> remove;
+    /// Per row mask of panels found by find not yet taken by next_group
+    std::vector<RowMask> ungrouped;
+    /// Per row mask of the last group taken
+    std::vector<RowMask> grouped;
+    int types = 0;
+    /// Type next_group is looking at
+    int group_type = 0;
+};
+
+template <class Board> int PanelMatcher::find(const Board& board)
+{
+    unsigned int types_mask = 0;
+
+    board.each_row([&](int i) {remove[i] = 0;});
+
+    // EMPTY is never matchable so start with the first color.
+    for (int t = Panel::Type::RED; t < TYPES; t++)
+    {
+        board.each_row([&](int i)
+        {
+            RowMask row = colors[i * TYPES + t] & matchable[i];
+            if (row == 0)
+                return;
+
+            // Bit j of run is set if columns j, j + 1 and j + 2 are all set.
+            RowMask run = row & (row >> 1) & (row >> 2);
+            if (run != 0)
+            {
+                remove[i] |= run | (run << 1) | (run << 2);
+                types_mask |= 1 << t;
+            }
+
+            if (i + 2 >= board.rows())
+                return;
+
+            run = row & colors[(i + 1) * TYPES + t] & matchable[i + 1] & colors[(i + 2) * TYPES + t] & matchable[i + 2];
+            if (run != 0)
+            {
+                remove[i] |= run;
+                remove[i + 1] |= run;
+                remove[i + 2] |= run;
+                types_mask |= 1 << t;
+            }
+        });
+    }
+
+    int total = 0;
+    board.each_row([&](int i)
+    {
+        total += __builtin_popcountll(remove[i]);
+        ungrouped[i] = remove[i];
+    });
+    types = __builtin_popcount(types_mask);
+    group_type = Panel::Type::RED;
+
+    return total;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef PANEL_RANDOM_HPP
+#define PANEL_RANDOM_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Small seedable generator owned by each panel source, so tables share no state and a game can be generated again from its seed.
+ * The sequence is xoshiro128** with its state filled by splitmix64 from the seed. It only uses 32 bit operations, which are cheap
+ * on the 3DS. The sequence of a seed is part of the replay format and must never change.
+ */
+class PanelRandom
+{
+public:
+    explicit PanelRandom(uint32_t seed = 0) {set_seed(seed);}
+
+    /// Restarts the sequence of seed.
+    void set_seed(uint32_t seed)
+    {
+        uint64_t x = seed;
+        for (int k = 0; k < 4; k += 2)
+        {
+            const uint64_t z = splitmix64(x);
+            s[k] = (uint32_t) z;
+            s[k + 1] = (uint32_t) (z >> 32);
+        }
+    }
+
+    /// Next 32 random bits.
+    uint32_t next()
+    {
+        const uint32_t result = rotl(s[1] * 5, 7) * 9;
+        const uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    /// Copies the state of the sequence to state, 4 values, so it can be restored with load.
+    void save(uint32_t* state) const {std::copy(s, s + 4, state);}
+    /// Goes on from a state copied by save.
+    void load(const uint32_t* state) {std::copy(state, state + 4, s);}
+
+    /// Value from 0 to max - 1, from the high bits of next scaled without a division.
+    int next(int max) {return (int) (((uint64_t) next() * (uint32_t) max) >> 32);}
+    /// Value from start to end inclusive.
+    int range(int start, int end) {return next(end - start + 1) + start;}
+
+    /// Shuffles count values with the Fisher-Yates shuffle.
+    template <class T>
+    void shuffle(T* values, int count)
+    {
+        for (int i = count - 1; i > 0; i--)
+        {
+            const int j = next(i + 1);
+            const T value = values[i];
+            values[i] = values[j];
+            values[j] = value;
+        }
+    }
+
+private:
+    static uint32_t rotl(uint32_t x, int k) {return (x << k) | (x >> (32 - k));}
+    static uint64_t splitmix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t s[4];
+};
+
+#endif
@@ -1,17 +1,6 @@
 #include "panel_source.hpp"
-#include <cstdlib>
 #include <algorithm>
 
-inline int randomInt(int max)
-{
-    return rand() / (RAND_MAX / max + 1);
-}
-
-inline int randomInt(int start, int end)
-{
-    return randomInt(end - start + 1) + start;
-}
-
 #define BOARD_CONFIGURATION_SIZE 46
 // Array of combinations of 6 values summing to 30.
 int board_configurations[BOARD_CONFIGURATION_SIZE][6] = {
@@ -63,7 +52,9 @@ int board_configurations[BOARD_CONFIGURATION_SIZE][6] = {
     {5, 5, 5, 5, 5, 5},
 };
 
-PanelSource::PanelSource(int _rows, int _columns) : rows(_rows), columns(_columns)
+constexpr int PanelSource::QUEUE_LINES;
+
+PanelSource::PanelSource(int _rows, int _columns) : rows(_rows), columns(_columns), queue(QUEUE_LINES * _columns), scratch(_columns)
 {
 
 }
@@ -84,59 +75,188 @@ std::vector<Panel::Type> PanelSource::board()
     return board;
 }
 
-std::vector<Panel::Type> PanelSource::line()
+void PanelSource::line(std::vector<Panel::Type>& next)
 {
-    std::vector<Panel::Type> next(columns, Panel::Type::EMPTY);
     for (int i = 0; i < columns; i++)
         next[i] = panel();
-    return next;
 }
 
+/// Draws panel_except makes before giving up on a source that keeps returning excluded types.
+static const int panel_except_draws = 32;
+
+Panel::Type PanelSource::panel_except(uint32_t excluded)
+{
+    // A source may have nothing but excluded types to give, the match can't be avoided then.
+    Panel::Type type = panel();
+    for (int draw = 1; draw < panel_except_draws && (excluded >> type & 1); draw++)
+        type = panel();
+    return type;
+}
+
+void PanelSource::fill()
+{
+    // Generating in batches leaves most frames with nothing to do.
+    if (count >= QUEUE_LINES / 2)
+        return;
+    for (; count < QUEUE_LINES; count++)
+        generate_line(&queue[(first + count) % QUEUE_LINES * columns]);
+}
+
+bool PanelSource::reseed(uint32_t seed)
+{
+    if (!restart(seed))
+        return false;
+    first = 0;
+    count = 0;
+    return true;
+}
+
+bool PanelSource::save(PanelSourceSnapshot& snapshot) const
+{
+    if (columns > SNAPSHOT_MAX_COLUMNS)
+        return false;
+
+    snapshot.columns = columns;
+    snapshot.first = first;
+    snapshot.count = count;
+    snapshot.seed = 0;
+    std::fill(snapshot.random, snapshot.random + 4, 0);
+    std::fill(snapshot.redraws, snapshot.redraws + 4, 0);
+    snapshot.sequence = 0;
+    for (int k = 0; k < QUEUE_LINES * SNAPSHOT_MAX_COLUMNS; k++)
+        snapshot.queue[k] = k < (int) queue.size() ? queue[k] : Panel::Type::EMPTY;
+    save_generator(snapshot);
+    return true;
+}
+
+bool PanelSource::load(const PanelSourceSnapshot& snapshot)
+{
+    if (snapshot.columns != columns || snapshot.first >= QUEUE_LINES || snapshot.count > QUEUE_LINES)
+        return false;
+
+    first = snapshot.first;
+    count = snapshot.count;
+    for (unsigned int k = 0; k < queue.size(); k++)
+        queue[k] = (Panel::Type) snapshot.queue[k];
+    load_generator(snapshot);
+    return true;
+}
+
+void PanelSource::take(std::vector<Panel::Type>& next)
+{
+    if (count == 0)
+    {
+        generate_line(next.data());
+        return;
+    }
+
+    std::copy(preview(0), preview(0) + columns, next.begin());
+    first = (first + 1) % QUEUE_LINES;
+    count--;
+}
 
-/// Generates n values which sum to total each value being < max
-/// TODO Remove this function.
-std::vector<int> generate_values(int n, int total, int max)
+void PanelSource::generate_line(Panel::Type* next)
 {
-    std::vector<int> values(n, 0);
-    while(1)
+    line(scratch);
+    for (int j = 0; j < columns; j++)
     {
-		int sum = 0;
-        for (int i = 0; i < n - 1; i++)
-        {
-            int value = randomInt(max);
-            values[i] = value;
-            sum += value;
-        }
-		int left = total - sum;
-        if (left >= 0 && left <= max)
-        {
-            values[n - 1] = left;
-            break;
-        }
+        next[j] = scratch[j];
+        // Only the rule along the line is known here, the one with the board is left to the table.
+        if (j >= 2 && next[j - 1] != Panel::Type::EMPTY && next[j - 1] == next[j - 2] && next[j] == next[j - 1])
+            next[j] = panel_except(1u << next[j - 1]);
     }
-    return values;
 }
 
-std::vector<int> generate_board_setup()
+
+/// Column heights for the initial board, 5 / 12 of the board is filled and no column is more than 7 / 12 full like the 6x12 layouts.
+std::vector<int> generate_board_setup(int rows, int columns, PanelRandom& random)
 {
-    int configuration = randomInt(BOARD_CONFIGURATION_SIZE);
-    std::vector<int> ret(board_configurations[configuration], board_configurations[configuration] + 6);
-    std::random_shuffle(ret.begin(), ret.end());
-    return ret;
+    if (rows == 12 && columns == 6)
+    {
+        int configuration = random.next(BOARD_CONFIGURATION_SIZE);
+        std::vector<int> ret(board_configurations[configuration], board_configurations[configuration] + 6);
+        random.shuffle(ret.data(), (int) ret.size());
+        return ret;
+    }
+
+    const int max = rows * 7 / 12;
+    const int total = std::min(rows * columns * 5 / 12, max * columns);
+    std::vector<int> heights(columns, total / columns);
+    for (int j = 0; j < total % columns; j++)
+        heights[j]++;
 
+    // Move panels between random columns keeping the total.
+    for (int k = 0; k < columns * 4; k++)
+    {
+        int from = random.next(columns);
+        int to = random.next(columns);
+        int amount = std::min(std::min(random.next(max / 2 + 1), heights[from]), max - heights[to]);
+        heights[from] -= amount;
+        heights[to] += amount;
+    }
+    return heights;
 }
 
-RandomPanelSource::RandomPanelSource(int rows, int columns, int _colors) : PanelSource(rows, columns), colors(_colors)
+/// Seed of the redraws sequence of a RandomPanelSource
+static uint32_t redraw_seed(uint32_t seed)
+{
+    return seed ^ 0x9E3779B9;
+}
+
+RandomPanelSource::RandomPanelSource(int rows, int columns, int _colors, uint32_t _seed) : PanelSource(rows, columns), colors(_colors),
+    seed(_seed), random(_seed), redraws(redraw_seed(_seed))
 {
 
 }
 
 std::vector<int> RandomPanelSource::board_layout()
 {
-    return generate_board_setup();
+    return generate_board_setup(rows, columns, random);
 }
 
 Panel::Type RandomPanelSource::panel()
 {
-    return (Panel::Type) randomInt(1, colors);
+    return (Panel::Type) random.range(1, colors);
+}
+
+Panel::Type RandomPanelSource::panel_except(uint32_t excluded)
+{
+    return draw_except(random, excluded);
+}
+
+Panel::Type RandomPanelSource::redraw(uint32_t excluded)
+{
+    return draw_except(redraws, excluded);
+}
+
+Panel::Type RandomPanelSource::draw_except(PanelRandom& random, uint32_t excluded) const
+{
+    const uint32_t types = ((1u << colors) - 1) << Panel::Type::RED;
+    // With fewer than 3 colors there may be nothing left to choose from, a match can't be avoided then.
+    uint32_t allowed = types & ~excluded ? types & ~excluded : types;
+    for (int k = random.next(__builtin_popcount(allowed)); k > 0; k--)
+        allowed &= allowed - 1;
+    return (Panel::Type) __builtin_ctz(allowed);
+}
+
+bool RandomPanelSource::restart(uint32_t _seed)
+{
+    seed = _seed;
+    random.set_seed(seed);
+    redraws.set_seed(redraw_seed(seed));
+    return true;
+}
+
+void RandomPanelSource::save_generator(PanelSourceSnapshot& snapshot) const
+{
+    snapshot.seed = seed;
+    random.save(snapshot.random);
+    redraws.save(snapshot.redraws);
+}
+
+void RandomPanelSource::load_generator(const PanelSourceSnapshot& snapshot)
+{
+    seed = snapshot.seed;
+    random.load(snapshot.random);
+    redraws.load(snapshot.redraws);
 }
@@ -2,8 +2,11 @@
 #define PANEL_SOURCE_HPP
 
 #include "panel.hpp"
+#include "panel_random.hpp"
 #include <vector>
 
+struct PanelSourceSnapshot;
+
 class PanelSource
 {
 public:
@@ -16,24 +19,113 @@ public:
     virtual std::vector<int> board_layout() {return std::vector<int>();};
     /// Get a panel, used for generating the initial board
     virtual Panel::Type panel() = 0;
+    /// Get a panel whose type is not in excluded, a mask with a bit set for each type not allowed. At most two types are excluded.
+    /// Used to replace a panel that made 3 in a row. Default implementation calls panel until it returns an allowed type,
+    /// giving up after a bounded number of draws with an excluded type if the source has no other.
+    virtual Panel::Type panel_except(uint32_t excluded);
+    /// Get a panel whose type is not in excluded for a panel the table makes outside of the lines,
+    /// one replacing a panel found making 3 in a row with the board or one a garbage block shatters into.
+    /// Seeded sources draw these from a sequence of their own, so when lines are generated ahead does not change the game.
+    /// Default implementation calls panel_except.
+    virtual Panel::Type redraw(uint32_t excluded) {return panel_except(excluded);}
     /// Get a line of panels, used for generating next set of panels
+    /// Fills next which already holds columns values so no allocation is needed.
     /// Default implementation calls panel "columns" times.
-    virtual std::vector<Panel::Type> line();
+    virtual void line(std::vector<Panel::Type>& next);
+
+    /// Most lines generated ahead.
+    static constexpr int QUEUE_LINES = 8;
+    /// Generates lines ahead once fewer than half of QUEUE_LINES are left, for frames with time to spare.
+    void fill();
+    /// Takes the next line into next, which holds columns values. The line is generated now if none was generated ahead.
+    void take(std::vector<Panel::Type>& next);
+    /// Number of lines generated ahead
+    int queued() const {return count;}
+    /** Line k of the lines generated ahead, 0 is the one taken next. Holds columns panels.
+      * A line never has 3 in a row along it, but the table may still replace a panel making 3 in a row with the board when it takes the line. */
+    const Panel::Type* preview(int k) const {return &queue[(first + k) % QUEUE_LINES * columns];}
+
+    /// Size of the board the source generates panels for
+    int height() const {return rows;}
+    int width() const {return columns;}
+    /// Starts the panels over as if the source was created with seed, dropping the lines generated ahead. Returns false if the source has no seed.
+    bool reseed(uint32_t seed);
+
+    /// Copies the lines generated ahead and the generator of the source into snapshot. Returns false if the board is too wide to be saved.
+    bool save(PanelSourceSnapshot& snapshot) const;
+    /// Goes on from a snapshot saved by a source of the same kind. Returns false leaving the source as it was if it is for another width.
+    bool load(const PanelSourceSnapshot& snapshot);
 
 protected:
+    /// Restarts the sequence of a seeded source from seed, returns false if it has none.
+    virtual bool restart(uint32_t /*seed*/) {return false;}
+    /// Saves and restores the generator of the source, a source without one has nothing to save.
+    virtual void save_generator(PanelSourceSnapshot& /*snapshot*/) const {}
+    virtual void load_generator(const PanelSourceSnapshot& /*snapshot*/) {}
+
     int rows;
     int columns;
+
+private:
+    /// Fills line with the next line from the source, replacing the panels making 3 in a row along it.
+    void generate_line(Panel::Type* line);
+
+    /// QUEUE_LINES lines of columns panels used as a ring
+    std::vector<Panel::Type> queue;
+    /// Line of the queue taken next
+    int first = 0;
+    /// Number of lines in the queue
+    int count = 0;
+    /// Passed to line
+    std::vector<Panel::Type> scratch;
+};
+
+/** Trivially copyable copy of the state of a PanelSource that decides the panels it generates next, saved with the table in a PanelTableSnapshot. */
+struct PanelSourceSnapshot
+{
+    uint8_t columns;
+    /// Line of the queue taken next
+    uint8_t first;
+    /// Number of lines generated ahead
+    uint8_t count;
+    /// Seed of a seeded source
+    uint32_t seed;
+    /// Generators of a RandomPanelSource
+    uint32_t random[4];
+    uint32_t redraws[4];
+    /// Position of a source that draws from a single 32 bit sequence
+    uint32_t sequence;
+    /// Lines generated ahead, QUEUE_LINES lines of columns panels used as a ring
+    uint8_t queue[PanelSource::QUEUE_LINES * SNAPSHOT_MAX_COLUMNS];
 };
 
+/** Random panels of colors types. The panels only depend on the seed, so the same seed always generates the same game. */
 class RandomPanelSource : public PanelSource
 {
 public:
-    RandomPanelSource(int rows, int columns, int colors);
+    RandomPanelSource(int rows, int columns, int colors, uint32_t seed);
     ~RandomPanelSource() override {}
     std::vector<int> board_layout() override;
     Panel::Type panel() override;
+    /// Draws once from the allowed types.
+    Panel::Type panel_except(uint32_t excluded) override;
+    /// Draws once from the allowed types with the redraws sequence.
+    Panel::Type redraw(uint32_t excluded) override;
+    /// Seed the source was created with
+    uint32_t get_seed() const {return seed;}
+protected:
+    bool restart(uint32_t seed) override;
+    void save_generator(PanelSourceSnapshot& snapshot) const override;
+    void load_generator(const PanelSourceSnapshot& snapshot) override;
 private:
+    /// Draws a type of colors not in excluded from random.
+    Panel::Type draw_except(PanelRandom& random, uint32_t excluded) const;
+
     int colors;
+    uint32_t seed;
+    PanelRandom random;
+    /// Sequence for redraw, seeded from seed
+    PanelRandom redraws;
 };
 
 #endif
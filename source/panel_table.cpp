@@ -1,8 +1,41 @@
 #include "panel_table.hpp"
+#include "board_traits.hpp"
 
-PanelTable::PanelTable(const Options& opts) : source(opts.source), settings(opts.settings), panels(opts.columns * opts.rows), next(opts.columns), columns(opts.columns), rows(opts.rows), moves(opts.moves),
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+/// Columns of a board of opts cut down to the limits of a table.
+static int table_columns(const PanelTable::Options& opts)
+{
+    return std::max(1, std::min(opts.columns, MAX_TABLE_COLUMNS));
+}
+
+/// Rows of a board of opts cut down to the limits of a table.
+static int table_rows(const PanelTable::Options& opts)
+{
+    return std::max(1, std::min(opts.rows, MAX_TABLE_ROWS));
+}
+
+/// Do the match times and countdowns of removing all panels of a board at once stay within limit.
+static bool match_times_fit(const PanelSpeedSettings& settings, int64_t panels, int64_t limit)
+{
+    return settings.first_removed + panels * settings.subsequent_removed <= limit &&
+        settings.pending_match + (settings.subsequent_removed - 1) * (panels - 1) <= limit;
+}
+
+bool PanelTable::valid(const Options& opts)
+{
+    if (opts.columns < 1 || opts.columns > MAX_TABLE_COLUMNS || opts.rows < 1 || opts.rows > MAX_TABLE_ROWS)
+        return false;
+    return match_times_fit(opts.settings, opts.rows * opts.columns, INT32_MAX);
+}
+
+PanelTable::PanelTable(const Options& opts) : source(opts.source), settings(opts.settings), next_line(table_columns(opts)),
+    matcher(table_rows(opts)), columns(table_columns(opts)), rows(table_rows(opts)), moves(opts.moves),
     type(opts.type)
 {
+    assert(valid(opts));
     if (type == ENDLESS)
         state = RISING;
     if (type == MOVES)
@@ -12,152 +45,684 @@ PanelTable::PanelTable(const Options& opts) : source(opts.source), settings(opts
     generate();
 }
 
-void PanelTable::clear()
+bool PanelTable::reset(const Options& opts, uint32_t seed)
 {
-    for (auto& panel : panels)
-        panel.type = Panel::Type::EMPTY;
-
-    for (auto& panel : next)
-        panel.type = Panel::Type::EMPTY;
+    // Checked before reseeding so a rejected reset leaves the kept source in step with the board.
+    if (!valid(opts) || !can_reset(opts))
+        return false;
+    (opts.source ? opts.source : source.get())->reseed(seed);
+    return reset(opts);
 }
 
-void PanelTable::init()
+bool PanelTable::reset(const Options& opts)
 {
-    // Handle plumbing things together
-    for (auto& panel : next)
+    if (!valid(opts) || !can_reset(opts))
+        return false;
+    if (opts.source && opts.source != source.get())
+        source.reset(opts.source);
+    settings = opts.settings;
+    moves = opts.moves;
+    type = opts.type;
+    state = type == MOVES ? PUZZLE : RISING;
+    rise_counter = 0;
+    rise = 0;
+    speed = 0;
+    stopped = false;
+    timeout = 0;
+    clink = 0;
+    chain = 0;
+    lines = 0;
+    match_groups.clear();
+    garbage.clear();
+
+    if (table_rows(opts) != rows || table_columns(opts) != columns)
     {
-        panel.settings = &settings;
-        panel.state = Panel::State::BOTTOM;
+        rows = table_rows(opts);
+        columns = table_columns(opts);
+        next_line.resize(columns);
+        matcher.resize(rows);
     }
+    // The views are rebuilt in the storage they already have.
+    panels.clear();
+    next.clear();
 
-    for (int i = 0; i < rows; i++)
-    {
-        for (int j = 0; j < columns; j++)
-        {
-            int id = j + i * columns;
-            auto& panel = panels[id];
-            panel.settings = &settings;
-            panel.up    = i == 0           ? nullptr  : &panels[id - columns];
-            panel.down  = i == rows - 1    ? &next[j] : &panels[id + columns];
-            panel.left  = j == 0           ? nullptr  : &panels[id - 1];
-            panel.right = j == columns - 1 ? nullptr  : &panels[id + 1];
-        }
-    }
+    // Recording starts again afterwards with no changes, as if it was turned on for a new table.
+    const bool record = data.changes != nullptr;
+    data.changes = nullptr;
+    init();
+    generate();
+    set_record_changes(record);
+    return true;
 }
 
-void PanelTable::generate()
+void PanelTable::clear()
+{
+    settle();
+    for (auto& type : data.type)
+        type = Panel::Type::EMPTY;
+    garbage.clear();
+    data.recount();
+}
+
+void PanelTable::init()
+{
+    data.resize(rows, columns);
+    data.settings = &settings;
+
+    for (int j = 0; j < columns; j++)
+        data.set_state(rows * columns + j, Panel::State::BOTTOM);
+
+    panels.reserve(rows * columns);
+    for (int i = 0; i < rows * columns; i++)
+        panels.emplace_back(&data, i);
+
+    next.reserve(columns);
+    for (int j = 0; j < columns; j++)
+        next.emplace_back(&data, rows * columns + j);
+
+    // Every group has at least 3 panels.
+    match_groups.groups.reserve(rows * columns / 3);
+    match_groups.cells.reserve(rows * columns);
+    garbage.reserve(SNAPSHOT_MAX_GARBAGE);
+    // Each segment has a panel of its own.
+    falls.clear();
+    falls.reserve(rows * columns);
+    next_falls.clear();
+    next_falls.reserve(rows * columns);
+
+    select_engine();
+}
+
+void PanelTable::select_engine()
 {
-    clear();
+    // The board of every game mode with the settings of a difficulty has its loops unrolled and its settings folded in.
+    const bool standard = !generic && rows == 12 && columns == 6;
+    if (standard && same_settings(settings, EasySpeed::settings()))
+        engine = &PanelTable::update_board<FixedBoard<12, 6, EasySpeed>>;
+    else if (standard && same_settings(settings, NormalSpeed::settings()))
+        engine = &PanelTable::update_board<FixedBoard<12, 6, NormalSpeed>>;
+    else if (standard && same_settings(settings, HardSpeed::settings()))
+        engine = &PanelTable::update_board<FixedBoard<12, 6, HardSpeed>>;
+    else
+        engine = &PanelTable::update_board<RuntimeBoard>;
+    specialised = engine != &PanelTable::update_board<RuntimeBoard>;
+}
+
+void PanelTable::set_generic_engine(bool generic_engine)
+{
+    generic = generic_engine;
+    select_engine();
+}
 
-    // Generate initial board.
+void PanelTable::set_falling_segments(bool enabled)
+{
+    settle();
+    segments = enabled;
+}
+
+void PanelTable::generate()
+{
+    // Generate initial board. The board was left empty by init and is counted once it is filled.
     std::vector<Panel::Type> values = source->board();
-    for (unsigned int i = 0; i < panels.size(); i++)
-        panels[i].type = values[i];
+    for (int i = 0; i < rows * columns; i++)
+        data.type[data.slot(i)] = values[i];
 
-    // Correction for 3 in a row/column.
-    for (int i = 0; i < rows; i++)
+    // Correction for 3 in a row/column. Going up from the bottom the panels below and to the left are final, so a panel making
+    // 3 in a row with them is drawn again once from the types that don't.
+    for (int i = rows - 1; i >= 0; i--)
     {
         for (int j = 0; j < columns; j++)
         {
-            int id = i * columns + j;
-            while (vertical(i, j))
-                panels[id + columns].type = source->panel();
-            while (horizontal(i, j) || (i >= 2 && vertical(i - 2, j + 1)) || (i >= 1 && vertical(i - 1, j + 1)))
-                panels[id + 1].type = source->panel();
+            if (!matchable(i, j))
+                continue;
+            const uint32_t excluded = board_conflicts(i, j);
+            if (excluded >> value(i, j) & 1)
+                data.type[data.slot(i * columns + j)] = source->redraw(excluded);
         }
     }
 
+    data.activate_all();
+    data.recount();
+
     if (state == RISING)
         generate_next();
 }
 
 void PanelTable::generate_next()
 {
-    const auto& next_panels = source->line();
+    uint8_t* next_row = &data.type[data.slot(rows * columns)];
+    data.type_hash -= data.type_sum(rows * columns, columns);
+
+    source->take(next_line);
     for (int i = 0; i < columns; i++)
     {
-        next[i].type = next_panels[i];
+        next_row[i] = next_line[i];
     }
 
     for (int j = 0; j < columns; j++)
     {
-        while(next_vertical_error(j) || (j >= 2 && next_horizontal_error(j - 2)) || (j >= 1 && next_horizontal_error(j - 1)))
-            next[j].type = source->panel();
-        while (next_horizontal_error(j) && j + 2 < columns)
-            next[j + 1].type = source->panel();
+        const uint32_t excluded = next_conflicts(j);
+        if (excluded >> next_row[j] & 1)
+            next_row[j] = source->redraw(excluded);
     }
+
+    data.type_hash += data.type_sum(rows * columns, columns);
+
+    if (data.changes)
+    {
+        changes.generated = true;
+        for (int j = 0; j < columns; j++)
+            changes.mark(rows * columns + j);
+    }
+}
+
+bool PanelTable::cleared_lines(int line)
+{
+    int bottom_line = lines;
+    int top_line = lines - rows;
+
+    if (!(line >= top_line && line <= bottom_line))
+        return false;
+
+    int offset = std::min(line - top_line, rows - 1);
+    return first_filled_row() >= offset;
 }
 
-bool PanelTable::warning() const
+std::vector<bool> PanelTable::danger_columns() const
 {
+    std::vector<bool> danger(columns, false);
     for (int j = 0; j < columns; j++)
+        danger[j] = danger_column(j);
+    return danger;
+}
+
+bool PanelTable::save_state(PanelTableSnapshot& snapshot) const
+{
+    if (rows > SNAPSHOT_MAX_ROWS || columns > SNAPSHOT_MAX_COLUMNS || !match_times_fit(settings, rows * columns, INT16_MAX) ||
+        !source->save(snapshot.source))
+        return false;
+
+    settle();
+    snapshot.rows = rows;
+    snapshot.columns = columns;
+    snapshot.state = state;
+    snapshot.stopped = stopped;
+    snapshot.moves = moves;
+    snapshot.rise_counter = rise_counter;
+    snapshot.rise = rise;
+    snapshot.speed = speed;
+    snapshot.timeout = timeout;
+    snapshot.clink = clink;
+    snapshot.chain = chain;
+    snapshot.lines = lines;
+
+    for (int i = 0; i < rows * columns; i++)
+        view(i).save(snapshot.panels[i]);
+    for (int j = 0; j < columns; j++)
+        view(rows * columns + j).save(snapshot.next[j]);
+
+    snapshot.garbage_count = garbage.size();
+    for (int k = 0; k < SNAPSHOT_MAX_GARBAGE; k++)
+        snapshot.garbage[k] = k < (int) garbage.size() ? garbage[k] : GarbageSpan {0, 0, 0, 0, 0, 0};
+
+    return true;
+}
+
+bool PanelTable::load_state(const PanelTableSnapshot& snapshot)
+{
+    if (snapshot.rows != rows || snapshot.columns != columns || snapshot.garbage_count > SNAPSHOT_MAX_GARBAGE ||
+        !source->load(snapshot.source))
+        return false;
+
+    begin_changes();
+    settle();
+    state = (State) snapshot.state;
+    stopped = snapshot.stopped;
+    moves = snapshot.moves;
+    rise_counter = snapshot.rise_counter;
+    rise = snapshot.rise;
+    speed = snapshot.speed;
+    timeout = snapshot.timeout;
+    clink = snapshot.clink;
+    chain = snapshot.chain;
+    lines = snapshot.lines;
+
+    for (int i = 0; i < rows * columns; i++)
+        Panel(&data, i).load(snapshot.panels[i]);
+    for (int j = 0; j < columns; j++)
+        Panel(&data, rows * columns + j).load(snapshot.next[j]);
+    data.activate_all();
+    garbage.assign(snapshot.garbage, snapshot.garbage + snapshot.garbage_count);
+
+    return true;
+}
+
+uint64_t PanelTable::hash() const
+{
+    settle();
+    return table_hash(data.hash, data.type_hash + data.countdown_hash, false);
+}
+
+uint64_t PanelTable::table_hash(uint64_t panels, uint64_t sums, bool mirrored) const
+{
+    const int values[] = {state, stopped, moves, rise_counter, rise, speed, timeout, clink, chain, lines};
+    uint64_t hash = panels;
+    for (int k = 0; k < (int) (sizeof(values) / sizeof(values[0])); k++)
+        hash ^= PanelData::key(-1, k, values[k]);
+
+    // Spans never overlap so each is keyed by all of its fields, independent of their order.
+    for (const auto& span : garbage)
     {
-        // Row 1
-        if (!top(j)->down->empty())
-            return true;
+        const uint8_t x = mirrored ? columns - span.x - span.width : span.x;
+        hash ^= PanelData::mix(0x6A09E667F3BCC908ULL ^ (x | (uint64_t) span.width << 8 | (uint64_t) (uint16_t) span.y << 16 |
+            (uint64_t) span.height << 32 | (uint64_t) span.state << 40 | (uint64_t) (uint16_t) span.countdown << 48));
     }
-    return false;
+
+    // The type and countdown terms are linear so their sum is mixed once more.
+    return hash ^ PanelData::mix(sums);
 }
 
-bool PanelTable::danger() const
+uint64_t PanelTable::mirrored_hash() const
 {
-    for (int j = 0; j < columns; j++)
+    settle();
+    uint64_t panels = 0;
+    uint64_t sums = 0;
+    for (int i = 0; i < data.size; i++)
+    {
+        // Each panel is hashed as if it was in the mirrored column, swapping panels trade sides.
+        const int row = i / columns;
+        const int mirror = row * columns + columns - 1 - (i - row * columns);
+        int state = data.state[i];
+        if (state == Panel::State::LEFT_SWAP || state == Panel::State::RIGHT_SWAP)
+            state ^= Panel::State::LEFT_SWAP ^ Panel::State::RIGHT_SWAP;
+
+        panels ^= PanelData::key(mirror, PanelData::OLD, data.old[i]);
+        panels ^= PanelData::key(mirror, PanelData::STATE, state) ^ PanelData::key(mirror, PanelData::FLAGS, data.flags[i]);
+        panels ^= PanelData::key(mirror, PanelData::MATCH_TIME, data.match_time[i]) ^ PanelData::key(mirror, PanelData::REMOVE_TIME, data.remove_time[i]);
+        sums += PanelData::type_key(data.type[data.slot(i)]) * data.position_keys[mirror];
+        sums += data.countdown[i] * data.countdown_keys[mirror];
+    }
+    return table_hash(panels, sums, true);
+}
+
+uint64_t PanelTable::canonical_hash() const
+{
+    return std::min(hash(), mirrored_hash());
+}
+
+void PanelTable::swap(int i, int j)
+{
+    // The right panel is j + 1 so the last column can't be swapped.
+    if (i < 0 || i >= rows || j < 0 || j >= columns - 1)
+        return;
+
+    settle();
+    Panel left(&data, i * columns + j);
+
+    if (!left.can_swap() || (type == MOVES && moves <= 0))
+        return;
+
+    begin_changes();
+
+    left.swap();
+
+    moves -= 1;
+}
+
+// Bits of SwapEvaluation::board
+#define SWAP_TYPE_MASK 0x0F
+#define SWAP_LANDED_CHAIN 0x80
+
+void PanelTable::evaluate_swaps(SwapEvaluation& evaluation) const
+{
+    settle();
+    evaluation.rows = rows;
+    evaluation.columns = columns;
+    evaluation.swaps.resize(rows * (columns - 1));
+    evaluation.board.resize(rows * columns);
+
+    // Each panel as it is on the frame a swap made now ends. A panel landed now has lost the chain flag by then,
+    // one falling in place keeps it only if it lands on that very frame.
+    const int swap_end = std::max(settings.swap, 1);
+    uint8_t* board = evaluation.board.data();
+    for (int k = 0; k < rows * columns; k++)
     {
-        // row 0
-        if (!top(j)->empty())
-            return true;
+        const Panel panel = view(k);
+        const Panel down = panel.down();
+        const int lands = std::max(panel.get_countdown(), 1);
+        if (panel.is_falling() && panel.normal() && lands <= swap_end &&
+            (down.is_bottom() || (!(down.empty() && down.is_idle()) && (down.empty() || !down.is_falling_process()))))
+            board[k] = panel.get_value() | (lands == swap_end && panel.chain() ? SWAP_LANDED_CHAIN : 0);
+        else
+            board[k] = panel.can_match() ? panel.get_value() : Panel::Type::EMPTY;
+    }
+
+    const bool out_of_moves = type == MOVES && moves <= 0;
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < columns - 1; j++)
+        {
+            SwapEvaluation::Swap& swap = evaluation.swaps[i * (columns - 1) + j];
+            const Panel left = view(i * columns + j);
+            swap.legal = !out_of_moves && left.can_swap();
+            swap.cleared = 0;
+            swap.chain = false;
+            if (!swap.legal)
+                continue;
+
+            // A match made by the swap has one of the swapped panels, which can be matched once swapped unless they fall.
+            const Panel right = view(i * columns + j + 1);
+            uint8_t swapped[2] = {(uint8_t) right.get_value(), (uint8_t) left.get_value()};
+            for (int side = 0; side < 2; side++)
+            {
+                const Panel down = view((i + 1) * columns + j + side);
+                const bool falls = !down.is_bottom() && (down.is_falling_process() || (down.empty() && (down.is_idle() || down.is_swapped() || down.is_match_end())));
+                if (falls || swapped[side] == Panel::Type::SPECIAL)
+                    swapped[side] = Panel::Type::EMPTY;
+            }
+
+            auto at = [&](int c) -> int {return c == j ? swapped[0] : c == j + 1 ? swapped[1] : board[i * columns + c] & SWAP_TYPE_MASK;};
+            uint64_t row_cells = 0;
+            int cleared = 0;
+            bool chain = false;
+            for (int side = 0; side < 2; side++)
+            {
+                const int c = j + side;
+                const int t = swapped[side];
+                if (t == Panel::Type::EMPTY)
+                    continue;
+
+                int first = c;
+                int last = c;
+                while (first > 0 && at(first - 1) == t)
+                    first--;
+                while (last < columns - 1 && at(last + 1) == t)
+                    last++;
+                if (last - first >= 2)
+                    row_cells |= ((2ULL << (last - first)) - 1) << first;
+
+                int top = i;
+                int bottom = i;
+                while (top > 0 && (board[(top - 1) * columns + c] & SWAP_TYPE_MASK) == t)
+                    top--;
+                while (bottom < rows - 1 && (board[(bottom + 1) * columns + c] & SWAP_TYPE_MASK) == t)
+                    bottom++;
+                if (bottom - top >= 2)
+                {
+                    cleared += bottom - top;
+                    row_cells |= 1ULL << c;
+                    for (int r = top; r <= bottom; r++)
+                        chain |= r != i && (board[r * columns + c] & SWAP_LANDED_CHAIN);
+                }
+            }
+
+            cleared += __builtin_popcountll(row_cells);
+            row_cells &= ~(3ULL << j);
+            while (row_cells != 0)
+            {
+                chain |= board[i * columns + __builtin_ctzll(row_cells)] & SWAP_LANDED_CHAIN;
+                row_cells &= row_cells - 1;
+            }
+
+            swap.cleared = cleared;
+            swap.chain = chain;
+        }
     }
-    return false;
 }
 
-bool PanelTable::all_idle() const
+void PanelTable::legal_swaps(std::vector<Point>& swaps) const
 {
-    for (const auto& panel : panels)
+    swaps.clear();
+    if (type == MOVES && moves <= 0)
+        return;
+    settle();
+
+    // A symmetric board reaches mirrored positions from mirrored swaps so only one of each pair is needed.
+    const int last = is_symmetric() ? (columns - 2) / 2 : columns - 2;
+    for (int i = 0; i < rows; i++)
     {
-        if (!panel.is_idle())
-            return false;
+        for (int j = 0; j <= last; j++)
+        {
+            if (data.type[data.slot(i * columns + j)] != data.type[data.slot(i * columns + j + 1)] && view(i * columns + j).can_swap())
+                swaps.emplace_back(j, i);
+        }
     }
-    return true;
 }
 
-bool PanelTable::cleared_lines(int line)
+static bool garbage_order(const GarbageSpan& a, const GarbageSpan& b)
 {
-    int bottom_line = lines;
-    int top_line = lines - rows;
+    return a.bottom() != b.bottom() ? a.bottom() > b.bottom() : a.x < b.x;
+}
 
-    if (!(line >= top_line && line <= bottom_line))
+/// Do two spans share an edge.
+static bool garbage_touching(const GarbageSpan& a, const GarbageSpan& b)
+{
+    if (a.bottom() + 1 == b.y || b.bottom() + 1 == a.y)
+        return (a.columns() & b.columns()) != 0;
+    return a.y <= b.bottom() && b.y <= a.bottom() && ((a.columns() << 1 | a.columns() >> 1) & b.columns()) != 0;
+}
+
+bool PanelTable::add_garbage(int x, int width, int height)
+{
+    if (x < 0 || width <= 0 || height <= 0 || x + width > columns || height > std::min(rows, 255) || garbage.size() >= SNAPSHOT_MAX_GARBAGE)
         return false;
 
-    int offset = std::min(line - top_line, rows - 1);
-    for (int i = 0; i < offset; i++)
+    // Starts just above the board or on top of the garbage waiting above it.
+    GarbageSpan span = {0, (int8_t) x, (uint8_t) width, (uint8_t) height, GarbageSpan::IDLE, 0};
+    int y = -height;
+    for (const auto& other : garbage)
     {
-        for (int j = 0; j < columns; j++)
+        if (other.y < 0 && (other.columns() & span.columns()))
+            y = std::min(y, other.y - height);
+    }
+    if (y < INT16_MIN)
+        return false;
+
+    span.y = y;
+    garbage.push_back(span);
+    std::sort(garbage.begin(), garbage.end(), garbage_order);
+    return true;
+}
+
+const GarbageSpan* PanelTable::garbage_at(int i, int j) const
+{
+    for (const auto& span : garbage)
+    {
+        if (i >= span.y && i <= span.bottom() && (span.columns() >> j & 1))
+            return &span;
+    }
+    return nullptr;
+}
+
+bool PanelTable::garbage_idle() const
+{
+    settle();
+    for (const auto& span : garbage)
+    {
+        if (span.state != GarbageSpan::IDLE || garbage_support(span) != GARBAGE_HELD)
+            return false;
+    }
+    return true;
+}
+
+PanelTable::GarbageSupport PanelTable::garbage_support(const GarbageSpan& span) const
+{
+    const int below = span.bottom() + 1;
+    if (below >= rows)
+        return GARBAGE_HELD;
+
+    GarbageSupport support = GARBAGE_FREE;
+    for (int j = span.x; j < span.x + span.width; j++)
+    {
+        bool falling;
+        if (below < 0 || view(below * columns + j).is_garbage())
         {
-            if (!empty(i, j))
-                return false;
+            // Above the board only other garbage can be below.
+            const GarbageSpan* other = garbage_at(below, j);
+            if (!other)
+                continue;
+            falling = other->state == GarbageSpan::FALLING;
         }
+        else
+        {
+            // Same as what a panel can fall onto.
+            const Panel down = view(below * columns + j);
+            if (down.empty() && (down.is_idle() || down.is_swapped() || down.is_match_end()))
+                continue;
+            falling = down.is_falling_process() || down.empty();
+        }
+
+        if (!falling)
+            return GARBAGE_HELD;
+        support = GARBAGE_ON_FALLING;
     }
-    return true;
+    return support;
 }
 
-std::vector<bool> PanelTable::danger_columns() const
+void PanelTable::update_garbage(bool& need_update_matches, bool& stop_rising)
 {
-    std::vector<bool> danger(columns, false);
-    for (int j = 0; j < columns; j++)
-        danger[j] = !top(j)->empty();
-    return danger;
+    // Spans are ordered from the bottom so a stack of falling spans moves together.
+    for (auto& span : garbage)
+    {
+        if (span.state == GarbageSpan::IDLE)
+        {
+            if (garbage_support(span) != GARBAGE_HELD)
+            {
+                span.state = GarbageSpan::FALLING;
+                span.countdown = settings.pending_fall;
+                stop_rising = true;
+            }
+            continue;
+        }
+
+        stop_rising = true;
+        if (--span.countdown > 0)
+            continue;
+
+        if (span.state == GarbageSpan::FALLING)
+        {
+            const GarbageSupport support = garbage_support(span);
+            if (support == GARBAGE_HELD)
+            {
+                span.state = GarbageSpan::IDLE;
+            }
+            else if (support == GARBAGE_ON_FALLING)
+            {
+                span.countdown = 1;
+            }
+            else
+            {
+                // Only the row below and the top row change when a span moves down.
+                const int below = span.bottom() + 1;
+                for (int j = span.x; below >= 0 && j < span.x + span.width; j++)
+                {
+                    Panel panel(&data, below * columns + j);
+                    panel.set_chain(false);
+                    panel.set_locked(false);
+                    panel.set_type(Panel::Type::SPECIAL);
+                    panel.set_state(Panel::State::GARBAGE);
+                    panel.set_countdown(0);
+                }
+                for (int j = span.x; span.y >= 0 && j < span.x + span.width; j++)
+                {
+                    Panel panel(&data, span.y * columns + j);
+                    panel.set_type(Panel::Type::EMPTY);
+                    panel.set_state(Panel::State::IDLE);
+                }
+                span.y++;
+                span.countdown = settings.falling;
+            }
+        }
+        else
+        {
+            // The bottom row turns into panels that continue the chain, the rest of the span stays on top of them.
+            const int i = span.bottom();
+            for (int j = span.x; j < span.x + span.width; j++)
+            {
+                Panel panel(&data, i * columns + j);
+                panel.set_type(source->redraw(0));
+                panel.set_state(Panel::State::END_FALL);
+                panel.set_chain(true);
+            }
+            span.height--;
+            span.state = GarbageSpan::IDLE;
+            need_update_matches = true;
+        }
+    }
+
+    garbage.erase(std::remove_if(garbage.begin(), garbage.end(), [](const GarbageSpan& span) {return span.height == 0;}), garbage.end());
+    std::sort(garbage.begin(), garbage.end(), garbage_order);
 }
 
-void PanelTable::swap(int i, int j)
+void PanelTable::shatter_garbage()
 {
-    Panel& left = panels[i * columns + j];
+    // Bit k is set if garbage[k] was touched by this match.
+    uint32_t shattered = 0;
+    for (int k = 0; k < (int) garbage.size(); k++)
+    {
+        const GarbageSpan& span = garbage[k];
+        if (span.state != GarbageSpan::IDLE || span.bottom() < 0)
+            continue;
 
-    if (!left.can_swap() || (type == MOVES && moves <= 0))
-        return;
+        const uint64_t columns = span.columns();
+        const uint64_t sides = columns << 1 | columns >> 1;
+        for (int i = std::max(span.y - 1, 0); i <= std::min(span.bottom() + 1, rows - 1); i++)
+        {
+            if (matcher.removed(i) & (i < span.y || i > span.bottom() ? columns : sides))
+            {
+                shattered |= 1u << k;
+                break;
+            }
+        }
+    }
 
-    left.swap();
+    // Garbage touching shattered garbage shatters with it.
+    for (uint32_t spread = shattered; spread != 0; )
+    {
+        uint32_t next = 0;
+        for (int k = 0; k < (int) garbage.size(); k++)
+        {
+            const GarbageSpan& span = garbage[k];
+            if ((shattered >> k & 1) || span.state != GarbageSpan::IDLE || span.bottom() < 0)
+                continue;
+            for (uint32_t others = spread; others != 0; others &= others - 1)
+            {
+                if (garbage_touching(span, garbage[__builtin_ctz(others)]))
+                {
+                    next |= 1u << k;
+                    break;
+                }
+            }
+        }
+        shattered |= next;
+        spread = next;
+    }
 
-    moves -= 1;
+    for (int k = 0; k < (int) garbage.size(); k++)
+    {
+        if (shattered >> k & 1)
+        {
+            GarbageSpan& span = garbage[k];
+            span.state = GarbageSpan::SHATTERING;
+            span.countdown = settings.pending_match + settings.first_removed + span.width * settings.subsequent_removed;
+        }
+    }
+}
+
+void PanelTable::rise_garbage()
+{
+    // Types moved up a row but states did not, so the states of the cells each span left and entered are fixed.
+    for (const auto& span : garbage)
+    {
+        for (int j = span.x; span.bottom() >= 0 && j < span.x + span.width; j++)
+            data.set_state(span.bottom() * columns + j, Panel::State::IDLE);
+    }
+    for (auto& span : garbage)
+    {
+        span.y--;
+        for (int j = span.x; span.y >= 0 && j < span.x + span.width; j++)
+            data.set_state(span.y * columns + j, Panel::State::GARBAGE);
+    }
 }
 
 void PanelTable::freeze(int cooloff)
@@ -180,6 +745,28 @@ void PanelTable::quick_rise()
 
 MatchInfo PanelTable::update()
 {
+    match_groups.clear();
+    begin_changes();
+    MatchInfo info = (this->*engine)();
+    changes.done = true;
+    return info;
+}
+
+void PanelTable::set_record_changes(bool record)
+{
+    // Segments only mark their cells once written, so a frame recorded has none.
+    settle();
+    changes.marked.assign(data.size, 0);
+    changes.cells.clear();
+    changes.cells.reserve(data.size);
+    changes.clear();
+    data.changes = record ? &changes : nullptr;
+}
+
+template <class Board> MatchInfo PanelTable::update_board()
+{
+    const Board board(rows, columns, &settings);
+    const int board_size = board.rows() * board.columns();
     bool need_update_matches = false;
     bool need_skip_update = false;
     bool in_clink = false;
@@ -187,8 +774,12 @@ MatchInfo PanelTable::update()
 
     if (is_rised())
     {
-        for (int j = 0; j < columns; j++)
-            top(j)->rise();
+        // Every panel type including the next set of panels moves up a row.
+        settle();
+        data.rise(board);
+        data.activate_all();
+        if (!garbage.empty())
+            rise_garbage();
 
         need_update_matches = true;
         // We already performed the update!
@@ -201,15 +792,63 @@ MatchInfo PanelTable::update()
 
     // Do not rise the panels if any panel is in match state, in swap state, or is FALLING only.
     bool stop_rising = false;
+    // A panel is only written to by itself and the panel above it, so the flags are the same as before the update.
+    in_chain = data.chains > 0;
+
+    // Falling stacks are moved as segments unless every changed cell is recorded or garbage could land on them.
+    const bool make_falls = segments && !data.changes && garbage.empty() && board.settings().falling >= 1;
+    size_t fall = 0;
+    next_falls.clear();
 
-    // Iterate in reverse so that falls work correctly.
-    for (unsigned int i = 0; i < panels.size(); i++)
+    // Iterate each column from the bottom so that falls work correctly, a panel only reads and writes the panel below it.
+    // Idle panels that can't fall are skipped, a change to a panel marks itself and the panel above as active.
+    for (int j = board.columns() - 1; j >= 0 && (data.active_count > 0 || fall < falls.size()); j--)
     {
-        auto& panel = panels[panels.size() - 1 - i];
-        in_chain |= panel.chain;
-        in_clink |= panel.is_match_process();
-        stop_rising |= panel.is_falling() || panel.is_fall_end() || panel.is_swapping() || panel.is_match_process();
-        need_update_matches |= panel.update();
+        int start = board_size - board.columns() + j;
+        if (fall < falls.size() && falls[fall].bottom % board.columns() == j)
+            start = update_falls(board, j, fall, stop_rising);
+        else if (data.active_count == 0)
+            continue;
+
+        for (int i = start; i >= 0; i -= board.columns())
+        {
+            if (!data.active[i])
+                continue;
+
+            Panel panel(&data, i);
+            in_clink |= panel.is_match_process();
+            stop_rising |= panel.is_falling() || panel.is_fall_end() || panel.is_swapping() || panel.is_match_process();
+
+            // Panels that only count down this frame are dispatched here without a full update.
+            if (Panel::transitions[data.state[i]].batch && data.countdown[i] > 1)
+            {
+                if (make_falls && panel.is_falling() && !panel.empty())
+                    i = start_fall(i);
+                else
+                    data.set_countdown(i, data.countdown[i] - 1);
+                continue;
+            }
+
+            if (panel.is_falling() && !panel.empty())
+            {
+                i = update_falling(board, i, make_falls, need_update_matches);
+                continue;
+            }
+
+            need_update_matches |= panel.update(board.settings());
+
+            if (panel.get_state() == Panel::State::IDLE || panel.get_state() == Panel::State::GARBAGE)
+                data.deactivate(i);
+        }
+    }
+
+    falls.swap(next_falls);
+
+    // Garbage reads and writes the cells below it.
+    if (!garbage.empty())
+    {
+        settle();
+        update_garbage(need_update_matches, stop_rising);
     }
 
     if (!in_clink)
@@ -219,7 +858,9 @@ MatchInfo PanelTable::update()
 
     MatchInfo info;
     if (need_update_matches)
-        info = update_matches();
+        info = update_matches(board);
+    if (info.combo != 0 && !garbage.empty())
+        shatter_garbage();
 
     if (info.fall_match)
     {
@@ -232,10 +873,6 @@ MatchInfo PanelTable::update()
         info.clink = clink <= 1 ? 0 : clink - 1;
     }
 
-    // Needed to catch newly matched panels.
-    for (const auto& panel : panels)
-        in_clink |= panel.is_pending_match();
-
     // Board is stopped while matches are being removed.
     if (need_skip_update || stop_rising)
         return info;
@@ -251,31 +888,13 @@ MatchInfo PanelTable::update()
 
     if (is_puzzle())
     {
-        bool win = true;
-        for (const auto& panel : panels)
-            win = win && panel.empty();
+        bool win = first_filled_row() == rows;
         if ((moves == 0 || win) && all_idle())
             state = win ? WIN : GAMEOVER;
     }
     else if (is_rising())
     {
-
-        if (rise_counter == 0xfff)
-        {
-            rise_counter -= 0x1000;
-            rise_counter += speed;
-        }
-        else if (rise_counter > 0xfff)
-        {
-            rise++;
-            rise_counter -= 0x1000;
-        }
-        else
-        {
-            rise_counter += speed;
-        }
-
-        if (rise >= 16)
+        if (rise_step(speed, rise, rise_counter))
         {
             if (danger())
                 // This state could immediately transition to Game over if !allow_clogged_state
@@ -347,183 +966,448 @@ MatchInfo PanelTable::update()
     return info;
 }
 
-MatchInfo PanelTable::update_matches()
+template <class Board> int PanelTable::update_falling(const Board& board, int index, bool make_falls, bool& need_update_matches)
 {
-    MatchInfo match_info;
-    std::set<Point> remove;
+    const int columns = board.columns();
+    Panel bottom(&data, index);
+    need_update_matches |= bottom.update(board.settings());
 
-    for (int i = 0; i < rows; i++)
+    // Panels above that also finish falling this frame do whatever the bottom panel did.
+    int top = index;
+    while (top >= columns)
     {
-        for (int j = 0; j < columns; j++)
+        const Panel panel = view(top - columns);
+        if (!panel.is_falling() || panel.countdown() > 1 || panel.empty())
+            break;
+        top -= columns;
+    }
+
+    if (bottom.empty())
+    {
+        // The bottom panel moved down so the whole stack moves down a row, only the ends of the stack change state.
+        if (top != index)
         {
-            std::set<Point> vert;
-            std::set<Point> horiz;
-            if (horizontal(i, j))
-                horiz = check_horizontal_combo(i, j);
-            if (vertical(i, j))
-                vert = check_vertical_combo(i, j);
-            remove.insert(horiz.begin(), horiz.end());
-            remove.insert(vert.begin(), vert.end());
+            data.move_down(top, index - columns);
+            data.set_state(index, Panel::State::FALLING);
+            data.set_state(top, Panel::State::IDLE);
+            for (int i = index; i > top; i -= columns)
+                data.set_countdown(i, board.settings().falling);
+            data.set_countdown(top, data.countdown[top] - 1);
         }
+        data.deactivate(top);
+        if (make_falls)
+            add_fall(top + columns, index + columns);
+    }
+    else
+    {
+        // The bottom panel landed or slipped onto a falling panel, the stack slips onto it.
+        for (int i = index - columns; i >= top; i -= columns)
+        {
+            Panel panel(&data, i);
+            panel.set_state(bottom.state());
+            panel.set_countdown(bottom.countdown());
+        }
+        need_update_matches |= bottom.is_fall_end();
     }
 
-    match_info.combo = remove.size();
-    match_info.swap_match = !remove.empty();
-    match_info.fall_match = false;
+    return top;
+}
 
-    bool chain = false;
-    std::set<Panel::Type> types_matched;
-    for (const auto& pt: remove)
+template <class Board> int PanelTable::update_falls(const Board& board, int j, size_t& fall, bool& stop_rising)
+{
+    const int columns = board.columns();
+    const int board_size = board.rows() * columns;
+
+    // Anything else updated in the column could read or write the cells of its segments, so they are written out first.
+    if (data.active_count > 0)
     {
-        auto& panel = get(pt.y, pt.x);
-        types_matched.insert(panel.get_value());
-        chain |= panel.chain;
+        for (int i = j; i < board_size; i += columns)
+        {
+            if (data.active[i])
+            {
+                settle_column(j, fall);
+                return board_size - columns + j;
+            }
+        }
     }
 
-    int index = remove.size() - 1;
-    for (const auto& pt : remove)
+    for (; fall < falls.size() && falls[fall].bottom % columns == j; fall++)
     {
-        auto& panel = get(pt.y, pt.x);
-        match_info.fall_match |= (panel.is_fall_end() && panel.chain);
-        match_info.swap_match &= !(panel.is_fall_end() && panel.chain);
-        panel.match(index, remove.size() - 1, types_matched.size(), chain);
-        index--;
-        match_info.x = pt.x;
-        match_info.y = pt.y;
-    }
+        FallingSegment segment = falls[fall];
+        stop_rising = true;
+        if (segment.countdown > 1)
+        {
+            segment.countdown--;
+            next_falls.push_back(segment);
+            continue;
+        }
 
-    return match_info;
+        // The stack moves down if the cell below is empty, which it also is if the segment below has just left it.
+        const int below = segment.lowest(columns) + columns;
+        const FallingSegment* under = !next_falls.empty() && next_falls.back().bottom % columns == j ? &next_falls.back() : nullptr;
+        const bool left = under && below >= under->top && below < under->highest(columns);
+        bool free = left;
+        if (!left && below < board_size && !(under && below >= under->top && below <= under->lowest(columns)))
+        {
+            const Panel down = view(below);
+            free = down.empty() && down.is_idle();
+        }
+        // A panel above the stack could follow it down once the first row is left, so that is only skipped for an empty cell.
+        if (free && segment.offset == 0 && segment.top >= columns && data.type[data.slot(segment.top - columns)] != Panel::Type::EMPTY)
+            free = false;
+
+        if (!free)
+        {
+            // It lands or slips onto what is below, update_falling does that with the panels written out.
+            const int bottom = segment.lowest(columns);
+            settle_column(j, fall);
+            return bottom;
+        }
+
+        // The cell moved into loses its chain flag as it does when a panel falls into it.
+        if (!left)
+            data.chains -= data.flags[below] & PanelData::CHAIN;
+        segment.offset++;
+        segment.countdown = board.settings().falling;
+        next_falls.push_back(segment);
+    }
+    return -1;
 }
 
-bool PanelTable::next_vertical_error(int j)
+int PanelTable::start_fall(int index)
 {
-    if (!matchable(rows - 2, j) || !matchable(rows - 1, j))
-        return false;
-
-    Panel::Type k, l, m;
-    k = next[j].type;
-    m = value(rows - 1, j);
-    l = value(rows - 2, j);
+    // Every panel of a stack that fell into place together counts down by itself until it moves, a segment counts down once.
+    const int countdown = data.countdown[index];
+    int top = index;
+    while (top >= columns)
+    {
+        const Panel panel = view(top - columns);
+        if (!panel.is_falling() || panel.empty() || panel.get_countdown() != countdown || !data.active[top - columns])
+            break;
+        top -= columns;
+    }
 
-    return k == l && k == m;
+    for (int i = top; i <= index; i += columns)
+    {
+        data.set_countdown(i, countdown - 1);
+        data.deactivate(i);
+    }
+    next_falls.push_back(FallingSegment {top, index, 0, countdown - 1});
+    return top;
 }
 
-bool PanelTable::next_horizontal_error(int j)
+void PanelTable::add_fall(int top, int bottom)
 {
-    if (j > columns - 3)
-        return false;
+    for (int i = top; i <= bottom; i += columns)
+        data.deactivate(i);
+    // The cell above the one the stack left was marked for an update that does nothing while it is empty and idle.
+    const int above = top - 2 * columns;
+    if (above >= 0 && data.type[data.slot(above)] == Panel::Type::EMPTY && data.state[above] == Panel::State::IDLE)
+        data.deactivate(above);
+    next_falls.push_back(FallingSegment {top, bottom, 0, data.countdown[bottom]});
+}
 
-    Panel::Type k, l, m;
-    m = next[j].type;
-    k = next[j + 1].type;
-    l = next[j + 2].type;
+void PanelTable::settle_column(int j, size_t& fall)
+{
+    // From the bottom, as a segment may have moved into the cells the one below it left.
+    size_t moved = next_falls.size();
+    while (moved > 0 && next_falls[moved - 1].bottom % columns == j)
+        moved--;
+    for (size_t k = moved; k < next_falls.size(); k++)
+        write_fall(next_falls[k]);
+    next_falls.resize(moved);
+    for (; fall < falls.size() && falls[fall].bottom % columns == j; fall++)
+        write_fall(falls[fall]);
+}
 
-    return m == k && m == l;
+void PanelTable::settle_falls()
+{
+    // In the order they were moved, so each is written after the segment below it.
+    for (const auto& fall : falls)
+        write_fall(fall);
+    falls.clear();
 }
 
-bool PanelTable::vertical(int i, int j)
+void PanelTable::write_fall(const FallingSegment& fall)
 {
-    if (i > rows - 3)
-        return false;
+    if (fall.offset == 0)
+    {
+        for (int i = fall.top; i <= fall.bottom; i += columns)
+        {
+            data.set_countdown(i, fall.countdown);
+            data.activate(i);
+        }
+        return;
+    }
 
-    if (!matchable(i, j) || !matchable(i + 1, j) || !matchable(i + 2, j))
-        return false;
+    // Types and chain flags move with the panels, from the bottom so none is overwritten before it is moved. As in update_falling
+    // only the bottom panel keeps the lock of the cell it fell into, and every cell left behind was emptied with its countdown run out.
+    // The chain count already follows the cells the segment fell into.
+    const int shift = fall.offset * columns;
+    const uint8_t locked = data.flags[fall.bottom + shift] & PanelData::LOCKED;
+    for (int i = fall.bottom; i >= fall.top; i -= columns)
+    {
+        data.set_type(i + shift, data.type[data.slot(i)]);
+        data.set_state(i + shift, Panel::State::FALLING);
+        data.set_flags(i + shift, (data.flags[i] & PanelData::CHAIN) | (i == fall.bottom ? locked : 0));
+        data.set_countdown(i + shift, fall.countdown);
+    }
+    for (int i = fall.top; i < fall.top + shift; i += columns)
+    {
+        data.set_type(i, Panel::Type::EMPTY);
+        data.set_state(i, Panel::State::IDLE);
+        data.set_flags(i, 0);
+        data.set_countdown(i, 0);
+    }
+}
 
-    Panel::Type k, l, m;
-    k = value(i, j);
-    l = value(i + 1, j);
-    m = value(i + 2, j);
+bool PanelTable::rise_step(int speed, int& rise, int& rise_counter)
+{
+    if (rise_counter == 0xfff)
+    {
+        rise_counter -= 0x1000;
+        rise_counter += speed;
+    }
+    else if (rise_counter > 0xfff)
+    {
+        rise++;
+        rise_counter -= 0x1000;
+    }
+    else
+    {
+        rise_counter += speed;
+    }
 
-    return k == l && k == m;
+    return rise >= 16;
 }
 
-bool PanelTable::horizontal(int i, int j)
+int PanelTable::rise_steps(int max_frames, int& rise, int& rise_counter) const
 {
-    if (j > columns - 3)
-        return false;
-
-    if (!matchable(i, j) || !matchable(i, j + 1) || !matchable(i, j + 2))
-        return false;
+    int frames = 0;
+    while (frames < max_frames)
+    {
+        if (rise_counter < 0xfff && rise < 16)
+        {
+            // Frames that only add the speed to the counter are taken at once.
+            const int left = max_frames - frames;
+            const int steps = speed > 0 ? std::min((0xfff - rise_counter + speed - 1) / speed, left) : left;
+            rise_counter += steps * speed;
+            frames += steps;
+            continue;
+        }
 
-    Panel::Type k, l, m;
-    k = value(i, j);
-    l = value(i, j + 1);
-    m = value(i, j + 2);
+        int step_rise = rise;
+        int step_rise_counter = rise_counter;
+        if (rise_step(speed, step_rise, step_rise_counter))
+            break;
+        rise = step_rise;
+        rise_counter = step_rise_counter;
+        frames++;
+    }
+    return frames;
+}
 
-    return k == l && k == m;
+int PanelTable::quiet_frames(int max_frames) const
+{
+    bool stop_rising, in_clink;
+    int next_rise, next_rise_counter;
+    return quiet_frames(max_frames, stop_rising, in_clink, next_rise, next_rise_counter);
 }
 
-std::set<Point> PanelTable::check_horizontal_combo(int i, int j)
+int PanelTable::quiet_frames(int max_frames, bool& stop_rising, bool& in_clink, int& next_rise, int& next_rise_counter) const
 {
-    std::set<Point> remove;
-    int moveon = 3;
+    if (is_rised() || max_frames <= 0)
+        return 0;
+    settle();
+
+    // Garbage that moves or shatters changes the board every few frames.
+    if (!garbage_idle())
+        return 0;
+
+    // Panel states stay the same until a countdown expires so these flags hold for every skipped frame.
+    int frames = max_frames;
+    stop_rising = false;
+    in_clink = false;
+    for (int i = 0; i < rows * columns && frames > 0 && data.active_count > 0; i++)
+    {
+        if (!data.active[i])
+            continue;
 
-    remove.emplace(j, i);
-    remove.emplace(j + 1, i);
-    remove.emplace(j + 2, i);
+        const Panel panel = view(i);
+        in_clink |= panel.is_match_process();
+        stop_rising |= panel.is_falling() || panel.is_fall_end() || panel.is_swapping() || panel.is_match_process();
+        frames = std::min(frames, panel.quiet_frames());
+    }
 
-    for (int k = 3; k < columns - j - 1; k++)
+    next_rise = rise;
+    next_rise_counter = rise_counter;
+    if (!stop_rising && frames > 0)
     {
-        if (!(j + k < columns && value(i, j) == value(i, j + k) && matchable(i, j + k)))
-            break;
+        if (stopped)
+        {
+            // The frame the timeout runs out the board starts rising again.
+            frames = std::min(frames, std::max(timeout, 0));
+        }
+        else if (is_puzzle())
+        {
+            bool win = first_filled_row() == rows;
+            if ((moves == 0 || win) && all_idle())
+                frames = 0;
+        }
+        else if (is_rising())
+        {
+            frames = rise_steps(frames, next_rise, next_rise_counter);
+        }
+        else if (!is_gameover() && !is_win())
+        {
+            frames = 0;
+        }
+    }
+
+    return frames;
+}
+
+int PanelTable::advance_until_event(int max_frames)
+{
+    bool stop_rising, in_clink;
+    int next_rise, next_rise_counter;
+    const int frames = quiet_frames(max_frames, stop_rising, in_clink, next_rise, next_rise_counter);
+    if (frames == 0)
+        return 0;
+
+    // The last skipped frame matched nothing and changed no panel type or state.
+    match_groups.clear();
+    begin_changes();
+    changes.done = true;
+
+    for (int i = 0; i < rows * columns && data.active_count > 0; i++)
+    {
+        if (!data.active[i])
+            continue;
 
-        moveon = k + 1;
-        remove.emplace(j + k, i);
+        Panel panel(&data, i);
+        if (panel.get_state() == Panel::State::IDLE || panel.get_state() == Panel::State::GARBAGE)
+            data.deactivate(i);
+        else
+            panel.set_countdown(panel.countdown() - frames);
     }
 
-    for (int m = 0; m < moveon; m++)
+    if (!in_clink)
+        clink = 0;
+    if (!(in_clink || data.chains > 0))
+        chain = 0;
+
+    if (!stop_rising)
     {
-        for (int k = -2; k <= 1; k++)
+        if (stopped)
         {
-            if (k == 0)
-                continue;
-
-            int l = k == -1 ? 1 : k + 1;
-            Panel::Type panel = value(i, j);
-            if (i + k >= 0 && i + l < rows && panel == value(i + k, j + m) && panel == value(i + l, j + m) && matchable(i + k, j + m) && matchable(i + l, j + m))
-            {
-                remove.emplace(j + m, i + k);
-                remove.emplace(j + m, i + l);
-            }
+            timeout -= frames;
+        }
+        else if (is_rising())
+        {
+            rise = next_rise;
+            rise_counter = next_rise_counter;
         }
     }
 
-    return remove;
+    return frames;
 }
 
-std::set<Point> PanelTable::check_vertical_combo(int i, int j)
+template <class Board> MatchInfo PanelTable::update_matches(const Board& board)
 {
-    std::set<Point> remove;
-    int moveon = 3;
+    const int rows = board.rows();
+    const int columns = board.columns();
+    MatchInfo match_info;
 
-    remove.emplace(j, i);
-    remove.emplace(j, i + 1);
-    remove.emplace(j, i + 2);
+    matcher.clear();
+    board.each_row([&](int i)
+    {
+        // The types of a row are next to each other in the ring buffer, each panel is checked as Panel::can_match does.
+        const uint8_t* types = &data.type[data.slot(i * columns)];
+        const uint8_t* states = &data.state[i * columns];
+        board.each_column([&](int j)
+        {
+            const bool normal = types[j] != Panel::Type::EMPTY && types[j] != Panel::Type::SPECIAL;
+            const bool settled = states[j] == Panel::State::IDLE || states[j] == Panel::State::IDLE_FELL ||
+                states[j] == Panel::State::SWAPPED || states[j] == Panel::State::END_FALL;
+            matcher.add(i, j, (Panel::Type) types[j], normal && settled);
+        });
+    });
+
+    int total = matcher.find(board);
+    int types_matched = matcher.types_matched();
+
+    match_info.combo = total;
+    match_info.swap_match = total != 0;
+    match_info.fall_match = false;
 
-    for (int k = 3; k < rows - i - 1; k++)
+    // Groups are found before matching the panels changes their state.
+    Panel::Type type;
+    while (total != 0 && (type = matcher.next_group()) != Panel::Type::EMPTY)
     {
-        if (!(i + k < rows && value(i, j) == value(i + k, j) && matchable(i + k, j)))
-            break;
+        MatchGroup group = {type, false, (int) match_groups.cells.size(), 0};
+        for (int i = 0; i < rows; i++)
+        {
+            PanelMatcher::RowMask cells = matcher.group(i);
+            while (cells != 0)
+            {
+                int j = __builtin_ctzll(cells);
+                cells &= cells - 1;
 
-        moveon = k + 1;
-        remove.emplace(j, i + k);
+                const Panel panel = view(i * columns + j);
+                group.chain |= panel.is_fall_end() && panel.chain();
+                match_groups.cells.emplace_back(j, i);
+                group.count++;
+            }
+        }
+        match_groups.groups.push_back(group);
     }
 
-    for (int m = 0; m < moveon; m++)
+    // Panels are visited from the bottom right to the top left, the last panel visited is removed first.
+    int index = total - 1;
+    for (int i = rows - 1; i >= 0; i--)
     {
-        for (int k = -2; k <= 1; k++)
+        PanelMatcher::RowMask remove = matcher.removed(i);
+        while (remove != 0)
         {
-            if (k == 0)
-                continue;
-            int l = k == -1 ? 1 : k + 1;
-            Panel::Type panel = value(i, j);
-            if (j + k >= 0 && j + l < columns && panel == value(i + m, j + k) && panel == value(i + m, j + l) && matchable(i + m, j + k) && matchable(i + m, j + l))
-            {
-                remove.emplace(j + k, i + m);
-                remove.emplace(j + l, i + m);
-            }
+            int j = 63 - __builtin_clzll(remove);
+            remove &= ~(PanelMatcher::RowMask(1) << j);
+
+            Panel panel(&data, i * columns + j);
+            match_info.fall_match |= (panel.is_fall_end() && panel.chain());
+            match_info.swap_match &= !(panel.is_fall_end() && panel.chain());
+            panel.match(index, total - 1, types_matched, board.settings());
+            index--;
+            match_info.x = j;
+            match_info.y = i;
         }
     }
 
-    return remove;
+    return match_info;
+}
+
+uint32_t PanelTable::board_conflicts(int i, int j) const
+{
+    uint32_t excluded = 0;
+    if (i + 2 < rows && matchable(i + 1, j) && matchable(i + 2, j) && value(i + 1, j) == value(i + 2, j))
+        excluded |= 1u << value(i + 1, j);
+    if (j >= 2 && matchable(i, j - 1) && matchable(i, j - 2) && value(i, j - 1) == value(i, j - 2))
+        excluded |= 1u << value(i, j - 1);
+    return excluded;
+}
+
+uint32_t PanelTable::next_conflicts(int j) const
+{
+    uint32_t excluded = 0;
+    // A board of one row has a single panel above the next set of panels.
+    if (rows >= 2 && matchable(rows - 2, j) && matchable(rows - 1, j) && value(rows - 2, j) == value(rows - 1, j))
+        excluded |= 1u << value(rows - 1, j);
+    if (j >= 2)
+    {
+        const Panel::Type left = next[j - 1].get_value();
+        if (left != Panel::Type::EMPTY && left == next[j - 2].get_value())
+            excluded |= 1u << left;
+    }
+    return excluded;
 }
+
@@ -2,11 +2,11 @@
 #define PANEL_TABLE_HPP
 
 #include "panel.hpp"
+#include "panel_matcher.hpp"
 #include "panel_source.hpp"
 
 #include <list>
 #include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
@@ -45,6 +45,132 @@ struct MatchInfo
     bool fall_match;
 };
 
+/** Connected panels of one type removed by the same match */
+struct MatchGroup
+{
+    Panel::Type type;
+    /// A panel in the group landed from a chain, otherwise the group was made by a swap.
+    bool chain;
+    /// Index of the first cell of the group in MatchGroups::cells, cells of a group are ordered from the top left.
+    int first;
+    /// Number of cells in the group
+    int count;
+};
+
+/** Groups matched by the last update. Storage is reserved for the whole board when the table is created so update never allocates. */
+struct MatchGroups
+{
+    void clear() {groups.clear(); cells.clear();}
+    bool empty() const {return groups.empty();}
+    std::vector<MatchGroup> groups;
+    std::vector<Point> cells;
+};
+
+/** What each swap of the board would do if it was made now, filled by PanelTable::evaluate_swaps. Reused between calls so evaluating does not allocate. */
+struct SwapEvaluation
+{
+    struct Swap
+    {
+        /// The swap can be made.
+        bool legal;
+        /// Number of panels matched when the swap ends, 0 if it makes no match.
+        int cleared;
+        /// A matched panel lands from a chain on the frame the swap ends so the match continues the chain.
+        bool chain;
+    };
+    /// Result of swapping the panel at i, j with the one to its right.
+    const Swap& get(int i, int j) const {return swaps[i * (columns - 1) + j];}
+
+    int rows = 0;
+    int columns = 0;
+    std::vector<Swap> swaps;
+    /// Type of each panel or EMPTY if it can't be matched when a swap made now ends, the high bit is set if it lands from a chain then.
+    std::vector<uint8_t> board;
+};
+
+/**
+ * Garbage block covering a rectangle of cells. The span holds the state of the whole block,
+ * its cells on the board are SPECIAL panels in the GARBAGE state so other panels rest on them.
+ */
+struct GarbageSpan
+{
+    enum State
+    {
+        /// Resting on something.
+        IDLE = 0,
+        /// Moves down a row when countdown runs out.
+        FALLING = 1,
+        /// Touched a match, the bottom row turns into panels when countdown runs out.
+        SHATTERING = 2,
+    };
+    int bottom() const {return y + height - 1;}
+    /// Bit j is set for each column the span covers.
+    uint64_t columns() const {return (~0ULL >> (64 - width)) << x;}
+
+    /// Top row, negative while the top of the span is above the board.
+    int16_t y;
+    /// Leftmost column
+    int8_t x;
+    uint8_t width;
+    uint8_t height;
+    uint8_t state;
+    int16_t countdown;
+};
+
+/**
+ * Stack of panels falling together in a column that PanelTable moves without writing its cells. The panels stay in the cells
+ * they had when the segment was made and are written where they are when it lands or anything else reads the board,
+ * so a frame of the fall costs the same however tall the stack is and however far it has fallen.
+ */
+struct FallingSegment
+{
+    /// Cell of the bottom panel now.
+    int lowest(int columns) const {return bottom + offset * columns;}
+    /// Cell of the top panel now.
+    int highest(int columns) const {return top + offset * columns;}
+
+    /// Cells of the top and bottom panel when the segment was made, in the same column.
+    int top;
+    int bottom;
+    /// Rows moved down since then
+    int offset;
+    /// Countdown of every panel of the segment
+    int countdown;
+};
+
+/// Largest board a table holds, the matcher keeps a row in 64 bits.
+#define MAX_TABLE_COLUMNS 64
+/// Cells including the next set of panels are recorded and keyed as 16 bit indexes, which holds every board this tall.
+#define MAX_TABLE_ROWS 256
+
+/// A table holds at most this many garbage spans so it can always be saved.
+#define SNAPSHOT_MAX_GARBAGE 24
+
+/**
+ * Trivially copyable copy of the complete simulation state of a PanelTable.
+ * The state of the panel source is saved with it, the source itself and the speed settings are not part of the snapshot.
+ */
+struct PanelTableSnapshot
+{
+    uint8_t rows;
+    uint8_t columns;
+    uint8_t state;
+    uint8_t stopped;
+    int32_t moves;
+    int32_t rise_counter;
+    int32_t rise;
+    int32_t speed;
+    int32_t timeout;
+    int32_t clink;
+    int32_t chain;
+    int32_t lines;
+    PanelSnapshot panels[SNAPSHOT_MAX_ROWS * SNAPSHOT_MAX_COLUMNS];
+    PanelSnapshot next[SNAPSHOT_MAX_COLUMNS];
+    uint8_t garbage_count;
+    GarbageSpan garbage[SNAPSHOT_MAX_GARBAGE];
+    PanelSourceSnapshot source;
+};
+
 class PanelTable
 {
 public:
@@ -91,8 +217,20 @@ public:
         int rows;
         int moves;
     };
-    /// Create a new Panel Table
+    /** Can a table be made from opts, the board must have 1 to MAX_TABLE_COLUMNS columns and 1 to MAX_TABLE_ROWS rows
+      * and the match times of removing every panel at once must fit in a panel. */
+    static bool valid(const Options& opts);
+    /// Create a new Panel Table, opts must be valid(). With asserts off a board too big is cut down to the limits.
     explicit PanelTable(const Options& opts);
+    /** Starts a new game in this table as if it was constructed with opts, reusing its storage.
+      * A null opts.source keeps the current source, which must be for a board of the same size.
+      * Returns false leaving the table as it was if opts is not valid() or it is for another size, opts.source then stays the caller's.
+      * Recording changes stays on or off. */
+    bool reset(const Options& opts);
+    /// Same as reset but the source, given or kept, starts over from seed first. A source without a seed goes on from where it was.
+    bool reset(const Options& opts, uint32_t seed);
+    /// Can reset start a game with opts, a kept source must be for the board of opts.
+    bool can_reset(const Options& opts) const {return opts.source || (source->height() == opts.rows && source->width() == opts.columns);}
 
     bool is_puzzle() const {return state == PUZZLE;}
     bool is_rising() const {return state == RISING;}
@@ -105,37 +243,68 @@ public:
     bool is_win() const {return state == WIN;}
     State get_state() const {return state;}
 
-    const std::vector<Panel>& get_panels() const {return panels;}
-    std::vector<Panel>& get_panels() {return panels;}
-    const std::vector<Panel>& get_next() const {return next;}
-    std::vector<Panel>& get_next() {return next;}
-    Panel& get(int i, int j) {return panels[i * columns + j];}
-    const Panel& get(int i, int j) const {return panels[i * columns + j];}
-    Panel::Type value(int i, int j) const {return get(i, j).get_value();}
-    bool empty(int i, int j) const {return get(i, j).empty();}
-    bool special(int i, int j) const {return get(i, j).special();}
-    bool matchable(int i, int j) const {return get(i, j).can_match();}
-    bool normal(int i, int j) const {return get(i, j).normal();}
+    const std::vector<Panel>& get_panels() const {settle(); return panels;}
+    const std::vector<Panel>& get_next() const {settle(); return next;}
+    /// Source of the panels, its preview holds the lines coming after the next set of panels.
+    const PanelSource& get_source() const {return *source;}
+    /** Lets the source generate the coming lines ahead, for frames with time to spare.
+      * A panel replaced for making 3 in a row with the board or shattered from garbage comes from
+      * PanelSource::redraw, so a game from a seeded source is the same whichever frames lines are filled on. */
+    void fill_lines() {source->fill();}
+    /// Groups of panels matched by the last update, empty if nothing matched.
+    const MatchGroups& get_match_groups() const {return match_groups;}
+    Panel& get(int i, int j) {settle(); return panels[i * columns + j];}
+    const Panel& get(int i, int j) const {settle(); return panels[i * columns + j];}
+    Panel::Type value(int i, int j) const {settle(); return (Panel::Type) data.type[data.slot(i * columns + j)];}
+    bool empty(int i, int j) const {return value(i, j) == Panel::Type::EMPTY;}
+    bool special(int i, int j) const {return value(i, j) == Panel::Type::SPECIAL;}
+    bool matchable(int i, int j) const {settle(); return view(i * columns + j).can_match();}
+    bool normal(int i, int j) const {settle(); return view(i * columns + j).normal();}
 
     int width() const {return columns;}
     int height() const {return rows;}
 
     void clear();
     /// Are the panels high
-    bool warning() const;
+    bool warning() const {settle(); return rows > 1 && PanelData::has_row(data.row_panels.data(), 1);}
 
     /// Have the panels reached the top row.
-    bool danger() const;
+    bool danger() const {settle(); return data.row_panels[0] & 1;}
 
     /// Are all panels idle
-    bool all_idle() const;
+    bool all_idle() const {return data.busy == 0 && (garbage.empty() || garbage_idle());}
 
     /// Returns a boolean for each column if they are very close to the top.
     std::vector<bool> danger_columns() const;
 
-    /// Swaps the panel at i, j with i + 1, j
+    /// Is this column very close to the top.  Same as danger_columns()[column] without allocating.
+    bool danger_column(int column) const {settle(); return data.column_panels[column * data.row_words] & 1;}
+
+    /// Number of rows from the bottom to the highest panel in the column, holes below it are counted.
+    int column_height(int column) const {settle(); return rows - data.first_row(&data.column_panels[column * data.row_words]);}
+    /// First row from the top that has a panel, rows if the board is empty.
+    int first_filled_row() const {settle(); return data.first_row(data.row_panels.data());}
+
+    /// Swaps the panel at i, j with i, j + 1. A swap outside the board does nothing.
     void swap(int i, int j);
 
+    /** Evaluates every swap on the board as it is now without changing the table.
+      * Each swap is checked for legality and for the match made when it ends, assuming nothing else on the board changes before then
+      * except that panels falling onto the panel below them land. The chain flag is the one the matched panels carry on that frame. */
+    void evaluate_swaps(SwapEvaluation& evaluation) const;
+
+    /** Fills swaps with the legal swaps that change the board, as Point(j, i) for swapping i, j with i, j + 1.
+      * Swaps of two panels of the same type or two empty cells are left out, and when the board is its own mirror image
+      * only the swap in the left half of each mirrored pair is kept. */
+    void legal_swaps(std::vector<Point>& swaps) const;
+
+    /** Drops a garbage block width columns wide and height rows high with its left edge in column x.
+      * It starts above the board, on top of any garbage still waiting there, and falls in.
+      * Returns false if it does not fit the board or the table already holds SNAPSHOT_MAX_GARBAGE spans. */
+    bool add_garbage(int x, int width, int height);
+    /// Garbage blocks on or above the board, ordered from the bottom.
+    const std::vector<GarbageSpan>& get_garbage() const {return garbage;}
+
     /// Stops the board from rising
     void freeze(int timeout);
 
@@ -144,14 +313,49 @@ public:
 
     /// Updates the game board.
     MatchInfo update();
+    /** Runs the engine for boards of any size even if the board has one specialised for its size and settings, to compare the two.
+      * Both play the same game. */
+    void set_generic_engine(bool generic);
+    /// Does update run an engine specialised for the size and settings of the board, 12 x 6 with the settings of a difficulty.
+    bool is_specialised() const {return specialised;}
+    /** Moves falling stacks as FallingSegments, on by default. Off every falling panel is updated every frame as before, to compare the two.
+      * Both play the same game. */
+    void set_falling_segments(bool enabled);
+    /// Number of falling stacks update is moving as segments, the board is written out and this is 0 once it is read.
+    int falling_segments() const {return falls.size();}
+    /// Starts or stops recording the cells changed by swap and update, off by default.
+    void set_record_changes(bool record);
+    /** Cells whose type or state changed during the last frame, the swaps made before the last update and the update itself.
+      * Empty unless recording. */
+    const ChangeSet& get_changes() const {return changes;}
+
+    /** Skips up to max_frames frames without input where panels only count down and the board only rises slowly.
+      * The state is the same as calling update that many times, the next update is a frame where something happens.
+      * Returns the number of frames skipped. */
+    int advance_until_event(int max_frames);
+    /// Number of frames advance_until_event(max_frames) would skip, without changing the table.
+    int quiet_frames(int max_frames) const;
 
     /// Returns a boolean if X lines have been risen and cleared.
     bool cleared_lines(int lines);
 
+    /// Copies the simulation state into snapshot. Returns false if the board is too large to be saved or its match times don't fit a PanelSnapshot.
+    bool save_state(PanelTableSnapshot& snapshot) const;
+    /// Restores the simulation state from a snapshot of a table with the same dimensions and a source of the same kind.
+    bool load_state(const PanelTableSnapshot& snapshot);
+    /// 64 bit hash of the simulation state, tables with equal snapshots have equal hashes.
+    uint64_t hash() const;
+    /** Hash that is the same for a table and its left-right mirror image, the smaller of the two hashes.
+      * Mirrored tables play out the same except that panels of a match are removed in order from the top left. */
+    uint64_t canonical_hash() const;
+    /// Is the table its own left-right mirror image
+    bool is_symmetric() const {return hash() == mirrored_hash();}
+
     int get_rise_counter() const {return rise_counter;}
     int get_rise() const {return rise;}
     int get_timeout() const {return timeout;}
     int get_chain() const {return chain;}
+    int get_clink() const {return clink;}
     int get_moves() const {return moves;}
     int get_lines() const {return lines;}
     void set_moves(int m) {moves = m;}
@@ -159,32 +363,106 @@ public:
 
 private:
     void init();
+    /// Read only view of the panel at index, the next set of panels start at rows * columns.
+    const Panel view(int index) const {return Panel(const_cast<PanelData*>(&data), index);}
     void generate();
     void generate_next();
-    MatchInfo update_matches();
-
-    Panel* top(int column) {return &panels[column];}
-    const Panel* top(int column) const {return &panels[column];}
-    Panel* bottom(int column) {return &panels[(rows - 1) * columns + column];}
-    const Panel* bottom(int column) const {return &panels[(rows - 1) * columns + column];}
-
-    bool next_horizontal_error(int j);
-    bool next_vertical_error(int j);
+    /// Picks the update_board the engine runs for the size and settings of the board.
+    void select_engine();
+    /** Moves the board on by a frame, update wraps it with clearing the match groups and recorded changes.
+      * Board has the size and settings of the table, see board_traits.hpp. */
+    template <class Board> MatchInfo update_board();
+    template <class Board> MatchInfo update_matches(const Board& board);
+    /** Updates the falling panel at index together with the falling panels stacked on it, returns the index of the highest panel updated.
+      * If make_falls is set a stack that moved down goes on falling as a segment. */
+    template <class Board> int update_falling(const Board& board, int index, bool make_falls, bool& need_update_matches);
+    /** Moves the segments of column j starting at falls[fall] by a frame, advancing fall past them. Returns the cell the update of
+      * the column goes on from once a segment has to be written out to land, or -1 if the segments were all the column had to do. */
+    template <class Board> int update_falls(const Board& board, int j, size_t& fall, bool& stop_rising);
+    /// Counts down the falling panels from index up that have its countdown as a new segment, returns the index of the highest one.
+    int start_fall(int index);
+    /// Takes the falling panels from top to bottom, just moved down together, as a new segment.
+    void add_fall(int top, int bottom);
+    /// Writes the segments of column j moved this frame and those from falls[fall] on, advancing fall past them.
+    void settle_column(int j, size_t& fall);
+    /// Writes every segment to the board, every read of the board from outside update does this first.
+    void settle() const {if (!falls.empty()) const_cast<PanelTable*>(this)->settle_falls();}
+    void settle_falls();
+    /// Writes the panels of a segment to the cells it covers now, and empties the cells it has left.
+    void write_fall(const FallingSegment& fall);
+    /// Advances the rise counter by one frame while rising at speed, returns true once a full row has risen.
+    static bool rise_step(int speed, int& rise, int& rise_counter);
+    /// Same as calling rise_step up to max_frames times stopping before the frame a full row has risen, returns the frames taken.
+    int rise_steps(int max_frames, int& rise, int& rise_counter) const;
+    /// Counts the quiet frames for advance_until_event, also returning what it needs to apply them.
+    int quiet_frames(int max_frames, bool& stop_rising, bool& in_clink, int& next_rise, int& next_rise_counter) const;
+    /// Moves, lands and shatters the garbage spans, called once per update before matches are found.
+    void update_garbage(bool& need_update_matches, bool& stop_rising);
+    /// Starts shattering the garbage touching the panels just matched and the garbage touching that.
+    void shatter_garbage();
+    /// Moves the garbage spans up a row with the panels.
+    void rise_garbage();
+    enum GarbageSupport
+    {
+        GARBAGE_HELD,
+        GARBAGE_FREE,
+        /// Only falling panels or garbage are below.
+        GARBAGE_ON_FALLING,
+    };
+    /// What is below the bottom row of a span.
+    GarbageSupport garbage_support(const GarbageSpan& span) const;
+    /// Span covering the cell at i, j, nullptr if there is none.
+    const GarbageSpan* garbage_at(int i, int j) const;
+    bool garbage_idle() const;
 
-    bool vertical(int i, int j);
-    bool horizontal(int i, int j);
+    /// Clears the recorded changes if the last frame is over.
+    void begin_changes()
+    {
+        if (changes.done)
+            changes.clear();
+    }
+    /// Combines the hash of the panels and the sum of their type and countdown terms with the fields of the table and the garbage, mirrored if asked.
+    uint64_t table_hash(uint64_t panels, uint64_t sums, bool mirrored) const;
+    /// Hash the table would have if it was mirrored left to right.
+    uint64_t mirrored_hash() const;
 
-    std::set<Point> check_horizontal_combo(int i, int j);
-    std::set<Point> check_vertical_combo(int i, int j);
+    /// Types that would make 3 in a row at i, j with the panels below and to the left of it, one bit per type.
+    uint32_t board_conflicts(int i, int j) const;
+    /// Types that would make 3 in a row at j of the next set of panels with the bottom of the board and the next panels to the left of it.
+    uint32_t next_conflicts(int j) const;
 
     /** Source where panels are generated */
     std::unique_ptr<PanelSource> source;
     /** Speed settings controlling panel speed */
     PanelSpeedSettings settings;
-    /** The panels as a 1d vector */
+    /** Storage for the panels and the next set of panels */
+    PanelData data;
+    /** Views of the panels as a 1d vector */
     std::vector<Panel> panels;
-    /** The next set of panels */
+    /** Views of the next set of panels */
     std::vector<Panel> next;
+    /** Line of panel types filled by the source when generating the next set of panels */
+    std::vector<Panel::Type> next_line;
+    /** Bitboards used to find matches */
+    PanelMatcher matcher;
+    /** Filled by update_matches */
+    MatchGroups match_groups;
+    /** Recorded by data while data.changes points to it */
+    ChangeSet changes;
+    /** Garbage spans ordered by bottom row from the bottom of the board, then by column */
+    std::vector<GarbageSpan> garbage;
+    /** update_board for the size and settings of the board, picked by select_engine */
+    MatchInfo (PanelTable::*engine)() = nullptr;
+    /** The engine for any board is run even if there is a specialised one */
+    bool generic = false;
+    /** The engine is specialised for the board */
+    bool specialised = false;
+    /** Falling stacks moved as segments, in the order update visits them: columns from the right, the lowest segment first */
+    std::vector<FallingSegment> falls;
+    /** Segments still falling after the frame being updated, swapped with falls when the panels are done */
+    std::vector<FallingSegment> next_falls;
+    /** Falling stacks can be made segments */
+    bool segments = true;
     /** Number of columns */
     int columns;
     /** Number of rows */
@@ -211,6 +489,9 @@ private:
     int chain = 0;
     /** Lines raised */
     int lines = 0;
+
+    // Starts its boards from tables, taking their panels and sources, and steps them as update does.
+    friend class PanelTableBatch;
 };
 
 #endif
@@ -0,0 +1,428 @@
+#include "panel_table_batch.hpp"
+#include "panel_table_batch_kernel.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+
+bool PanelTableBatch::valid(const PanelTable::Options& opts)
+{
+    if (!PanelTable::valid(opts))
+        return false;
+
+    const PanelSpeedSettings& settings = opts.settings;
+    const int64_t panels = opts.rows * opts.columns;
+    const int64_t countdowns[] = {settings.swap, settings.pending_fall + settings.falling, settings.idle_fell,
+        settings.first_removed + panels * settings.subsequent_removed,
+        settings.pending_match + (settings.subsequent_removed - 1) * (panels - 1)};
+    for (const int64_t countdown : countdowns)
+    {
+        if (countdown > INT16_MAX)
+            return false;
+    }
+    return true;
+}
+
+PanelTableBatch::PanelTableBatch(const PanelTable::Options& opts, const std::vector<PanelSource*>& board_sources) :
+    settings(opts.settings), type(opts.type), rows(opts.rows), columns(opts.columns), boards(board_sources.size()),
+    block(BATCH_KERNEL_WIDTH), lanes((boards + block - 1) / block * block), cells((rows + 1) * columns), next_line(columns)
+{
+    assert(valid(opts));
+
+    // The boards past the last one are empty boards above a next set of panels, nothing ever happens on them.
+    const int values = cells * lanes;
+    panel_type.assign(values, Panel::Type::EMPTY);
+    old.assign(values, Panel::Type::EMPTY);
+    panel_state.assign(values, Panel::State::IDLE);
+    flags.assign(values, 0);
+    countdown.assign(values, 0);
+    match_time.assign(values, 0);
+    remove_time.assign(values, 0);
+    for (int k = 0; k < lanes; k++)
+    {
+        for (int j = 0; j < columns; j++)
+            at(panel_state, k, rows * columns + j) = Panel::State::BOTTOM;
+    }
+    frame.assign(lanes, 0);
+    combo.assign(lanes, 0);
+    match_x.assign(lanes, 0);
+    match_y.assign(lanes, 0);
+    scratch.assign(2 * rows * columns * BATCH_KERNEL_WIDTH, 0);
+
+    state.assign(boards, PanelTable::INVALID);
+    moves.assign(boards, 0);
+    rise_counter.assign(boards, 0);
+    rise.assign(boards, 0);
+    speed.assign(boards, 0);
+    stopped.assign(boards, 0);
+    timeout.assign(boards, 0);
+    clink.assign(boards, 0);
+    chain.assign(boards, 0);
+    lines.assign(boards, 0);
+    sources.resize(boards);
+    infos.resize(boards);
+
+    // Each board starts as the table made with its source does, which generates the panels.
+    for (int k = 0; k < boards; k++)
+    {
+        PanelTable::Options board_opts = opts;
+        board_opts.source = board_sources[k];
+        PanelTable table(board_opts);
+        const PanelData& data = table.data;
+        for (int index = 0; index < (rows + 1) * columns; index++)
+        {
+            at(panel_type, k, index) = data.type[data.slot(index)];
+            at(old, k, index) = data.old[index];
+            at(panel_state, k, index) = data.state[index];
+            at(flags, k, index) = data.flags[index];
+            at(countdown, k, index) = data.countdown[index];
+            at(match_time, k, index) = data.match_time[index];
+            at(remove_time, k, index) = data.remove_time[index];
+        }
+        state[k] = table.state;
+        moves[k] = table.moves;
+        rise_counter[k] = table.rise_counter;
+        rise[k] = table.rise;
+        speed[k] = table.speed;
+        stopped[k] = table.stopped;
+        timeout[k] = table.timeout;
+        clink[k] = table.clink;
+        chain[k] = table.chain;
+        lines[k] = table.lines;
+        sources[k] = std::move(table.source);
+    }
+
+    kernel = supported(AVX2) ? AVX2 : supported(SSE2) ? SSE2 : SCALAR;
+}
+
+/// Code of a kernel, null if this build doesn't have it.
+static BatchKernel kernel_code(PanelTableBatch::Kernel kernel)
+{
+    if (kernel == PanelTableBatch::AVX2)
+        return batch_avx2_kernel();
+#if defined(__SSE2__)
+    if (kernel == PanelTableBatch::SSE2)
+        return &update_lanes<Sse2Lanes>;
+#endif
+    if (kernel == PanelTableBatch::SCALAR)
+        return &update_lanes<ScalarLanes>;
+    return nullptr;
+}
+
+bool PanelTableBatch::supported(Kernel kernel)
+{
+    if (!kernel_code(kernel))
+        return false;
+#if defined(__x86_64__) || defined(__i386__)
+    // The AVX2 kernel can be built for processors without it.
+    if (kernel == AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return true;
+}
+
+bool PanelTableBatch::set_kernel(Kernel new_kernel)
+{
+    if (!supported(new_kernel))
+        return false;
+    kernel = new_kernel;
+    return true;
+}
+
+void PanelTableBatch::swap(int board, int i, int j)
+{
+    // The right panel is j + 1 so the last column can't be swapped.
+    if (i < 0 || i >= rows || j < 0 || j >= columns - 1)
+        return;
+
+    const int left = i * columns + j;
+    const int right = left + 1;
+    if (!can_swap(board, left) || (type == PanelTable::MOVES && moves[board] <= 0))
+        return;
+
+    // Panel::swap
+    const int16_t left_type = at(panel_type, board, left);
+    at(panel_type, board, left) = at(panel_type, board, right);
+    at(panel_type, board, right) = left_type;
+    at(old, board, left) = left_type;
+    at(old, board, right) = at(panel_type, board, left);
+    at(panel_state, board, left) = Panel::State::LEFT_SWAP;
+    at(panel_state, board, right) = Panel::State::RIGHT_SWAP;
+    for (const int index : {left, right})
+    {
+        // Forfeit chain flag if you become empty.
+        if (at(panel_type, board, index) == Panel::Type::EMPTY)
+            at(flags, board, index) &= ~PanelData::CHAIN;
+        at(countdown, board, index) = settings.swap;
+    }
+
+    moves[board] -= 1;
+}
+
+void PanelTableBatch::quick_rise(int board)
+{
+    if (state[board] == PanelTable::RISING)
+    {
+        state[board] = PanelTable::REQUEST_FAST_RISE;
+        if (stopped[board])
+            timeout[board] = 1;
+    }
+}
+
+void PanelTableBatch::freeze(int board, int cooloff)
+{
+    if (cooloff != 0 && cooloff > timeout[board] && state[board] != PanelTable::PUZZLE)
+    {
+        timeout[board] = cooloff;
+        stopped[board] = true;
+    }
+}
+
+const std::vector<MatchInfo>& PanelTableBatch::update()
+{
+    for (int k = 0; k < boards; k++)
+    {
+        frame[k] = 0;
+        if (state[k] == PanelTable::RISED)
+        {
+            rise_board(k);
+            frame[k] = BATCH_ROSE;
+            state[k] = PanelTable::GENERATE_NEXT;
+            rise[k] = 0;
+            lines[k]++;
+        }
+    }
+
+    const BatchLanes arrays = {rows, columns, lanes, settings, panel_type.data(), old.data(), panel_state.data(), flags.data(),
+        countdown.data(), match_time.data(), remove_time.data(), frame.data(), combo.data(), match_x.data(), match_y.data(),
+        scratch.data()};
+    kernel_code(kernel)(arrays);
+
+    for (int k = 0; k < boards; k++)
+        finish(k, infos[k]);
+    return infos;
+}
+
+void PanelTableBatch::finish(int k, MatchInfo& info)
+{
+    const int bits = frame[k];
+    info = MatchInfo();
+
+    if (!(bits & BATCH_IN_CLINK))
+        clink[k] = 0;
+    if (!(bits & (BATCH_IN_CLINK | BATCH_IN_CHAIN)))
+        chain[k] = 0;
+
+    if (bits & BATCH_MATCHED)
+    {
+        info.combo = combo[k];
+        info.fall_match = (bits & BATCH_FALL_MATCH) != 0;
+        info.swap_match = combo[k] != 0 && !info.fall_match;
+        info.x = match_x[k];
+        info.y = match_y[k];
+    }
+
+    if (info.fall_match)
+    {
+        chain[k]++;
+        info.chain = chain[k] == 0 ? 0 : chain[k] + 1;
+    }
+    if (info.swap_match)
+    {
+        clink[k]++;
+        info.clink = clink[k] <= 1 ? 0 : clink[k] - 1;
+    }
+
+    // Board is stopped while matches are being removed.
+    if (bits & (BATCH_ROSE | BATCH_STOP_RISING))
+        return;
+
+    if (stopped[k])
+    {
+        timeout[k]--;
+        if (timeout[k] >= 0)
+            return;
+        timeout[k] = 0;
+        stopped[k] = false;
+    }
+
+    // The rest of update_board, with the board read from what the kernel found.
+    const bool danger = bits & BATCH_DANGER;
+    if (state[k] == PanelTable::PUZZLE)
+    {
+        const bool win = !(bits & BATCH_FILLED);
+        const bool all_idle = !(bits & BATCH_BUSY) && combo[k] == 0;
+        if ((moves[k] == 0 || win) && all_idle)
+            state[k] = win ? PanelTable::WIN : PanelTable::GAMEOVER;
+    }
+    else if (state[k] == PanelTable::RISING)
+    {
+        if (PanelTable::rise_step(speed[k], rise[k], rise_counter[k]))
+            state[k] = danger ? PanelTable::CLOGGED : PanelTable::RISED;
+    }
+    else if (state[k] == PanelTable::FAST_RISING)
+    {
+        // One frame delay
+        if (rise_counter[k] > 0)
+            rise[k]++;
+
+        rise_counter[k] = 0xfff - speed[k];
+
+        if (rise[k] >= 16)
+        {
+            rise_counter[k] -= 0x1000;
+            state[k] = danger ? PanelTable::CLOGGED : PanelTable::RISED;
+        }
+    }
+    else if (state[k] == PanelTable::REQUEST_FAST_RISE)
+    {
+        state[k] = PanelTable::FAST_RISING;
+        rise_counter[k] = 0xfff - speed[k];
+    }
+    else if (state[k] == PanelTable::GENERATE_NEXT)
+    {
+        generate_next(k);
+        state[k] = PanelTable::RISING;
+    }
+    else if (state[k] == PanelTable::CLOGGED)
+    {
+        if (type == PanelTable::ENDLESS)
+            state[k] = PanelTable::GAMEOVER;
+
+        if (!danger)
+        {
+            state[k] = PanelTable::RISED;
+        }
+        else
+        {
+            if (rise[k] >= 16)
+                state[k] = PanelTable::GAMEOVER;
+
+            if (rise_counter[k] >= 0xfff)
+            {
+                rise[k]++;
+                rise_counter[k] -= 0x1000;
+            }
+            else
+            {
+                rise_counter[k] += speed[k];
+            }
+        }
+    }
+}
+
+void PanelTableBatch::rise_board(int board)
+{
+    const int board_size = rows * columns;
+    for (int index = 0; index < board_size; index++)
+        at(panel_type, board, index) = at(panel_type, board, index + columns);
+    for (int j = 0; j < columns; j++)
+        at(panel_type, board, board_size + j) = Panel::Type::EMPTY;
+}
+
+void PanelTableBatch::generate_next(int board)
+{
+    const int next = rows * columns;
+    sources[board]->take(next_line);
+    for (int j = 0; j < columns; j++)
+        at(panel_type, board, next + j) = next_line[j];
+
+    // Types making 3 in a row with the bottom of the board or the next panels to the left, as PanelTable::next_conflicts.
+    for (int j = 0; j < columns; j++)
+    {
+        uint32_t excluded = 0;
+        const int above = next - columns + j;
+        if (rows >= 2 && matchable(board, above - columns) && matchable(board, above) &&
+            at(panel_type, board, above - columns) == at(panel_type, board, above))
+            excluded |= 1u << at(panel_type, board, above);
+        if (j >= 2)
+        {
+            const int left = at(panel_type, board, next + j - 1);
+            if (left != Panel::Type::EMPTY && left == at(panel_type, board, next + j - 2))
+                excluded |= 1u << left;
+        }
+        if (excluded >> at(panel_type, board, next + j) & 1)
+            at(panel_type, board, next + j) = sources[board]->redraw(excluded);
+    }
+}
+
+bool PanelTableBatch::matchable(int board, int index) const
+{
+    const int value = at(panel_type, board, index);
+    const int current = at(panel_state, board, index);
+    const bool settled = current == Panel::State::IDLE || current == Panel::State::IDLE_FELL || current == Panel::State::SWAPPED ||
+        current == Panel::State::END_FALL;
+    return settled && value != Panel::Type::EMPTY && value != Panel::Type::SPECIAL;
+}
+
+bool PanelTableBatch::can_swap(int board, int index) const
+{
+    const int right = index + 1;
+    if ((at(flags, board, index) | at(flags, board, right)) & PanelData::LOCKED)
+        return false;
+
+    auto is = [&](int cell, Panel::State value) {return at(panel_state, board, cell) == value;};
+    auto empty = [&](int cell) {return at(panel_type, board, cell) == Panel::Type::EMPTY;};
+    auto falling_process = [&](int cell)
+    {
+        return is(cell, Panel::State::PENDING_FALL) || is(cell, Panel::State::FALLING) || is(cell, Panel::State::END_FALL);
+    };
+
+    // The right panel can be pending fall if the left one is, as Panel::can_swap checks it.
+    const bool left_state = is(index, Panel::State::IDLE) || is(index, Panel::State::IDLE_FELL) || falling_process(index) ||
+        is(index, Panel::State::SWAPPED);
+    const bool right_state = is(right, Panel::State::IDLE) || is(right, Panel::State::IDLE_FELL) || is(index, Panel::State::PENDING_FALL) ||
+        is(right, Panel::State::FALLING) || is(right, Panel::State::END_FALL) || is(right, Panel::State::SWAPPED);
+    if (!left_state || !right_state)
+        return false;
+
+    // A panel can't be swapped under a falling panel.
+    if (!empty(index) && empty(right) && right >= columns && falling_process(right - columns))
+        return false;
+    if (empty(index) && !empty(right) && index >= columns && falling_process(index - columns))
+        return false;
+
+    return true;
+}
+
+PanelSnapshot PanelTableBatch::panel(int board, int index) const
+{
+    PanelSnapshot snapshot;
+    snapshot.types = at(panel_type, board, index) | at(old, board, index) << 4;
+    snapshot.flags = at(panel_state, board, index) | (at(flags, board, index) & PanelData::CHAIN ? SNAPSHOT_CHAIN : 0) |
+        (at(flags, board, index) & PanelData::LOCKED ? SNAPSHOT_LOCKED : 0);
+    snapshot.countdown = at(countdown, board, index);
+    snapshot.match_time = at(match_time, board, index);
+    snapshot.remove_time = at(remove_time, board, index);
+    return snapshot;
+}
+
+bool PanelTableBatch::save_state(int board, PanelTableSnapshot& snapshot) const
+{
+    if (rows > SNAPSHOT_MAX_ROWS || columns > SNAPSHOT_MAX_COLUMNS || !sources[board]->save(snapshot.source))
+        return false;
+
+    snapshot.rows = rows;
+    snapshot.columns = columns;
+    snapshot.state = state[board];
+    snapshot.stopped = stopped[board];
+    snapshot.moves = moves[board];
+    snapshot.rise_counter = rise_counter[board];
+    snapshot.rise = rise[board];
+    snapshot.speed = speed[board];
+    snapshot.timeout = timeout[board];
+    snapshot.clink = clink[board];
+    snapshot.chain = chain[board];
+    snapshot.lines = lines[board];
+
+    for (int i = 0; i < rows * columns; i++)
+        snapshot.panels[i] = panel(board, i);
+    for (int j = 0; j < columns; j++)
+        snapshot.next[j] = panel(board, rows * columns + j);
+
+    snapshot.garbage_count = 0;
+    for (int k = 0; k < SNAPSHOT_MAX_GARBAGE; k++)
+        snapshot.garbage[k] = GarbageSpan {0, 0, 0, 0, 0, 0};
+
+    return true;
+}
@@ -0,0 +1,142 @@
+#ifndef PANEL_TABLE_BATCH_HPP
+#define PANEL_TABLE_BATCH_HPP
+
+#include "panel_table.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Steps many boards of the same size, settings and game type in lockstep, each playing the game a PanelTable made with the same
+ * options and source would. The boards are kept in blocks of 16 where each array holds a cell of the 16 boards side by side,
+ * so a kernel updates a cell of 8 or 16 boards with each SSE2 or AVX2 instruction and the cells of a block stay together.
+ * The panels of every board are updated every frame in the order PanelTable::update updates them, only the counters of
+ * each board, rising a row, generating the next set of panels and swaps are done a board at a time.
+ *
+ * Garbage is not supported, the boards are for games without it.
+ */
+class PanelTableBatch
+{
+public:
+    /// Code that updates the panels, SSE2 and AVX2 are only there on processors and builds that have them.
+    enum Kernel
+    {
+        SCALAR = 0,
+        SSE2 = 1,
+        AVX2 = 2,
+    };
+
+    /** Can a batch be made from opts, the table must be PanelTable::valid() and every countdown and match time of removing
+      * all panels of the board at once must fit in 16 bits. */
+    static bool valid(const PanelTable::Options& opts);
+    /** Makes a board for each source as PanelTable(opts) would with opts.source set to it, opts.source is not used.
+      * The batch owns the sources, opts must be valid(). The best kernel the processor runs is picked. */
+    PanelTableBatch(const PanelTable::Options& opts, const std::vector<PanelSource*>& sources);
+
+    /// Number of boards
+    int size() const {return boards;}
+    int width() const {return columns;}
+    int height() const {return rows;}
+
+    /// Can kernel run here
+    static bool supported(Kernel kernel);
+    /// Runs update with kernel from now on, returns false keeping the current one if it is not supported.
+    bool set_kernel(Kernel kernel);
+    Kernel get_kernel() const {return kernel;}
+
+    /// Same as PanelTable::swap on board.
+    void swap(int board, int i, int j);
+    /// Same as PanelTable::quick_rise on board.
+    void quick_rise(int board);
+    /// Same as PanelTable::freeze on board.
+    void freeze(int board, int cooloff);
+    void set_speed(int board, int rise_speed) {speed[board] = rise_speed;}
+
+    /// Moves every board on by a frame, returns what PanelTable::update would have returned for each board.
+    const std::vector<MatchInfo>& update();
+
+    /// Panel at index of board as Panel::save copies it, the next set of panels start at rows * columns.
+    PanelSnapshot panel(int board, int index) const;
+    /// Same as PanelTable::save_state for board, the snapshot of its table.
+    bool save_state(int board, PanelTableSnapshot& snapshot) const;
+
+    PanelTable::State get_state(int board) const {return (PanelTable::State) state[board];}
+    bool is_gameover(int board) const {return state[board] == PanelTable::GAMEOVER;}
+    int get_rise_counter(int board) const {return rise_counter[board];}
+    int get_rise(int board) const {return rise[board];}
+    int get_timeout(int board) const {return timeout[board];}
+    int get_chain(int board) const {return chain[board];}
+    int get_clink(int board) const {return clink[board];}
+    int get_moves(int board) const {return moves[board];}
+    int get_lines(int board) const {return lines[board];}
+
+private:
+    /// Value of a cell of board in one of the cell arrays.
+    int16_t& at(std::vector<int16_t>& values, int board, int index) {return values[offset(board, index)];}
+    int16_t at(const std::vector<int16_t>& values, int board, int index) const {return values[offset(board, index)];}
+    /// Where the value of cell index of board is in each of the cell arrays.
+    int offset(int board, int index) const {return (board / block * cells + index) * block + board % block;}
+    /// Can the panel at index of board be matched, as Panel::can_match.
+    bool matchable(int board, int index) const;
+    /// Can the panel at index of board be swapped with the one to its right, as Panel::can_swap.
+    bool can_swap(int board, int index) const;
+    /// Moves every type of board including the next set of panels up a row, as PanelData::rise.
+    void rise_board(int board);
+    /// Takes the next set of panels of board from its source, as PanelTable::generate_next.
+    void generate_next(int board);
+    /// Does what PanelTable::update_board does after the panels were updated and the matches found, for board.
+    void finish(int board, MatchInfo& info);
+
+    PanelSpeedSettings settings;
+    PanelTable::Type type;
+    int rows;
+    int columns;
+    /// Number of boards
+    int boards;
+    /// Boards kept together, as many as the widest kernel updates at once
+    int block;
+    /// Boards rounded up to a block, the boards past the last one stay empty.
+    int lanes;
+    /// Cells of a board, the panels and the next set of panels.
+    int cells;
+    Kernel kernel = SCALAR;
+
+    /** Values of the panels and the next set of panels of each board, at offset(board, index) */
+    std::vector<int16_t> panel_type;
+    std::vector<int16_t> old;
+    std::vector<int16_t> panel_state;
+    /** PanelData::Flags */
+    std::vector<int16_t> flags;
+    std::vector<int16_t> countdown;
+    std::vector<int16_t> match_time;
+    std::vector<int16_t> remove_time;
+    /** What the kernel is told about each board and what it found, BatchFrame bits */
+    std::vector<int16_t> frame;
+    /** Panels matched, the column and row of the last panel matched, by the kernel for each board */
+    std::vector<int16_t> combo;
+    std::vector<int16_t> match_x;
+    std::vector<int16_t> match_y;
+    /** Room the kernel finds the matches in */
+    std::vector<int16_t> scratch;
+
+    /** Counters of each board, as PanelTable keeps them */
+    std::vector<int> state;
+    std::vector<int> moves;
+    std::vector<int> rise_counter;
+    std::vector<int> rise;
+    std::vector<int> speed;
+    std::vector<uint8_t> stopped;
+    std::vector<int> timeout;
+    std::vector<int> clink;
+    std::vector<int> chain;
+    std::vector<int> lines;
+    std::vector<std::unique_ptr<PanelSource>> sources;
+
+    /** Returned by update */
+    std::vector<MatchInfo> infos;
+    /** Filled by the source when generating the next set of panels */
+    std::vector<Panel::Type> next_line;
+};
+
+#endif
@@ -0,0 +1,12 @@
+/* The AVX2 kernel of PanelTableBatch, in a file of its own so only it is built with AVX2 enabled (-mavx2 on x86).
+   Built without it, as for the 3DS, there is no AVX2 kernel. */
+#include "panel_table_batch_kernel.hpp"
+
+BatchKernel batch_avx2_kernel()
+{
+#if defined(__AVX2__)
+    return &update_lanes<Avx2Lanes>;
+#else
+    return nullptr;
+#endif
+}
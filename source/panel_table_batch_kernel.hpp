@@ -0,0 +1,483 @@
+#ifndef PANEL_TABLE_BATCH_KERNEL_HPP
+#define PANEL_TABLE_BATCH_KERNEL_HPP
+
+#include "panel.hpp"
+
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/// Bits of PanelTableBatch::frame, what a board tells the kernel and what the kernel found on it.
+enum BatchFrame
+{
+    /// The board rose a row before the kernel ran, its matches are looked for as update_board does.
+    BATCH_ROSE = 1,
+    /// A panel was falling, swapping or being matched when the frame started, so the board doesn't rise.
+    BATCH_STOP_RISING = 2,
+    /// A panel was being matched when the frame started.
+    BATCH_IN_CLINK = 4,
+    /// A panel had its chain flag set when the frame started.
+    BATCH_IN_CHAIN = 8,
+    /// A panel is not idle after the panels were updated, panels matched after that are counted by combo.
+    BATCH_BUSY = 16,
+    /// The board has a panel.
+    BATCH_FILLED = 32,
+    /// The top row has a panel.
+    BATCH_DANGER = 64,
+    /// Matches were looked for, combo and the match are set.
+    BATCH_MATCHED = 128,
+    /// A panel matched had landed with its chain flag set.
+    BATCH_FALL_MATCH = 256,
+};
+
+/// Arrays of a PanelTableBatch a kernel works on, laid out as PanelTableBatch keeps them.
+struct BatchLanes
+{
+    int rows;
+    int columns;
+    int lanes;
+    PanelSpeedSettings settings;
+    int16_t* type;
+    int16_t* old;
+    int16_t* state;
+    int16_t* flags;
+    int16_t* countdown;
+    int16_t* match_time;
+    int16_t* remove_time;
+    int16_t* frame;
+    int16_t* combo;
+    int16_t* match_x;
+    int16_t* match_y;
+    /// Two values per cell for each of BATCH_KERNEL_WIDTH boards.
+    int16_t* scratch;
+};
+
+/// Most boards a kernel updates at once, the boards of a batch are rounded up to a multiple of it.
+#define BATCH_KERNEL_WIDTH 16
+
+/// Updates the panels of every board by a frame and finds their matches.
+typedef void (*BatchKernel)(const BatchLanes& lanes);
+
+/// The AVX2 kernel, null if panel_table_batch_avx2.cpp was not built for AVX2.
+BatchKernel batch_avx2_kernel();
+
+/* The AVX2 kernel is built with other flags than the rest of the program. Nothing below may be shared between the files
+   including this one, the linker would keep a single copy of it which could be the AVX2 build of it. */
+namespace
+{
+
+/// Where the value of cell index of board is in each of the cell arrays, the cells of a block of boards are together.
+int batch_offset(const BatchLanes& b, int board, int index)
+{
+    return (board / BATCH_KERNEL_WIDTH * (b.rows + 1) * b.columns + index) * BATCH_KERNEL_WIDTH + board % BATCH_KERNEL_WIDTH;
+}
+
+/// A value per board, one board at a time. Masks are all bits set for true.
+struct ScalarLanes
+{
+    typedef int16_t Vec;
+    static constexpr int WIDTH = 1;
+
+    static Vec load(const int16_t* values) {return *values;}
+    static void store(int16_t* values, Vec v) {*values = v;}
+    static Vec set(int value) {return (int16_t) value;}
+    static Vec add(Vec a, Vec b) {return (int16_t) (a + b);}
+    static Vec sub(Vec a, Vec b) {return (int16_t) (a - b);}
+    static Vec mul(Vec a, Vec b) {return (int16_t) (a * b);}
+    static Vec eq(Vec a, Vec b) {return a == b ? -1 : 0;}
+    static Vec gt(Vec a, Vec b) {return a > b ? -1 : 0;}
+    static Vec both(Vec a, Vec b) {return a & b;}
+    static Vec either(Vec a, Vec b) {return a | b;}
+    /// a without the bits of b
+    static Vec except(Vec a, Vec b) {return a & ~b;}
+    static Vec select(Vec mask, Vec a, Vec b) {return (a & mask) | (b & ~mask);}
+    template <int N> static Vec shift_right(Vec a) {return (int16_t) ((uint16_t) a >> N);}
+    static bool any(Vec mask) {return mask != 0;}
+};
+
+#if defined(__SSE2__)
+/// 8 boards at a time.
+struct Sse2Lanes
+{
+    typedef __m128i Vec;
+    static constexpr int WIDTH = 8;
+
+    static Vec load(const int16_t* values) {return _mm_loadu_si128((const __m128i*) values);}
+    static void store(int16_t* values, Vec v) {_mm_storeu_si128((__m128i*) values, v);}
+    static Vec set(int value) {return _mm_set1_epi16((int16_t) value);}
+    static Vec add(Vec a, Vec b) {return _mm_add_epi16(a, b);}
+    static Vec sub(Vec a, Vec b) {return _mm_sub_epi16(a, b);}
+    static Vec mul(Vec a, Vec b) {return _mm_mullo_epi16(a, b);}
+    static Vec eq(Vec a, Vec b) {return _mm_cmpeq_epi16(a, b);}
+    static Vec gt(Vec a, Vec b) {return _mm_cmpgt_epi16(a, b);}
+    static Vec both(Vec a, Vec b) {return _mm_and_si128(a, b);}
+    static Vec either(Vec a, Vec b) {return _mm_or_si128(a, b);}
+    static Vec except(Vec a, Vec b) {return _mm_andnot_si128(b, a);}
+    static Vec select(Vec mask, Vec a, Vec b) {return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));}
+    template <int N> static Vec shift_right(Vec a) {return _mm_srli_epi16(a, N);}
+    static bool any(Vec mask) {return _mm_movemask_epi8(mask) != 0;}
+};
+#endif
+
+#if defined(__AVX2__)
+/// 16 boards at a time.
+struct Avx2Lanes
+{
+    typedef __m256i Vec;
+    static constexpr int WIDTH = 16;
+
+    static Vec load(const int16_t* values) {return _mm256_loadu_si256((const __m256i*) values);}
+    static void store(int16_t* values, Vec v) {_mm256_storeu_si256((__m256i*) values, v);}
+    static Vec set(int value) {return _mm256_set1_epi16((int16_t) value);}
+    static Vec add(Vec a, Vec b) {return _mm256_add_epi16(a, b);}
+    static Vec sub(Vec a, Vec b) {return _mm256_sub_epi16(a, b);}
+    static Vec mul(Vec a, Vec b) {return _mm256_mullo_epi16(a, b);}
+    static Vec eq(Vec a, Vec b) {return _mm256_cmpeq_epi16(a, b);}
+    static Vec gt(Vec a, Vec b) {return _mm256_cmpgt_epi16(a, b);}
+    static Vec both(Vec a, Vec b) {return _mm256_and_si256(a, b);}
+    static Vec either(Vec a, Vec b) {return _mm256_or_si256(a, b);}
+    static Vec except(Vec a, Vec b) {return _mm256_andnot_si256(b, a);}
+    static Vec select(Vec mask, Vec a, Vec b) {return _mm256_blendv_epi8(b, a, mask);}
+    template <int N> static Vec shift_right(Vec a) {return _mm256_srli_epi16(a, N);}
+    static bool any(Vec mask) {return _mm256_movemask_epi8(mask) != 0;}
+};
+#endif
+
+/// Mask of the lanes of x from low to high.
+template <class L> typename L::Vec between(typename L::Vec x, int low, int high)
+{
+    return L::both(L::gt(x, L::set(low - 1)), L::gt(L::set(high + 1), x));
+}
+
+/** Finds the matches of the boards first to first + L::WIDTH - 1 that need them and starts matching their panels,
+  * as PanelTable::update_matches does. Adds the BatchFrame bits of the match to bits. */
+template <class L> void match_group(const BatchLanes& b, int first, typename L::Vec need, typename L::Vec& bits)
+{
+    typedef typename L::Vec Vec;
+    const int rows = b.rows;
+    const int columns = b.columns;
+    const int board_size = rows * columns;
+    const Vec zero = L::set(0);
+    int16_t* key = b.scratch;
+    int16_t* removed = b.scratch + board_size * L::WIDTH;
+    const int block = batch_offset(b, first, 0);
+    auto cell = [&](int16_t* values, int index) {return values + block + index * BATCH_KERNEL_WIDTH;};
+
+    // Panels are checked as Panel::can_match does, the key of a panel that can be matched is its type and 0 otherwise.
+    for (int index = 0; index < board_size; index++)
+    {
+        const Vec type = L::load(cell(b.type, index));
+        const Vec state = L::load(cell(b.state, index));
+        const Vec normal = L::except(need, L::eq(type, L::set(Panel::Type::SPECIAL)));
+        const Vec settled = L::either(L::either(L::eq(state, L::set(Panel::State::IDLE)), L::eq(state, L::set(Panel::State::IDLE_FELL))),
+            L::either(L::eq(state, L::set(Panel::State::SWAPPED)), L::eq(state, L::set(Panel::State::END_FALL))));
+        L::store(key + index * L::WIDTH, L::both(L::both(normal, settled), type));
+    }
+
+    /* Runs of 3 of a type along a row and down a column, as PanelMatcher::find. Two panels next to each other with the same key
+       are a pair and two pairs in a row a run, a panel is removed if one of the runs starting at it or the two panels before it is. */
+    auto pair = [&](int a, int c)
+    {
+        const Vec value = L::load(key + a * L::WIDTH);
+        return L::except(L::eq(value, L::load(key + c * L::WIDTH)), L::eq(value, zero));
+    };
+    auto runs = [&](int start, int step, int count, bool add)
+    {
+        Vec next = count > 1 ? pair(start, start + step) : zero;
+        Vec last = zero;
+        Vec before = zero;
+        for (int n = 0; n < count; n++)
+        {
+            const int index = start + n * step;
+            const Vec current = next;
+            next = n + 2 < count ? pair(index + step, index + 2 * step) : zero;
+            const Vec run = L::both(current, next);
+            Vec found = L::either(run, L::either(last, before));
+            if (add)
+                found = L::either(found, L::load(removed + index * L::WIDTH));
+            L::store(removed + index * L::WIDTH, found);
+            before = last;
+            last = run;
+        }
+    };
+    for (int i = 0; i < rows; i++)
+        runs(i * columns, 1, columns, false);
+    for (int j = 0; j < columns; j++)
+        runs(j, columns, rows, true);
+
+    // Panels matched, a bit for each type matched and whether a panel that landed with its chain flag set is among them.
+    Vec total = zero;
+    Vec types = zero;
+    Vec fall_match = zero;
+    for (int index = 0; index < board_size; index++)
+    {
+        const Vec match = L::load(removed + index * L::WIDTH);
+        if (!L::any(match))
+            continue;
+        const Vec type = L::load(cell(b.type, index));
+        Vec bit = zero;
+        for (int t = Panel::Type::RED; t < Panel::Type::SPECIAL; t++)
+            bit = L::either(bit, L::both(L::eq(type, L::set(t)), L::set(1 << t)));
+        total = L::sub(total, match);
+        types = L::either(types, L::both(match, bit));
+        const Vec chained = L::eq(L::both(L::load(cell(b.flags, index)), L::set(PanelData::CHAIN)), L::set(PanelData::CHAIN));
+        fall_match = L::either(fall_match, L::both(match, L::both(chained, L::eq(L::load(cell(b.state, index)), L::set(Panel::State::END_FALL)))));
+    }
+
+    // Number of types matched, the bits of types are counted in parallel.
+    types = L::sub(types, L::both(L::template shift_right<1>(types), L::set(0x55)));
+    types = L::add(L::both(types, L::set(0x33)), L::both(L::template shift_right<2>(types), L::set(0x33)));
+    types = L::both(L::add(types, L::template shift_right<4>(types)), L::set(0x0F));
+
+    // Panel::match with each panel, visited from the bottom right to the top left so the last panel visited is removed first.
+    const PanelSpeedSettings& settings = b.settings;
+    const Vec subsequent = L::set(settings.subsequent_removed);
+    const Vec first_removed = L::set(settings.first_removed);
+    const Vec one = L::set(1);
+    const Vec remove_time = L::add(first_removed, L::mul(L::sub(total, one), subsequent));
+    const Vec match_countdown = L::add(L::set(settings.pending_match), L::mul(L::set(settings.subsequent_removed - 1), L::sub(types, one)));
+    Vec index = L::sub(total, one);
+    Vec x = zero;
+    Vec y = zero;
+    for (int i = rows - 1; i >= 0; i--)
+    {
+        for (int j = columns - 1; j >= 0; j--)
+        {
+            const int at = i * columns + j;
+            const Vec match = L::load(removed + at * L::WIDTH);
+            if (!L::any(match))
+                continue;
+            L::store(cell(b.state, at), L::select(match, L::set(Panel::State::PENDING_MATCH), L::load(cell(b.state, at))));
+            L::store(cell(b.match_time, at), L::select(match, L::add(first_removed, L::mul(index, subsequent)), L::load(cell(b.match_time, at))));
+            L::store(cell(b.remove_time, at), L::select(match, remove_time, L::load(cell(b.remove_time, at))));
+            L::store(cell(b.countdown, at), L::select(match, match_countdown, L::load(cell(b.countdown, at))));
+            x = L::select(match, L::set(j), x);
+            y = L::select(match, L::set(i), y);
+            index = L::add(index, match);
+        }
+    }
+
+    L::store(b.combo + first, total);
+    L::store(b.match_x + first, x);
+    L::store(b.match_y + first, y);
+    bits = L::either(bits, L::either(L::both(need, L::set(BATCH_MATCHED)), L::both(fall_match, L::set(BATCH_FALL_MATCH))));
+}
+
+/** Updates the panels of the boards first to first + L::WIDTH - 1 by a frame as PanelTable::update_board does, every panel from
+  * the bottom row up so a panel is updated after the panel below it, then finds their matches. */
+template <class L> void update_group(const BatchLanes& b, int first)
+{
+    typedef typename L::Vec Vec;
+    const int columns = b.columns;
+    const int board_size = b.rows * columns;
+    const PanelSpeedSettings& settings = b.settings;
+    const int block = batch_offset(b, first, 0);
+    auto cell = [&](int16_t* values, int index) {return values + block + index * BATCH_KERNEL_WIDTH;};
+
+    const Vec zero = L::set(0);
+    const Vec one = L::set(1);
+    const Vec chain_flag = L::set(PanelData::CHAIN);
+    const Vec locked_flag = L::set(PanelData::LOCKED);
+    const Vec idle = L::set(Panel::State::IDLE);
+    const Vec idle_fell = L::set(Panel::State::IDLE_FELL);
+    const Vec swapped = L::set(Panel::State::SWAPPED);
+    const Vec pending_fall = L::set(Panel::State::PENDING_FALL);
+    const Vec falling = L::set(Panel::State::FALLING);
+    const Vec end_fall = L::set(Panel::State::END_FALL);
+    const Vec pending_match = L::set(Panel::State::PENDING_MATCH);
+    const Vec matched = L::set(Panel::State::MATCHED);
+    const Vec removed = L::set(Panel::State::REMOVED);
+    const Vec end_match = L::set(Panel::State::END_MATCH);
+    const Vec garbage = L::set(Panel::State::GARBAGE);
+
+    const Vec rose = L::set(BATCH_ROSE);
+    Vec bits = L::both(L::load(b.frame + first), rose);
+    Vec need_matches = L::eq(bits, rose);
+    Vec stop_rising = zero;
+    Vec in_clink = zero;
+    Vec chains = zero;
+    Vec busy = zero;
+    Vec filled = zero;
+    Vec danger = zero;
+
+    for (int j = 0; j < columns; j++)
+    {
+        // A panel is written once the panel above it was updated, which can fall into it. Below the bottom row are the next set of panels.
+        int below = board_size + j;
+        Vec below_type = L::load(cell(b.type, below));
+        Vec below_state = L::load(cell(b.state, below));
+        Vec below_flags = L::load(cell(b.flags, below));
+        Vec below_countdown = L::load(cell(b.countdown, below));
+        auto write_below = [&]()
+        {
+            L::store(cell(b.type, below), below_type);
+            L::store(cell(b.state, below), below_state);
+            L::store(cell(b.flags, below), below_flags);
+            L::store(cell(b.countdown, below), below_countdown);
+            busy = L::either(busy, L::except(L::except(L::except(L::set(-1), L::eq(below_state, idle)), L::eq(below_state, idle_fell)),
+                L::eq(below_state, garbage)));
+            filled = L::either(filled, L::except(L::set(-1), L::eq(below_type, zero)));
+        };
+        // The panel at index was updated, the one below it is written and it is the one below the next.
+        auto take = [&](int index, Vec type, Vec state, Vec flags, Vec countdown)
+        {
+            if (below < board_size)
+                write_below();
+            below = index;
+            below_type = type;
+            below_state = state;
+            below_flags = flags;
+            below_countdown = countdown;
+        };
+
+        for (int i = b.rows - 1; i >= 0; i--)
+        {
+            const int index = i * columns + j;
+            const Vec type = L::load(cell(b.type, index));
+            const Vec state = L::load(cell(b.state, index));
+            const Vec flags = L::load(cell(b.flags, index));
+            Vec countdown = L::load(cell(b.countdown, index));
+
+            // What update_board gathers from the panels, the panel is as it was when the frame started.
+            const Vec match_process = between<L>(state, Panel::State::PENDING_MATCH, Panel::State::END_MATCH);
+            in_clink = L::either(in_clink, match_process);
+            stop_rising = L::either(stop_rising, L::either(match_process, L::either(between<L>(state, Panel::State::LEFT_SWAP,
+                Panel::State::RIGHT_SWAP), between<L>(state, Panel::State::FALLING, Panel::State::END_FALL))));
+            chains = L::either(chains, flags);
+
+            /* An idle panel starts falling onto a falling panel or into an empty cell that isn't busy, what is below is as it was
+               before this panel's update as an idle panel doesn't move. When no board has a panel here that acts the rest of
+               Panel::update is skipped, which is most of the cells of a board. */
+            const Vec below_falling = between<L>(below_state, Panel::State::PENDING_FALL, Panel::State::END_FALL);
+            const Vec open = L::both(L::eq(below_type, zero), L::either(L::either(L::eq(below_state, idle), L::eq(below_state, idle_fell)),
+                L::either(L::eq(below_state, swapped), L::eq(below_state, end_match))));
+            const Vec drop = L::either(below_falling, open);
+            if (!L::any(L::either(L::except(L::set(-1), L::eq(state, idle)), L::except(drop, L::eq(type, zero)))))
+            {
+                take(index, type, state, flags, countdown);
+                continue;
+            }
+
+            // Panel::update, a state with a countdown acts once it runs out and the others every frame.
+            const Vec counting = L::either(L::either(between<L>(state, Panel::State::LEFT_SWAP, Panel::State::RIGHT_SWAP), L::eq(state, falling)),
+                L::either(L::eq(state, idle_fell), between<L>(state, Panel::State::PENDING_MATCH, Panel::State::REMOVED)));
+            countdown = L::select(counting, L::sub(countdown, one), countdown);
+            const Vec expired = L::both(counting, L::gt(one, countdown));
+
+            /* A panel counting down that doesn't run out, as a matched one does for many frames, changes nothing but its countdown
+               unless it starts falling. The rest is skipped as well when that or idle is all there is on every board. */
+            const Vec still = L::except(L::either(L::eq(state, idle), counting), expired);
+            const Vec falls = L::both(L::either(L::eq(state, idle), L::eq(state, idle_fell)), L::except(drop, L::eq(type, zero)));
+            if (!L::any(L::except(L::set(-1), L::except(still, falls))))
+            {
+                take(index, type, state, flags, countdown);
+                continue;
+            }
+
+            Vec new_type = type;
+            Vec new_state = state;
+            Vec new_flags = flags;
+            Vec new_countdown = countdown;
+
+            // swap_end
+            Vec act = L::both(expired, between<L>(state, Panel::State::LEFT_SWAP, Panel::State::RIGHT_SWAP));
+            if (L::any(act))
+                L::store(cell(b.old, index), L::except(L::load(cell(b.old, index)), act));
+            new_state = L::select(act, swapped, new_state);
+            // swapped
+            new_state = L::select(L::eq(state, swapped), idle, new_state);
+            // pending_fall
+            act = L::eq(state, pending_fall);
+            new_countdown = L::select(act, L::sub(countdown, one), new_countdown);
+            new_state = L::select(act, falling, new_state);
+            // fall, into an empty cell below, onto a falling panel or landing
+            act = L::except(L::both(expired, L::eq(state, falling)), L::eq(type, zero));
+            const Vec move = L::both(act, L::both(L::eq(below_type, zero), L::either(L::eq(below_state, idle), L::eq(below_state, idle_fell))));
+            const Vec slip = L::except(L::both(act, below_falling), L::eq(below_type, zero));
+            const Vec land = L::except(L::both(expired, L::eq(state, falling)), L::either(move, slip));
+            new_type = L::except(new_type, move);
+            new_state = L::select(move, idle, new_state);
+            new_flags = L::except(new_flags, move);
+            new_state = L::select(slip, below_state, new_state);
+            new_countdown = L::select(slip, below_countdown, new_countdown);
+            new_state = L::select(land, end_fall, new_state);
+            below_type = L::select(move, type, below_type);
+            below_state = L::select(move, falling, below_state);
+            below_countdown = L::select(move, L::set(settings.falling), below_countdown);
+            below_flags = L::select(move, L::either(L::except(below_flags, chain_flag), L::both(flags, chain_flag)), below_flags);
+            // fall_end
+            act = L::eq(state, end_fall);
+            new_state = L::select(act, idle_fell, new_state);
+            new_countdown = L::select(act, L::set(settings.idle_fell), new_countdown);
+            new_flags = L::except(new_flags, L::both(act, chain_flag));
+            // fell_idle_end
+            new_state = L::select(L::both(expired, L::eq(state, idle_fell)), idle, new_state);
+            // pending_match_end, matched_end and removed_end, only read the match times if a panel needs them.
+            act = L::both(expired, between<L>(state, Panel::State::PENDING_MATCH, Panel::State::MATCHED));
+            if (L::any(act))
+            {
+                const Vec match_time = L::load(cell(b.match_time, index));
+                const Vec removing = L::sub(L::load(cell(b.remove_time, index)), match_time);
+                act = L::both(expired, L::eq(state, pending_match));
+                new_state = L::select(act, matched, new_state);
+                new_countdown = L::select(act, match_time, new_countdown);
+                act = L::both(expired, L::eq(state, matched));
+                const Vec last = L::both(act, L::eq(removing, zero));
+                new_countdown = L::select(act, removing, new_countdown);
+                new_type = L::except(new_type, last);
+                new_state = L::select(act, L::select(last, end_match, removed), new_state);
+            }
+            act = L::both(expired, L::eq(state, removed));
+            new_type = L::except(new_type, act);
+            new_state = L::select(act, end_match, new_state);
+            // match_end
+            act = L::eq(state, end_match);
+            new_state = L::select(act, idle, new_state);
+            new_flags = L::except(new_flags, L::both(act, chain_flag));
+
+            /* An idle or swapped panel starts falling as an idle one does, a panel that moved down has left this cell empty
+               and one that slipped has a falling panel below, so drop is still right for them. */
+            const Vec settled = L::either(L::either(L::eq(new_state, idle), L::eq(new_state, idle_fell)), L::eq(new_state, swapped));
+            const Vec start = L::except(L::both(settled, drop), L::eq(new_type, zero));
+            const Vec chained = L::either(L::eq(below_state, end_match), L::eq(L::both(below_flags, chain_flag), chain_flag));
+            new_flags = L::select(start, L::either(L::both(L::eq(new_state, swapped), locked_flag), L::both(chained, chain_flag)), new_flags);
+            new_state = L::select(start, pending_fall, new_state);
+            new_countdown = L::select(start, L::set(settings.pending_fall + settings.falling), new_countdown);
+
+            need_matches = L::either(need_matches, L::either(L::eq(new_state, swapped), L::eq(new_state, end_fall)));
+
+            take(index, new_type, new_state, new_flags, new_countdown);
+        }
+
+        // Nothing falls into the top row.
+        write_below();
+        danger = L::either(danger, L::except(L::set(-1), L::eq(below_type, zero)));
+    }
+
+    bits = L::either(bits, L::both(stop_rising, L::set(BATCH_STOP_RISING)));
+    bits = L::either(bits, L::both(in_clink, L::set(BATCH_IN_CLINK)));
+    bits = L::either(bits, L::both(L::eq(L::both(chains, chain_flag), chain_flag), L::set(BATCH_IN_CHAIN)));
+    bits = L::either(bits, L::both(busy, L::set(BATCH_BUSY)));
+    bits = L::either(bits, L::both(filled, L::set(BATCH_FILLED)));
+    bits = L::either(bits, L::both(danger, L::set(BATCH_DANGER)));
+    if (L::any(need_matches))
+        match_group<L>(b, first, need_matches, bits);
+    else
+        L::store(b.combo + first, zero);
+    L::store(b.frame + first, bits);
+}
+
+/// Kernel updating the boards L::WIDTH at a time.
+template <class L> void update_lanes(const BatchLanes& lanes)
+{
+    for (int first = 0; first < lanes.lanes; first += L::WIDTH)
+        update_group<L>(lanes, first);
+}
+
+}
+
+#endif
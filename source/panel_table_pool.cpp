@@ -0,0 +1,72 @@
+#include "panel_table_pool.hpp"
+
+std::unique_ptr<PanelTable> PanelTablePool::acquire(const PanelTable::Options& opts)
+{
+    const int index = find(opts);
+    if (index < 0)
+        return create(opts);
+
+    std::unique_ptr<PanelTable> table = take(index);
+    if (!table->reset(opts))
+    {
+        // The table still holds its last game, it goes back for a later acquire.
+        release(std::move(table));
+        return create(opts);
+    }
+    return table;
+}
+
+std::unique_ptr<PanelTable> PanelTablePool::acquire(const PanelTable::Options& opts, uint32_t seed)
+{
+    const int index = find(opts);
+    if (index < 0)
+    {
+        if (opts.source && PanelTable::valid(opts))
+            opts.source->reseed(seed);
+        return create(opts);
+    }
+
+    std::unique_ptr<PanelTable> table = take(index);
+    if (!table->reset(opts, seed))
+    {
+        release(std::move(table));
+        return create(opts);
+    }
+    return table;
+}
+
+std::unique_ptr<PanelTable> PanelTablePool::create(const PanelTable::Options& opts)
+{
+    if (!PanelTable::valid(opts))
+    {
+        delete opts.source;
+        return nullptr;
+    }
+    return std::unique_ptr<PanelTable>(opts.source ? new PanelTable(opts) : nullptr);
+}
+
+int PanelTablePool::find(const PanelTable::Options& opts) const
+{
+    // Prefer a table of the same size, its storage is exactly what the game needs.
+    for (size_t k = 0; k < tables.size(); k++)
+    {
+        if (tables[k]->width() == opts.columns && tables[k]->height() == opts.rows && tables[k]->can_reset(opts))
+            return k;
+    }
+    // Any table can be resized for a game with its own source.
+    return opts.source ? (int) tables.size() - 1 : -1;
+}
+
+std::unique_ptr<PanelTable> PanelTablePool::take(int index)
+{
+    std::unique_ptr<PanelTable> table = std::move(tables[index]);
+    tables[index] = std::move(tables.back());
+    tables.pop_back();
+    return table;
+}
+
+void PanelTablePool::release(std::unique_ptr<PanelTable> table)
+{
+    if (table)
+        tables.push_back(std::move(table));
+}
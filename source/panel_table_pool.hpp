@@ -0,0 +1,40 @@
+#ifndef PANEL_TABLE_POOL_HPP
+#define PANEL_TABLE_POOL_HPP
+
+#include "panel_table.hpp"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Keeps the tables of finished games so the next games reset them instead of constructing new ones.
+ * A reset table reuses the storage it already has, so a loop starting thousands of games allocates nothing once the pool is warm.
+ */
+class PanelTablePool
+{
+public:
+    PanelTablePool() {}
+
+    /** A table for a new game with opts, reset from a released table if there is one. The pool takes ownership of opts.source either way.
+      * With a null opts.source only a released table of the same size keeping its source will do, returns null if there is none.
+      * Returns null if opts is not PanelTable::valid(), deleting opts.source. */
+    std::unique_ptr<PanelTable> acquire(const PanelTable::Options& opts);
+    /// Same as acquire but the source, given or kept, starts over from seed first.
+    std::unique_ptr<PanelTable> acquire(const PanelTable::Options& opts, uint32_t seed);
+    /// Gives back a table whose game is over for a later acquire.
+    void release(std::unique_ptr<PanelTable> table);
+    /// Number of tables waiting to be acquired
+    int size() const {return (int) tables.size();}
+
+private:
+    /// Index of the released table to reset for opts, -1 if none will do.
+    int find(const PanelTable::Options& opts) const;
+    /// Takes the released table at index out of the pool.
+    std::unique_ptr<PanelTable> take(int index);
+    /// A new table for opts when no released table will do, null if opts has no source or is not valid.
+    static std::unique_ptr<PanelTable> create(const PanelTable::Options& opts);
+
+    std::vector<std::unique_ptr<PanelTable>> tables;
+};
+
+#endif
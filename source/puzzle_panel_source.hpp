@@ -7,7 +7,7 @@
 class PuzzlePanelSource : public PanelSource
 {
 public:
-    PuzzlePanelSource(const BasicPuzzle& puzzle) : PanelSource(12, 6), table(72)
+    PuzzlePanelSource(const BasicPuzzle& puzzle) : PanelSource(puzzle.rows, puzzle.columns), table(puzzle.rows * puzzle.columns)
     {
         for (unsigned int i = 0; i < table.size(); i++)
             table[i] = (Panel::Type) puzzle.panels[i];
@@ -1,5 +1,6 @@
 #include "recorder.hpp"
 #include <algorithm>
+#include <cstring>
 #include <ctime>
 
 const std::string generate_filename()
@@ -56,30 +57,230 @@ bool Recorder::save()
     return ret;
 }
 
-bool Recorder::save(std::ostream& file)
+bool Recorder::save(std::ostream& file) const
 {
-    const char magic[4] = {'B', 'B', 'B', 0};
+    save_part(file, 0, save_size());
+    return true;
+}
+
+/// Magic, version and settings that start a save.
+static const size_t header_size = 11;
+
+/** Writes the part of a save that falls between offset and limit as the save is walked through from the start. */
+struct SaveWindow
+{
+    SaveWindow(std::ostream& f, size_t o, size_t max_bytes) : file(f), offset(o), limit(o + max_bytes) {}
+
+    /// Takes the next size bytes of the save, setting begin and end to the part of them inside the window.
+    bool take(size_t size, size_t& begin, size_t& end)
+    {
+        begin = std::min(std::max(offset, position), position + size) - position;
+        end = std::max(std::min(limit, position + size), position) - position;
+        position += size;
+        written += end > begin ? end - begin : 0;
+        return end > begin;
+    }
+
+    void write(const void* data, size_t size)
+    {
+        size_t begin, end;
+        if (take(size, begin, end))
+            file.write(static_cast<const char*>(data) + begin, end - begin);
+    }
+
+    void put(const std::vector<Panel::Type>& panels)
+    {
+        size_t begin, end;
+        if (take(panels.size(), begin, end))
+        {
+            for (size_t k = begin; k < end; k++)
+                file.put(panels[k]);
+        }
+    }
+
+    std::ostream& file;
+    size_t offset;
+    size_t limit;
+    size_t position = 0;
+    size_t written = 0;
+};
 
-    file.write(magic, sizeof(magic));
-    file.put(RECORDER_MAJOR_VERSION);
-    file.put(RECORDER_MINOR_VERSION);
-    file.put(rows);
-    file.put(columns);
-    file.put(type);
-    file.put(difficulty);
-    file.put(level);
+size_t Recorder::save_size() const
+{
+    return header_size + initial.size() + sizeof(unsigned int) + next.size() + sizeof(unsigned int) + input.size() * sizeof(Input);
+}
+
+size_t Recorder::save_part(std::ostream& file, size_t offset, size_t max_bytes) const
+{
+    const char header[header_size] = {'B', 'B', 'B', 0, RECORDER_MAJOR_VERSION, RECORDER_MINOR_VERSION,
+        (char) rows, (char) columns, (char) type, (char) difficulty, (char) level};
+
+    SaveWindow window(file, offset, std::min(max_bytes, save_size() - std::min(offset, save_size())));
+    window.write(header, sizeof(header));
     // rows * columns size.
-    for (const auto& panel : initial)
-        file.put(panel);
+    window.put(initial);
     unsigned int size = next.size();
-    file.write(reinterpret_cast<char*>(&size), sizeof(size));
-    for (const auto& panel : next)
-        file.put(panel);
+    window.write(&size, sizeof(size));
+    window.put(next);
 
     size = input.size();
-    file.write(reinterpret_cast<char*>(&size), sizeof(size));
-    for (const auto& move : input)
-        file.write(reinterpret_cast<const char*>(&move), sizeof(move));
+    window.write(&size, sizeof(size));
+    window.write(input.data(), input.size() * sizeof(Input));
 
-    return true;
+    return window.written;
+}
+
+bool Recorder::load_header(std::istream& file)
+{
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    if (!file || memcmp(magic, "BBB", 4) != 0)
+        return false;
+    if (file.get() != RECORDER_MAJOR_VERSION || file.get() != RECORDER_MINOR_VERSION)
+        return false;
+
+    rows = file.get();
+    columns = file.get();
+    type = (PanelTable::Type) file.get();
+    difficulty = file.get();
+    level = file.get();
+
+    initial.resize(rows * columns);
+    for (auto& panel : initial)
+        panel = (Panel::Type) file.get();
+    return (bool) file;
+}
+
+bool Recorder::load(std::istream& file)
+{
+    if (!load_header(file))
+        return false;
+
+    unsigned int size = 0;
+    // A damaged file must not ask for more memory than a game can record.
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file || size > MAX_RECORDED)
+        return false;
+    next.resize(size);
+    for (auto& panel : next)
+        panel = (Panel::Type) file.get();
+
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file || size > MAX_RECORDED)
+        return false;
+    input.resize(size);
+    for (auto& move : input)
+        file.read(reinterpret_cast<char*>(&move), sizeof(move));
+
+    return (bool) file;
+}
+
+size_t Recorder::append_size() const
+{
+    const size_t header = appended_mark.header ? 0 : header_size + initial.size();
+    // The last input appended is written again for the frames it went on for.
+    const size_t inputs = input.size() - appended_mark.input + (appended_mark.input > 0 && input[appended_mark.input - 1].frames > appended_mark.frames);
+    // Nothing is appended when nothing was recorded since the last time.
+    if (appended_mark.header && next.size() == appended_mark.next && inputs == 0)
+        return 0;
+    return header + sizeof(unsigned int) + next.size() - appended_mark.next + sizeof(unsigned int) + inputs * sizeof(Input);
+}
+
+size_t Recorder::append_part(std::ostream& file, size_t offset, size_t max_bytes) const
+{
+    const size_t size = append_size();
+    if (size == 0)
+        return 0;
+    SaveWindow window(file, offset, std::min(max_bytes, size - std::min(offset, size)));
+    if (!appended_mark.header)
+    {
+        const char header[header_size] = {'B', 'B', 'B', 0, RECORDER_MAJOR_VERSION, RECORDER_MINOR_VERSION,
+            (char) rows, (char) columns, (char) type, (char) difficulty, (char) level};
+        window.write(header, sizeof(header));
+        window.put(initial);
+    }
+
+    unsigned int count = next.size() - appended_mark.next;
+    window.write(&count, sizeof(count));
+    size_t begin, end;
+    if (window.take(count, begin, end))
+    {
+        for (size_t k = begin; k < end; k++)
+            file.put(next[appended_mark.next + k]);
+    }
+
+    Input last;
+    const bool went_on = appended_mark.input > 0 && input[appended_mark.input - 1].frames > appended_mark.frames;
+    if (went_on)
+    {
+        last = input[appended_mark.input - 1];
+        last.frames -= appended_mark.frames;
+    }
+    count = input.size() - appended_mark.input + went_on;
+    window.write(&count, sizeof(count));
+    if (went_on)
+        window.write(&last, sizeof(last));
+    window.write(input.data() + appended_mark.input, (input.size() - appended_mark.input) * sizeof(Input));
+
+    return window.written;
+}
+
+Recorder::AppendMark Recorder::mark() const
+{
+    AppendMark mark;
+    mark.header = true;
+    mark.next = next.size();
+    mark.input = input.size();
+    mark.frames = input.empty() ? 0 : input.back().frames;
+    return mark;
+}
+
+void Recorder::appended(const AppendMark& mark)
+{
+    appended_mark = mark;
+}
+
+bool Recorder::load_appended(std::istream& file, size_t size)
+{
+    size_t read = 0;
+    if (!appended_mark.header)
+    {
+        if (size < header_size || !load_header(file))
+            return false;
+        read += header_size + initial.size();
+        next.clear();
+        input.clear();
+    }
+
+    while (read < size)
+    {
+        // A damaged file must not ask for more memory than a game can record.
+        unsigned int count = 0;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || count > MAX_RECORDED - std::min<size_t>(next.size(), MAX_RECORDED))
+            return false;
+        for (unsigned int k = 0; k < count; k++)
+            next.push_back((Panel::Type) file.get());
+        read += sizeof(count) + count;
+
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || count > MAX_RECORDED - std::min<size_t>(input.size(), MAX_RECORDED))
+            return false;
+        for (unsigned int k = 0; k < count; k++)
+        {
+            Input move;
+            file.read(reinterpret_cast<char*>(&move), sizeof(move));
+            // Entries split by an append are put back together.
+            if (!input.empty() && input.back().trigger == move.trigger && input.back().held == move.held)
+                input.back().frames += move.frames;
+            else
+                input.push_back(move);
+        }
+        read += sizeof(count) + count * sizeof(Input);
+        if (!file)
+            return false;
+    }
+
+    appended_mark = mark();
+    return read == size;
 }
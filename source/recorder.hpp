@@ -9,6 +9,8 @@
 
 #define RECORDER_MAJOR_VERSION 0
 #define RECORDER_MINOR_VERSION 2
+/// Most next panels or input entries load accepts.
+#define MAX_RECORDED (1 << 24)
 
 /**
  * This class records all relevant inputs to a game.
@@ -21,7 +23,37 @@ public:
     /// Saves this recorders state to file.
     bool save();
     /// Test only, saves recorder state to stream.
-    bool save(std::ostream& file);
+    bool save(std::ostream& file) const;
+    /// Number of bytes save writes.
+    size_t save_size() const;
+    /// Writes up to max_bytes of what save writes starting offset bytes in, so a long recording can be saved a piece at a time. Returns the bytes written.
+    size_t save_part(std::ostream& file, size_t offset, size_t max_bytes) const;
+    /// Restores the state written by save.
+    bool load(std::istream& file);
+
+    /** How much of the recording was appended to a file that grows as the game goes on, a suspended game's session recording.
+      * The file starts with the header and initial board save writes and has a block for each append after that. */
+    struct AppendMark
+    {
+        /// The header and initial board were appended.
+        bool header = false;
+        /// Next panels appended
+        size_t next = 0;
+        /// Input entries appended, the last one may have gone on for more frames since
+        size_t input = 0;
+        /// Frames of the last input entry appended
+        unsigned int frames = 0;
+    };
+    /// Number of bytes append_part writes, what was recorded since the last call to appended.
+    size_t append_size() const;
+    /// Writes up to max_bytes of what append_size counts starting offset bytes in, so it can be appended a piece at a time. Returns the bytes written.
+    size_t append_part(std::ostream& file, size_t offset, size_t max_bytes) const;
+    /// Everything recorded so far, passed to appended once append_part wrote all of it.
+    AppendMark mark() const;
+    /// Sets how much was appended, the next append_part starts after it. A recorder resuming a game starts with only the header appended.
+    void appended(const AppendMark& mark);
+    /// Reads size bytes appended to file, adding them to what this recorder holds as if it had recorded them. Everything is then appended.
+    bool load_appended(std::istream& file, size_t size);
     /**
      * @brief settings
      * Sets the game settings for replay.
@@ -67,7 +99,10 @@ private:
     std::vector<Panel::Type> initial;
     std::vector<Panel::Type> next;
     std::vector<Input> input;
+    AppendMark appended_mark;
 
+    /// Reads the header and initial board save writes.
+    bool load_header(std::istream& file);
 };
 
 #endif
@@ -29,6 +29,9 @@ public:
         if (index >= next.size()) return Panel::EMPTY;
         return next[index++];
     }
+protected:
+    void save_generator(PanelSourceSnapshot& snapshot) const override {snapshot.sequence = index;}
+    void load_generator(const PanelSourceSnapshot& snapshot) override {index = snapshot.sequence;}
 private:
     std::vector<Panel::Type> initial;
     std::vector<Panel::Type> next;
@@ -31,6 +31,23 @@ void EndlessScene::init_menu()
     info.set_difficulty(config.difficulty);
 }
 
+bool EndlessScene::capture(SessionImage& image) const
+{
+    image.mode = SessionImage::ENDLESS;
+    return capture_game(image);
+}
+
+bool EndlessScene::restore(const SessionImage& image)
+{
+    if (!GameScene::restore(image))
+        return false;
+    info.set_score(score);
+    info.set_level(level);
+    info.set_next(get_panels_for_level(level) - next, get_panels_for_level(level));
+    info.set_timeout(table->get_timeout());
+    return true;
+}
+
 void EndlessScene::update_windows()
 {
     GameScene::update_windows();
@@ -20,6 +20,9 @@ protected:
     void update_windows();
     void update_gameover();
 
+    bool capture(SessionImage& image) const override;
+    bool restore(const SessionImage& image) override;
+
     void draw_game_top();
     void draw_gameover_top();
 private:
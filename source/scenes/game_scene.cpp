@@ -12,13 +12,20 @@
 
 void GameScene::initialize()
 {
-    srand((unsigned int) time(NULL));
-
     init_panel_table();
     init_recorder();
     init_sprites();
     init_menu();
     scene_music = get_track("Demo.brstm");
+
+    if (resume)
+    {
+        // A session that can't be loaded is deleted and the scene plays the new game it was set up with.
+        suspended = restore(*resume);
+        if (!suspended)
+            session_writer.discard();
+        resume.reset();
+    }
 }
 
 void GameScene::init_panel_table()
@@ -27,18 +34,19 @@ void GameScene::init_panel_table()
     opts.rows = config.rows;
     opts.columns = config.columns;
     opts.type = config.type;
+    seed = config.seed ? config.seed : (uint32_t) time(NULL);
     switch (config.difficulty)
     {
         case EASY:
-            opts.source = new RandomPanelSource(opts.rows, opts.columns, 5);
+            opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
             opts.settings = easy_speed_settings;
             break;
         case NORMAL:
-            opts.source = new RandomPanelSource(opts.rows, opts.columns, 6);
+            opts.source = new RandomPanelSource(opts.rows, opts.columns, 6, seed);
             opts.settings = normal_speed_settings;
             break;
         case HARD:
-            opts.source = new RandomPanelSource(opts.rows, opts.columns, 6);
+            opts.source = new RandomPanelSource(opts.rows, opts.columns, 6, seed);
             opts.settings = hard_speed_settings;
             break;
     }
@@ -105,6 +113,17 @@ void GameScene::update()
 {
     Scene2D::update();
 
+    // Once a save is written the next one only appends what was recorded after it.
+    if (saving && !session_writer.busy())
+    {
+        if (!session_writer.failed())
+        {
+            recorder.appended(saving_mark);
+            recording_size = saving_size;
+        }
+        saving = false;
+    }
+
     if (!gameover_state)
     {
         update_input();
@@ -115,6 +134,12 @@ void GameScene::update()
         if (is_gameover())
         {
             gameover_state = true;
+            if (suspended)
+            {
+                // The replay is the session recording followed by what was recorded since.
+                load_session_recording(SESSION_FILENAME, seed, recording_size, recorder);
+                session_writer.discard();
+            }
             update_on_gameover();
         }
     }
@@ -134,6 +159,72 @@ bool GameScene::is_gameover() const
     return table->is_gameover();
 }
 
+void GameScene::suspend()
+{
+    save_session(false);
+}
+
+void GameScene::save_session(bool leaving)
+{
+    SessionImage image;
+    if (gameover_state || !capture(image))
+        return;
+
+    // Only what was recorded since the last save is appended to the session recording.
+    // A game being left hands its recorder over, otherwise it keeps recording and on suspend no frames run until the copy is written.
+    image.recording_size = recording_size;
+    saving_mark = recorder.mark();
+    saving_size = recording_size + recorder.append_size();
+    if (leaving)
+        session_writer.begin(std::move(image), std::move(recorder));
+    else
+        session_writer.begin(std::move(image), Recorder(recorder));
+    saving = true;
+    suspended = true;
+}
+
+bool GameScene::capture_game(SessionImage& image) const
+{
+    image.rows = config.rows;
+    image.columns = config.columns;
+    image.type = config.type;
+    image.difficulty = config.difficulty;
+    image.start_level = config.level;
+    image.time_mode = config.time_mode;
+    image.value = config.value;
+    image.panel_gfx = config.panel_gfx;
+    image.seed = seed;
+
+    image.score = score;
+    image.level = level;
+    image.next = next;
+    image.selector_x = selector_x;
+    image.selector_y = selector_y;
+    image.frame = frame;
+    return table->save_state(image.table);
+}
+
+bool GameScene::restore(const SessionImage& image)
+{
+    // Loaded before anything is restored so a session that fails leaves the new game as it was.
+    if (!table->load_state(image.table))
+        return false;
+
+    score = image.score;
+    level = image.level;
+    next = image.next;
+    selector_x = image.selector_x;
+    selector_y = image.selector_y;
+    frame = image.frame;
+    // The game so far is in the session recording, the recorder goes on after it with the header already there.
+    Recorder::AppendMark header;
+    header.header = true;
+    recorder = Recorder();
+    recorder.appended(header);
+    recording_size = image.recording_size;
+    return true;
+}
+
 void GameScene::update_input()
 {
     int mx = 0, my = 0;
@@ -156,7 +247,11 @@ void GameScene::update_input()
         table->swap(selector_y, selector_x);
 
     if (input.trigger(KEY_START))
+    {
+        // Quitting keeps the game so it can be resumed from the mode select.
+        save_session(true);
         current_scene = new ModeSelectScene();
+    }
 
     if (input.trigger(KEY_X))
         debug_drawing = !debug_drawing;
@@ -187,14 +282,32 @@ void GameScene::update_match()
         update_on_timeout();
     }
 
+    // Lines are generated ahead on frames that don't take one.
+    if (!next_generated)
+        table->fill_lines();
+
     frames.update(table->get_state(), danger_panel);
     markers.update();
 }
 
 void GameScene::update_create_markers()
 {
-    int x = current_match.x * PANEL_SIZE;
-    int y = current_match.y * PANEL_SIZE;
+    // Markers go over the top left panel of the match, or of the groups continuing the chain.
+    const MatchGroups& groups = table->get_match_groups();
+    const Point* top_left = nullptr;
+    for (const auto& group : groups.groups)
+    {
+        const Point& first = groups.cells[group.first];
+        if (current_match.is_chain() && !group.chain)
+            continue;
+        if (!top_left || first.y < top_left->y || (first.y == top_left->y && first.x < top_left->x))
+            top_left = &first;
+    }
+    if (!top_left)
+        return;
+
+    int x = top_left->x * PANEL_SIZE;
+    int y = top_left->y * PANEL_SIZE;
     if (current_match.is_combo())
         markers.add(x, y, Marker::COMBO, current_match.combo);
     if (current_match.is_chain())
@@ -284,14 +397,12 @@ void GameScene::draw_panels()
     if (table->is_puzzle() || table->is_clogged() || table->is_gameover() || table->is_rised())
         offset = panel_size;
 
-    std::vector<bool> column_danger = table->danger_columns();
-
     for (int i = 0; i < table->height(); i++)
     {
         for (int j = 0; j < table->width(); j++)
         {
             const Panel& panel = table->get(i, j);
-            int status = get_panel_frame(panel, frames.panel, danger_panel, column_danger[j], is_gameover());
+            int status = get_panel_frame(panel, frames.panel, danger_panel, table->danger_column(j), is_gameover());
             if (panel.get_value() == Panel::EMPTY || status == -1) continue;
 
             int x = startx + j * panel_size;
@@ -309,7 +420,7 @@ void GameScene::draw_panels()
     {
         const int i = table->height();
         const Panel& panel = next[j];
-        int status = get_panel_frame(panel, frames.panel, danger_panel, column_danger[j], is_gameover());
+        int status = get_panel_frame(panel, frames.panel, danger_panel, table->danger_column(j), is_gameover());
 
         int x = j * panel_size + startx;
         int y = (i + 1) * panel_size - offset + starty;
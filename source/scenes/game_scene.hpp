@@ -16,6 +16,7 @@
 #include "animation_params.hpp"
 #include "marker_manager.hpp"
 #include "recorder.hpp"
+#include "session.hpp"
 
 enum Difficulty
 {
@@ -66,6 +67,8 @@ public:
         Difficulty difficulty = EASY;
         int level = 1;
         std::string panel_gfx = "";
+        /// Seed the panels are generated from, 0 picks one from the clock.
+        uint32_t seed = 0;
     };
 
     GameScene(const GameConfig& c) : config(c), batch(200), level(c.level) {}
@@ -73,7 +76,11 @@ public:
 
     void initialize();
     void update();
+    /// Saves the game in progress so it can be resumed.
+    void suspend() override;
     std::string music() {return scene_music;}
+    /// Continues the game in image instead of starting a new one, called before initialize.
+    void resume_from(const SessionImage& image) {resume.reset(new SessionImage(image));}
 protected:
     void draw_top();
     void draw_bottom();
@@ -85,6 +92,15 @@ protected:
 
     virtual bool is_gameover() const;
 
+    /// Starts saving the game in progress, leaving takes the recording from the scene instead of copying it.
+    void save_session(bool leaving);
+    /// Fills image with the game in progress except for the recording size. Returns false for modes that can't be resumed.
+    virtual bool capture(SessionImage& image) const {return false;}
+    /// Fills the parts of image every mode has, for capture. Returns false if the table can't be saved.
+    bool capture_game(SessionImage& image) const;
+    /// Puts the game back the way image has it once the scene is initialized. Returns false leaving the new game as it was if image can't be loaded.
+    virtual bool restore(const SessionImage& image);
+
     void update_recorder();
     virtual void update_windows() {}
     virtual void update_on_gameover() {}
@@ -130,6 +146,8 @@ protected:
 
     // Core game stuff
     std::unique_ptr<PanelTable> table;
+    /// Seed the table's panels are generated from, config.seed or the one picked from the clock.
+    uint32_t seed = 0;
     MatchInfo current_match;
     int selector_x = 2;
     int selector_y = 6;
@@ -148,6 +166,17 @@ protected:
     bool debug_drawing = false;
     bool next_generated = false;
 
+    // Suspend and resume
+    std::unique_ptr<SessionImage> resume;
+    /// The saved session belongs to this game so it is deleted once the game is over.
+    bool suspended = false;
+    /// Bytes of the session recording the saved session goes with
+    size_t recording_size = 0;
+    /// A save is in progress, once written the recorder was appended up to saving_mark and the recording is saving_size bytes.
+    bool saving = false;
+    Recorder::AppendMark saving_mark;
+    size_t saving_size = 0;
+
     // Nice things
     Background background_top;
     Background background_bottom;
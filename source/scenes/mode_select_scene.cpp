@@ -5,6 +5,8 @@
 #include "score_config_scene.hpp"
 #include "puzzle_select_scene.hpp"
 #include "options_scene.hpp"
+#include "endless_scene.hpp"
+#include "score_scene.hpp"
 
 const std::string menu_background = "romfs:/graphics/menu/menu_background.png";
 
@@ -20,6 +22,31 @@ const char* help_text[MODES_SIZE] =
     "Change game options\nhere!"
 };
 
+const char* resume_help_text = "\n\nPress Y to resume\nyour last game.";
+
+/// Scene continuing the game saved in image. If the table in image can't be loaded the scene deletes the session and starts a new game with its settings.
+static Scene* create_resumed_scene(const SessionImage& image)
+{
+    GameScene::GameConfig config;
+    config.rows = image.rows;
+    config.columns = image.columns;
+    config.type = image.type;
+    config.difficulty = (Difficulty) image.difficulty;
+    config.level = image.start_level;
+    config.time_mode = (TimingMode) image.time_mode;
+    config.value = image.value;
+    config.panel_gfx = image.panel_gfx;
+    config.seed = image.seed;
+
+    GameScene* scene;
+    if (image.mode == SessionImage::SCORE)
+        scene = new ScoreScene(config);
+    else
+        scene = new EndlessScene(config);
+    scene->resume_from(image);
+    return scene;
+}
+
 void ModeSelectScene::initialize()
 {
     command_window.create(0, 0,  7 * 16, 16, 1, {"Endless", "Score", "Puzzle", "Mission", "Versus", "Online", "Options"});
@@ -47,11 +74,19 @@ void ModeSelectScene::update()
     menu_background_bottom.update();
 
 
+    // A save started when the last game was quit is written over the next frames.
+    bool loaded = false;
+    if (!session_loaded && !session_writer.busy())
+    {
+        has_session = load_session(SESSION_FILENAME, session);
+        session_loaded = loaded = true;
+    }
+
     /// TODO implement events so hacks like this aren't necessary
-    if (mode != command_window.selection())
+    if (mode != command_window.selection() || loaded)
     {
         mode = command_window.selection();
-        help_window.set_text(help_text[mode]);
+        help_window.set_text(std::string(help_text[mode]) + (has_session && mode <= SCORE ? resume_help_text : ""));
     }
 
     if (input.trigger(KEY_A))
@@ -74,6 +109,8 @@ void ModeSelectScene::update()
                 break;
         }
     }
+    else if (input.trigger(KEY_Y) && has_session)
+        current_scene = create_resumed_scene(session);
     else if (input.trigger(KEY_B))
         current_scene = new TitleScene();
 }
@@ -2,6 +2,7 @@
 #define MODE_SELECT_SCENE_HPP
 
 #include "scene.hpp"
+#include "session.hpp"
 #include <util/background.hpp>
 #include <util/command_window.hpp>
 #include <util/texture.hpp>
@@ -34,7 +35,11 @@ private:
     Background menu_background_top;
     Background menu_background_bottom;
     int mode = 0;
-
+    /// Game left with HOME, sleep or quit, resumed with Y
+    SessionImage session;
+    bool has_session = false;
+    /// Loaded once a save started by quitting a game is written
+    bool session_loaded = false;
 };
 
 #endif
@@ -11,18 +11,27 @@
 
 PuzzleSnapshot::PuzzleSnapshot(const PanelTable& table)
 {
+    saved = table.save_state(state);
+    moves = table.get_moves();
+    if (saved)
+        return;
+
     const auto& table_panels = table.get_panels();
     panels.resize(table_panels.size());
     for (unsigned int i = 0; i < panels.size(); i++)
-        panels[i] = (Panel::Type) table_panels[i].get_value();
-    moves = table.get_moves();
+        panels[i] = table_panels[i].get_value();
 }
 
 void PuzzleSnapshot::restore(PanelTable& table) const
 {
-    auto& table_panels = table.get_panels();
+    if (saved)
+    {
+        table.load_state(state);
+        return;
+    }
+
     for (unsigned int i = 0; i < panels.size(); i++)
-        table_panels[i].set_value(panels[i]);
+        table.get(i / table.width(), i % table.width()).set_value(panels[i]);
     table.set_moves(moves);
 }
 
@@ -42,7 +51,6 @@ void PuzzleScene::init_panel_table()
     }
 
     table.reset(new PanelTable(opts));
-
     snapshots.push_back(PuzzleSnapshot(*table));
 }
 
@@ -8,14 +8,19 @@
 #include <windows/puzzle_status_window.hpp>
 #include <util/background.hpp>
 
+/** Board saved for undo, taken while every panel is idle. */
 class PuzzleSnapshot
 {
 public:
     PuzzleSnapshot(const PanelTable& table);
     void restore(PanelTable& table) const;
 private:
-    int moves;
+    PanelTableSnapshot state;
+    /// Could the table be saved in state
+    bool saved;
+    /// A board bigger than a snapshot holds keeps its panel types and moves instead, which is all that changes while every panel is idle.
     std::vector<Panel::Type> panels;
+    int moves;
 };
 
 class PuzzleScene : public GameScene
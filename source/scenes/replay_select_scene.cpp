@@ -2,27 +2,12 @@
 #include "replay_scene.hpp"
 #include "title_scene.hpp"
 
-extern "C"
-{
-#include <dirent.h>
-}
+#include <util/file_helper.hpp>
 
 std::vector<std::string> get_replays()
 {
-    std::vector<std::string> files;
-    struct dirent* dir;
-    DIR* d = opendir("/bbb-moves");
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            files.push_back(dir->d_name);
-        }
-        closedir(d);
-    }
-
-    std::sort(files.begin(), files.end());
-    return files;
+    // Only the replays, a suspended game's session is saved in the same directory.
+    return dir_filenames("/bbb-moves", "bbb", true, true);
 }
 
 void ReplaySelectScene::initialize()
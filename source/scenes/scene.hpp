@@ -24,6 +24,10 @@ public:
     virtual void initialize() {}
     virtual void update() {input.update();}
     virtual void draw() {}
+    /// Called before the app is suspended with HOME, put to sleep or closed.
+    virtual void suspend() {}
+    /// Called when the app comes back from HOME or sleep.
+    virtual void wake() {}
     virtual std::string music() {return get_track("Select.brstm");}
 protected:
     InputSource input;
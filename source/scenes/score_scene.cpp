@@ -63,6 +63,29 @@ bool ScoreScene::is_gameover() const
     return base_game_over || table->is_gameover();
 }
 
+bool ScoreScene::capture(SessionImage& image) const
+{
+    image.mode = SessionImage::SCORE;
+    image.time = time;
+    return capture_game(image);
+}
+
+bool ScoreScene::restore(const SessionImage& image)
+{
+    if (!GameScene::restore(image))
+        return false;
+    time = image.time;
+    // The info window shows the restored game before the first frame updates it.
+    update_info();
+    return true;
+}
+
+void ScoreScene::wake()
+{
+    // Time spent in HOME or asleep doesn't count.
+    last_frame = osGetTime();
+}
+
 void ScoreScene::update()
 {
     time -= (int)(osGetTime() - last_frame);
@@ -73,6 +96,12 @@ void ScoreScene::update()
 void ScoreScene::update_windows()
 {
     GameScene::update_windows();
+    update_info();
+    info.update();
+}
+
+void ScoreScene::update_info()
+{
     if (config.time_mode == TIME)
         info.set_value(time);
     else if (config.time_mode == LINES)
@@ -81,7 +110,6 @@ void ScoreScene::update_windows()
         info.set_value(table->get_moves());
 
     info.set_score(score);
-    info.update();
 }
 
 void ScoreScene::update_on_gameover()
@@ -11,6 +11,7 @@ public:
     ScoreScene(const GameConfig& c) : GameScene(c) {}
     void initialize() override;
     void update() override;
+    void wake() override;
 
 protected:
     void init_menu() override;
@@ -18,6 +19,9 @@ protected:
 
     bool is_gameover() const override;
 
+    bool capture(SessionImage& image) const override;
+    bool restore(const SessionImage& image) override;
+
     void update_windows() override;
     void update_gameover() override;
     void update_on_gameover() override;
@@ -27,6 +31,9 @@ protected:
     void draw_gameover_top() override;
 
 private:
+    /// Shows the score and the time, lines or moves left.
+    void update_info();
+
     ScoreInfoWindow info;
     Text game_over;
     CommandWindow try_again_command;
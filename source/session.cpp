@@ -0,0 +1,343 @@
+#include "session.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+static const char session_magic[4] = {'B', 'B', 'S', 0};
+
+static void put(std::string& bytes, int32_t value)
+{
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put(std::string& bytes, const std::string& value)
+{
+    put(bytes, (int32_t) value.size());
+    bytes.append(value);
+}
+
+/** Reads the fields back in the order they were put, failing once the bytes run out. */
+struct SessionReader
+{
+    explicit SessionReader(const std::string& b) : bytes(b) {}
+
+    int32_t get()
+    {
+        int32_t value = 0;
+        if (!read(&value, sizeof(value)))
+            return 0;
+        return value;
+    }
+
+    bool get(std::string& value)
+    {
+        const int32_t size = get();
+        if (!ok || size < 0 || (size_t) size > bytes.size() - offset)
+            return ok = false;
+        value.assign(bytes, offset, size);
+        offset += size;
+        return true;
+    }
+
+    bool read(void* out, size_t size)
+    {
+        if (!ok || size > bytes.size() - offset)
+            return ok = false;
+        memcpy(out, bytes.data() + offset, size);
+        offset += size;
+        return true;
+    }
+
+    const std::string& bytes;
+    size_t offset = 0;
+    bool ok = true;
+};
+
+void write_session(const SessionImage& image, std::string& bytes)
+{
+    bytes.clear();
+    bytes.append(session_magic, sizeof(session_magic));
+    put(bytes, SESSION_VERSION);
+    // The size of the whole session is filled in once the rest is written.
+    put(bytes, (int32_t) 0);
+
+    put(bytes, image.mode);
+    put(bytes, image.rows);
+    put(bytes, image.columns);
+    put(bytes, image.type);
+    put(bytes, image.difficulty);
+    put(bytes, image.start_level);
+    put(bytes, image.time_mode);
+    put(bytes, image.value);
+    put(bytes, image.panel_gfx);
+    put(bytes, (int32_t) image.seed);
+
+    put(bytes, image.score);
+    put(bytes, image.level);
+    put(bytes, image.next);
+    put(bytes, image.selector_x);
+    put(bytes, image.selector_y);
+    put(bytes, image.frame);
+    put(bytes, image.time);
+
+    // The snapshot is trivially copyable, its size guards against a session saved by a build with a different layout.
+    put(bytes, (int32_t) sizeof(image.table));
+    bytes.append(reinterpret_cast<const char*>(&image.table), sizeof(image.table));
+    put(bytes, (int32_t) image.recording_size);
+
+    const int32_t size = (int32_t) std::min<size_t>(bytes.size(), INT32_MAX);
+    memcpy(&bytes[sizeof(session_magic) + sizeof(int32_t)], &size, sizeof(size));
+}
+
+/// Checks the header of a session of size bytes. Returns false if it is not a session of this version that is size bytes long.
+static bool check_header(const char* header, size_t size)
+{
+    int32_t version;
+    int32_t session_size;
+    memcpy(&version, header + sizeof(session_magic), sizeof(version));
+    memcpy(&session_size, header + sizeof(session_magic) + sizeof(version), sizeof(session_size));
+    return memcmp(header, session_magic, sizeof(session_magic)) == 0 && version == SESSION_VERSION &&
+           session_size >= 0 && (size_t) session_size == size && size <= SESSION_MAX_SIZE;
+}
+
+bool read_session(const std::string& bytes, SessionImage& image)
+{
+    if (bytes.size() < SESSION_HEADER_SIZE || !check_header(bytes.data(), bytes.size()))
+        return false;
+    SessionReader reader(bytes);
+    reader.offset = SESSION_HEADER_SIZE;
+
+    image.mode = (SessionImage::Mode) reader.get();
+    image.rows = reader.get();
+    image.columns = reader.get();
+    image.type = (PanelTable::Type) reader.get();
+    image.difficulty = reader.get();
+    image.start_level = reader.get();
+    image.time_mode = reader.get();
+    image.value = reader.get();
+    reader.get(image.panel_gfx);
+    image.seed = (uint32_t) reader.get();
+
+    image.score = reader.get();
+    image.level = reader.get();
+    image.next = reader.get();
+    image.selector_x = reader.get();
+    image.selector_y = reader.get();
+    image.frame = reader.get();
+    image.time = reader.get();
+
+    if (reader.get() != (int32_t) sizeof(image.table))
+        return false;
+    reader.read(&image.table, sizeof(image.table));
+    image.recording_size = (uint32_t) reader.get();
+
+    return reader.ok && reader.offset == bytes.size() && image.rows == image.table.rows && image.columns == image.table.columns &&
+           image.seed == image.table.source.seed;
+}
+
+/// Opens filename and checks its header against its length, leaving the file at the start. Returns the size of the session or 0 if it is not a complete one.
+static size_t open_session_file(const std::string& filename, std::ifstream& file)
+{
+    file.open(filename.c_str(), std::ios::binary);
+    if (!file)
+        return 0;
+
+    file.seekg(0, std::ios::end);
+    const std::streamoff size = file.tellg();
+    if (size < SESSION_HEADER_SIZE)
+        return 0;
+    file.seekg(0, std::ios::beg);
+
+    char header[SESSION_HEADER_SIZE];
+    file.read(header, sizeof(header));
+    if (!file || !check_header(header, size))
+        return 0;
+    file.seekg(0, std::ios::beg);
+    return size;
+}
+
+/// Size of the file at filename, 0 if it can't be opened.
+static size_t file_size(const std::string& filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+    return file ? (size_t) std::max<std::streamoff>(file.tellg(), 0) : 0;
+}
+
+std::string session_recording_path(const std::string& filename, uint32_t seed)
+{
+    char name[16];
+    std::snprintf(name, sizeof(name), ".%08lx", (unsigned long) seed);
+    return filename + name + SESSION_RECORDING_SUFFIX;
+}
+
+static bool load_session_file(const std::string& filename, const std::string& session_filename, SessionImage& image)
+{
+    // The header says how long the session is, so a file cut short or too big is refused before it is read.
+    std::ifstream file;
+    const size_t size = open_session_file(filename, file);
+    if (size == 0)
+        return false;
+
+    std::string bytes(size, '\0');
+    file.read(&bytes[0], size);
+    // Saves append to the recording before the image is written, so it is at least as long as the image says.
+    return file && read_session(bytes, image) && image.recording_size <= SESSION_MAX_RECORDING_SIZE &&
+           file_size(session_recording_path(session_filename, image.seed)) >= image.recording_size;
+}
+
+bool load_session(const std::string& filename, SessionImage& image)
+{
+    // A save interrupted between removing the old session and renaming the new one left it complete under the temporary name.
+    return load_session_file(filename, filename, image) || load_session_file(filename + ".tmp", filename, image);
+}
+
+bool load_session_recording(const std::string& filename, uint32_t seed, size_t size, Recorder& recorder)
+{
+    std::ifstream file(session_recording_path(filename, seed).c_str(), std::ios::binary);
+    Recorder whole;
+    if (!file || size > SESSION_MAX_RECORDING_SIZE || !whole.load_appended(file, size))
+        return false;
+
+    std::stringstream since;
+    const size_t since_size = recorder.append_size();
+    recorder.append_part(since, 0, since_size);
+    if (!whole.load_appended(since, since_size))
+        return false;
+
+    recorder = std::move(whole);
+    return true;
+}
+
+void remove_session(const std::string& filename)
+{
+    SessionImage image;
+    if (load_session(filename, image))
+        std::remove(session_recording_path(filename, image.seed).c_str());
+    std::remove(filename.c_str());
+    std::remove((filename + ".tmp").c_str());
+}
+
+void SessionWriter::begin(SessionImage&& image, Recorder&& game_recording)
+{
+    if (file.is_open())
+        file.close();
+    if (recording_file.is_open())
+        recording_file.close();
+    recording_file.clear();
+
+    // A save interrupted between removing the old session and renaming the new one left the only session in the temporary file.
+    // Its rename is finished first so the temporary file can be reused. Only its header is read to see that it is complete.
+    std::ifstream temp;
+    if (!std::ifstream(path.c_str()) && open_session_file(temp_path, temp))
+    {
+        temp.close();
+        std::rename(temp_path.c_str(), path.c_str());
+    }
+
+    // The old session needs the recording up to where it was saved, the new part goes after it. A new game starts a recording of
+    // its own, the one of the session it replaces is deleted once the new session is in place.
+    const size_t offset = image.recording_size;
+    recording_path = session_recording_path(path, image.seed);
+    replaced_recording.clear();
+    SessionImage replaced;
+    const bool replacing = offset == 0 && load_session(path, replaced);
+    new_recording = offset == 0 && !(replacing && replaced.seed == image.seed);
+    if (replacing && replaced.seed != image.seed)
+        replaced_recording = session_recording_path(path, replaced.seed);
+    appended = game_recording.append_size();
+    written = 0;
+    if (offset + appended > SESSION_MAX_RECORDING_SIZE || (offset > 0 && file_size(recording_path) < offset))
+    {
+        bytes.clear();
+        recording = Recorder();
+        error = true;
+        return;
+    }
+    image.recording_size = offset + appended;
+    write_session(image, bytes);
+    recording = std::move(game_recording);
+    size = appended + bytes.size();
+
+    if (appended > 0)
+    {
+        recording_file.open(recording_path.c_str(), offset == 0 ? std::ios::out | std::ios::binary | std::ios::trunc :
+                                                                   std::ios::in | std::ios::out | std::ios::binary);
+        recording_file.seekp(offset);
+    }
+    file.open(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+    error = !file || !recording_file;
+    if (error)
+        discard_save();
+}
+
+bool SessionWriter::step(size_t max_bytes)
+{
+    if (!file.is_open())
+        return true;
+
+    size_t left = std::min(max_bytes, size - written);
+    if (written < appended)
+    {
+        const size_t part = recording.append_part(recording_file, written, left);
+        written += part;
+        left -= part;
+        // Closed before any of the image is written so the recording is on the card before the image that points past it.
+        if (written == appended)
+            recording_file.close();
+    }
+    if (left > 0)
+    {
+        file.write(bytes.data() + written - appended, left);
+        written += left;
+    }
+    if (!file || !recording_file)
+    {
+        error = true;
+        discard_save();
+        return true;
+    }
+    if (written < size)
+        return false;
+
+    file.close();
+    // The SD card can't rename over a file. Until the rename a resume finds the complete temporary file.
+    std::remove(path.c_str());
+    error = !file || std::rename(temp_path.c_str(), path.c_str()) != 0;
+    if (!error && !replaced_recording.empty())
+        std::remove(replaced_recording.c_str());
+    new_recording = false;
+    bytes.clear();
+    recording = Recorder();
+    return true;
+}
+
+bool SessionWriter::finish()
+{
+    step(size);
+    return !error;
+}
+
+void SessionWriter::discard()
+{
+    discard_save();
+    error = false;
+    remove_session(path);
+}
+
+void SessionWriter::discard_save()
+{
+    if (file.is_open())
+    {
+        file.close();
+        std::remove(temp_path.c_str());
+    }
+    if (recording_file.is_open())
+        recording_file.close();
+    // A new game's recording belongs to no session until its save is complete.
+    if (new_recording)
+        std::remove(recording_path.c_str());
+    new_recording = false;
+    bytes.clear();
+    recording = Recorder();
+}
@@ -0,0 +1,141 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include "panel_table.hpp"
+#include "recorder.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#define SESSION_VERSION 4
+/// Where the game left with HOME, sleep or quit is kept until it is resumed, with the replays.
+#define SESSION_FILENAME "/bbb-moves/session.bin"
+/// Ends the name of the recording of the game saved with a session, see session_recording_path.
+#define SESSION_RECORDING_SUFFIX ".moves"
+/// Bytes SessionWriter::step writes per frame.
+#define SESSION_CHUNK_SIZE 4096
+/// Largest session loaded, the fields and the table snapshot. Loading reads the whole file at once so it is bounded.
+#define SESSION_MAX_SIZE (64 << 10)
+/// Largest session recording saved, hours of recorded input.
+#define SESSION_MAX_RECORDING_SIZE (16 << 20)
+/// Bytes of a session before its fields, the magic, the version and the size of the whole session.
+#define SESSION_HEADER_SIZE 12
+
+/**
+ * Everything needed to put an endless or score game back the way it was left.
+ * Resuming loads this instead of replaying the recording from the first frame.
+ */
+struct SessionImage
+{
+    enum Mode
+    {
+        ENDLESS = 0,
+        SCORE = 1,
+    };
+    Mode mode = ENDLESS;
+
+    // Game config
+    int rows = 0;
+    int columns = 0;
+    PanelTable::Type type = PanelTable::Type::ENDLESS;
+    int difficulty = 0;
+    /// Level the game was started at
+    int start_level = 1;
+    /// Score mode only
+    int time_mode = 0;
+    int value = 0;
+    std::string panel_gfx;
+    /// Seed the panels are generated from
+    uint32_t seed = 0;
+
+    // Game scene
+    int score = 0;
+    int level = 1;
+    /// Panels left to clear before the next level
+    int next = 0;
+    int selector_x = 0;
+    int selector_y = 0;
+    int frame = 0;
+    /// Milliseconds left in a timed score game
+    int time = 0;
+
+    /// The table with its panel source, whose generators and queued lines go on where they were left.
+    PanelTableSnapshot table;
+    /** Bytes of the session recording that go with this image, the game recorded up to here appended with Recorder::append_part.
+      * The recording is only read back once the game is over, so resuming reads the image alone. */
+    uint32_t recording_size = 0;
+};
+
+/// Serializes image into bytes.
+void write_session(const SessionImage& image, std::string& bytes);
+/// Reads an image written by write_session. Returns false if bytes are not a session of this version.
+bool read_session(const std::string& bytes, SessionImage& image);
+/** Reads the session saved at filename, or the complete save left under its temporary name. Returns false if there is none,
+  * it can't be read or its recording is shorter than it says. Only the image is read, up to SESSION_MAX_SIZE bytes. */
+bool load_session(const std::string& filename, SessionImage& image);
+/** Puts the whole recording of the game with seed saved at filename back together, the size bytes of its session recording then
+  * what recorder recorded since. recorder is left as it was if the recording can't be read. */
+bool load_session_recording(const std::string& filename, uint32_t seed, size_t size, Recorder& recorder);
+/** Where the recording of the game with seed saved at filename is, each game has its own so a new game's save never writes over
+  * the recording of the session it replaces. */
+std::string session_recording_path(const std::string& filename, uint32_t seed);
+/// Deletes the session saved at filename and its recording so it is not resumed again.
+void remove_session(const std::string& filename);
+
+/**
+ * Saves a session a chunk at a time so a frame never waits for the whole SD card write.
+ * What was recorded since the last save is appended to the session recording first. The image goes to a temporary file
+ * that replaces the session file only once complete, so the saved session is always either the old or the new one.
+ */
+class SessionWriter
+{
+public:
+    explicit SessionWriter(const std::string& filename) : path(filename), temp_path(filename + ".tmp") {}
+
+    /** Starts saving image, dropping a save still in progress. What recording recorded since its mark is appended after the
+      * image.recording_size bytes the last save left and image.recording_size is set to the new size, a new game's first save reads the
+      * session it replaces to find its recording. A recording over SESSION_MAX_RECORDING_SIZE is not saved and the save fails. */
+    void begin(SessionImage&& image, Recorder&& recording);
+    /// Writes up to max_bytes, replacing the session file once everything is written. Returns true when no save is in progress.
+    bool step(size_t max_bytes = SESSION_CHUNK_SIZE);
+    /// Writes the rest at once, for when no more frames run such as on suspend or exit. Returns false if the save failed.
+    bool finish();
+    /// Drops a save in progress and deletes the session file and its recording.
+    void discard();
+
+    /// Is a save in progress
+    bool busy() const {return file.is_open();}
+    /// Did the last save fail
+    bool failed() const {return error;}
+
+private:
+    /// Drops the save in progress, the session on the card stays as it was.
+    void discard_save();
+
+    std::string path;
+    std::string temp_path;
+    std::string recording_path;
+    /// Recording of the session being replaced by a new game's, deleted once the save is complete
+    std::string replaced_recording;
+    /// The recording is one no saved session uses yet, deleted if the save is dropped
+    bool new_recording = false;
+    /// Serialized image
+    std::string bytes;
+    /// What is appended to the session recording before the image is written
+    Recorder recording;
+    /// Bytes appended
+    size_t appended = 0;
+    /// Bytes in the whole save, appended and then the image
+    size_t size = 0;
+    /// Bytes already written
+    size_t written = 0;
+    std::ofstream file;
+    std::fstream recording_file;
+    bool error = false;
+};
+
+/// Saves the game left with HOME, sleep or quit, stepped once per frame by the main loop.
+extern SessionWriter session_writer;
+
+#endif
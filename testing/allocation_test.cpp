@@ -0,0 +1,143 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <game_common.hpp>
+#include <panel_table.hpp>
+
+/** Allocations are only counted while a frame is being simulated. */
+static bool counting = false;
+static unsigned long allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    if (counting)
+        allocations++;
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+PanelTable* CreateEndlessTable()
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 0xBBB);
+    opts.settings = easy_speed_settings;
+    opts.moves = 0;
+    return new PanelTable(opts);
+}
+
+/** Does what GameScene does in a frame, with random input instead of the buttons. */
+void SimulateFrame(PanelTable& table, int& level, int& next)
+{
+    if (rand() % 4 == 0)
+        table.swap(rand() % table.height(), rand() % (table.width() - 1));
+    if (rand() % 64 == 0)
+        table.quick_rise();
+
+    const bool next_generated = table.is_generate_next();
+    MatchInfo info = table.update();
+    if (info.matched())
+    {
+        next -= info.combo;
+        if (next <= 0)
+        {
+            level++;
+            next += get_panels_for_level(level);
+            table.set_speed(get_speed_for_level(level));
+        }
+        table.freeze(calculate_timeout(info.combo, info.chain + 1, 0, table.warning()));
+    }
+
+    // Per frame queries made by GameScene when drawing.
+    for (int j = 0; j < table.width(); j++)
+        table.danger_column(j);
+    table.warning();
+    // Lines are generated ahead on frames that don't take one.
+    if (!next_generated)
+        table.fill_lines();
+}
+
+BOOST_AUTO_TEST_CASE(TestUpdateDoesNotAllocate)
+{
+    const int warmup_frames = 600;
+    const int frames = 100000;
+
+    srand(0xBBB);
+    int level = 1;
+    int next = get_panels_for_level(level);
+    std::unique_ptr<PanelTable> table(CreateEndlessTable());
+    table->set_speed(get_speed_for_level(level));
+
+    for (int frame = 0; frame < warmup_frames; frame++)
+        SimulateFrame(*table, level, next);
+
+    int games = 1;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table->is_gameover())
+        {
+            // Starting a new game allocates, only the frame loop is measured.
+            level = 1;
+            next = get_panels_for_level(level);
+            table.reset(CreateEndlessTable());
+            table->set_speed(get_speed_for_level(level));
+            games++;
+        }
+
+        counting = true;
+        SimulateFrame(*table, level, next);
+        counting = false;
+    }
+
+    BOOST_TEST_MESSAGE("Simulated " << frames << " frames over " << games << " games, " << table->get_lines() << " lines");
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestResetOnlyAllocatesBoard)
+{
+    std::unique_ptr<PanelTable> table(CreateEndlessTable());
+    table->set_record_changes(true);
+    RandomPanelSource source(12, 6, 5, 0xBBB);
+
+    // The source hands the starting board over in vectors of its own, everything else reuses the table's storage.
+    counting = true;
+    source.board();
+    counting = false;
+    const unsigned long board_allocations = allocations;
+    allocations = 0;
+
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.source = nullptr;
+    opts.settings = easy_speed_settings;
+    opts.moves = 0;
+    for (int game = 0; game < 100; game++)
+    {
+        for (int frame = 0; frame < 200 && !table->is_gameover(); frame++)
+            table->update();
+        counting = true;
+        table->reset(opts);
+        counting = false;
+    }
+
+    BOOST_CHECK_EQUAL(allocations, 100 * board_allocations);
+}
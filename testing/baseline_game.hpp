@@ -0,0 +1,94 @@
+#ifndef BASELINE_GAME_HPP
+#define BASELINE_GAME_HPP
+
+#include <cstdint>
+#include <panel.hpp>
+
+/** Games recorded from the PanelTable of the first commit, which linked Panel objects with pointers, are played again on the current
+  * PanelTable by panel_table_test. record_baseline_games builds against those sources and the test against these, so everything here
+  * only uses what the two tables have in common. */
+
+/// Generator of the board, the lines and the input of a game, the same one as TestRandom.
+struct BaselineRandom
+{
+    explicit BaselineRandom(uint32_t s) : seed(s) {}
+    int next(int max)
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % max;
+    }
+    uint32_t seed;
+};
+
+/// Number of colors panels are drawn from
+const int BASELINE_COLORS = 5;
+/// Speed settings of the easy preset
+const PanelSpeedSettings BASELINE_SPEED_SETTINGS = {3, 11, 1, 46, 25, 9, FALL_ANIMATION_FRAMES};
+
+/// 64 bit FNV-1a of every value added, a game keeps adding to one digest frame after frame.
+struct GameDigest
+{
+    void add(int32_t v)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            value ^= (uint32_t) v >> (8 * k) & 0xFF;
+            value *= 0x100000001B3ULL;
+        }
+    }
+    uint64_t value = 0xCBF29CE484222325ULL;
+};
+
+/// Adds a panel, the panels of the board come first going left to right from the top row then the next set of panels.
+inline void DigestPanel(GameDigest& digest, int type, int old, int state, bool chain, bool locked, int countdown, int match_time, int remove_time)
+{
+    digest.add(type);
+    digest.add(old);
+    digest.add(state);
+    digest.add(chain);
+    digest.add(locked);
+    digest.add(countdown);
+    digest.add(match_time);
+    digest.add(remove_time);
+}
+
+/// Adds the counters of the table, after its panels.
+inline void DigestTable(GameDigest& digest, int state, bool stopped, int moves, int rise_counter, int rise, int speed, int timeout, int clink,
+                        int chain, int lines)
+{
+    const int values[] = {state, stopped, moves, rise_counter, rise, speed, timeout, clink, chain, lines};
+    for (const int value : values)
+        digest.add(value);
+}
+
+/// Adds the match of a frame, after the table. Info is the MatchInfo of either table.
+template <class Info> void DigestMatch(GameDigest& digest, const Info& info)
+{
+    digest.add(info.combo);
+    digest.add(info.chain);
+    digest.add(info.clink);
+    digest.add(info.swap_match);
+    digest.add(info.fall_match);
+}
+
+/** Plays a frame of a recorded game on Table, either PanelTable. Panels are swapped and quick rises asked for at random and a board
+  * about to top out is cleared so the game keeps rising. A match freezes the board as the game scenes do. Returns the match. */
+template <class Table> auto PlayBaselineFrame(Table& table, BaselineRandom& input) -> decltype(table.update())
+{
+    if (input.next(8) == 0)
+        table.swap(input.next(table.height()), input.next(table.width() - 1));
+    if (input.next(100) == 0)
+        table.quick_rise();
+    if (table.warning() && table.all_idle())
+        table.clear();
+
+    auto info = table.update();
+    if (info.matched())
+        table.freeze(info.combo * 10 + info.chain * 20);
+    return info;
+}
+
+/// Frames between the digests written for a game, one is also written after the table is made and after the last frame.
+const int BASELINE_DIGEST_FRAMES = 50;
+
+#endif
@@ -0,0 +1,267 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <panel_table.hpp>
+#include "test_tables.hpp"
+
+PanelTable* CreateTable(PanelTable::Type type, uint32_t seed)
+{
+    TestPanelSource* source;
+    PanelTable::Options opts = TestTableOptions(type, source, seed);
+    source->heights = 6;
+    PanelTable* table = new PanelTable(opts);
+    table->set_speed(0x400);
+    return table;
+}
+
+/// Puzzle table with only a bottom row of panels that do not match.
+PanelTable* CreateFloor()
+{
+    PanelTable* table = CreateTable(PanelTable::Type::MOVES, 1);
+    PanelTableSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    table->save_state(snapshot);
+    for (int k = 0; k < 12 * 6; k++)
+        snapshot.panels[k] = PanelSnapshot {(uint8_t) (k >= 11 * 6 ? 1 + k % 3 : Panel::Type::EMPTY), Panel::State::IDLE, 0, 0, 0};
+    table->load_state(snapshot);
+    return table;
+}
+
+void Settle(PanelTable& table)
+{
+    for (int frame = 0; frame < 1000 && !table.all_idle(); frame++)
+        table.update();
+    BOOST_REQUIRE(table.all_idle());
+}
+
+/// Every cell covered by a span is a garbage panel and no other cell is.
+void CheckGarbage(const PanelTable& table)
+{
+    std::vector<int> covered(table.height() * table.width(), 0);
+    const auto& garbage = table.get_garbage();
+    for (unsigned int k = 0; k < garbage.size(); k++)
+    {
+        const GarbageSpan& span = garbage[k];
+        BOOST_REQUIRE(span.height > 0 && span.x >= 0 && span.x + span.width <= table.width() && span.bottom() < table.height());
+        if (k > 0)
+            BOOST_REQUIRE(garbage[k - 1].bottom() > span.bottom() || (garbage[k - 1].bottom() == span.bottom() && garbage[k - 1].x < span.x));
+        for (int i = std::max<int>(span.y, 0); i <= span.bottom(); i++)
+        {
+            for (int j = span.x; j < span.x + span.width; j++)
+                BOOST_REQUIRE_EQUAL(covered[i * table.width() + j]++, 0);
+        }
+    }
+
+    for (int i = 0; i < table.height(); i++)
+    {
+        for (int j = 0; j < table.width(); j++)
+        {
+            const Panel& panel = table.get(i, j);
+            BOOST_REQUIRE_EQUAL(panel.is_garbage(), covered[i * table.width() + j] != 0);
+            if (panel.is_garbage())
+                BOOST_REQUIRE(panel.special());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestGarbageFallsAndLands)
+{
+    std::unique_ptr<PanelTable> table(CreateFloor());
+    BOOST_REQUIRE(table->add_garbage(1, 4, 2));
+    BOOST_REQUIRE_EQUAL(table->get_garbage()[0].y, -2);
+    BOOST_CHECK(!table->all_idle());
+    Settle(*table);
+    CheckGarbage(*table);
+
+    const GarbageSpan& span = table->get_garbage()[0];
+    BOOST_CHECK_EQUAL(span.y, 9);
+    BOOST_CHECK_EQUAL(span.bottom(), 10);
+    BOOST_CHECK(table->empty(10, 0));
+    // Garbage can't be swapped or matched.
+    BOOST_CHECK(!table->get(10, 0).can_swap());
+    BOOST_CHECK(!table->matchable(10, 1));
+
+    // Garbage lands on garbage even if only part of it is held up.
+    BOOST_REQUIRE(table->add_garbage(0, 6, 1));
+    Settle(*table);
+    CheckGarbage(*table);
+    BOOST_REQUIRE_EQUAL(table->get_garbage().size(), 2u);
+    BOOST_CHECK_EQUAL(table->get_garbage()[1].y, 8);
+    BOOST_CHECK(table->empty(9, 0));
+
+    BOOST_CHECK(!table->add_garbage(4, 3, 1));
+    BOOST_CHECK(!table->add_garbage(0, 1, 13));
+}
+
+BOOST_AUTO_TEST_CASE(TestGarbageStacksAboveTheBoard)
+{
+    std::unique_ptr<PanelTable> table(CreateFloor());
+    BOOST_REQUIRE(table->add_garbage(0, 6, 2));
+    BOOST_REQUIRE(table->add_garbage(2, 3, 3));
+    BOOST_CHECK_EQUAL(table->get_garbage()[1].y, -5);
+
+    // The spans fall in together.
+    Settle(*table);
+    CheckGarbage(*table);
+    BOOST_CHECK_EQUAL(table->get_garbage()[0].y, 9);
+    BOOST_CHECK_EQUAL(table->get_garbage()[1].y, 6);
+}
+
+BOOST_AUTO_TEST_CASE(TestGarbageShattersIntoPanels)
+{
+    std::unique_ptr<PanelTable> table(CreateFloor());
+    BOOST_REQUIRE(table->add_garbage(0, 6, 2));
+    BOOST_REQUIRE(table->add_garbage(0, 1, 1));
+    Settle(*table);
+
+    // Reds on top of the wide span in row 8, away from the narrow span on it in column 0.
+    PanelTableSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    table->save_state(snapshot);
+    snapshot.panels[8 * 6 + 2] = PanelSnapshot {Panel::Type::RED, Panel::State::IDLE, 0, 0, 0};
+    snapshot.panels[8 * 6 + 3] = PanelSnapshot {Panel::Type::RED, Panel::State::IDLE, 0, 0, 0};
+    snapshot.panels[8 * 6 + 4] = PanelSnapshot {Panel::Type::BLUE, Panel::State::IDLE, 0, 0, 0};
+    snapshot.panels[8 * 6 + 5] = PanelSnapshot {Panel::Type::RED, Panel::State::IDLE, 0, 0, 0};
+    BOOST_REQUIRE(table->load_state(snapshot));
+    CheckGarbage(*table);
+
+    table->swap(8, 4);
+    bool shattering = false;
+    for (int frame = 0; frame < 10 && !shattering; frame++)
+    {
+        table->update();
+        shattering = table->get_garbage()[0].state == GarbageSpan::SHATTERING;
+    }
+    BOOST_REQUIRE(shattering);
+    // The match does not touch the narrow span but the wide span does so it shatters with it.
+    BOOST_CHECK_EQUAL(table->get_garbage()[1].state, GarbageSpan::SHATTERING);
+
+    Settle(*table);
+    CheckGarbage(*table);
+    // Each span lost its bottom row, the wide one is now one row high on top of new panels.
+    const auto& garbage = table->get_garbage();
+    BOOST_REQUIRE_EQUAL(garbage.size(), 1u);
+    BOOST_CHECK_EQUAL(garbage[0].width, 6);
+    BOOST_CHECK_EQUAL(garbage[0].height, 1);
+    for (int j = 0; j < 6; j++)
+        BOOST_CHECK(!table->get(10, j).is_garbage());
+}
+
+BOOST_AUTO_TEST_CASE(TestGarbageRandomGames)
+{
+    const PanelTable::Type types[] = {PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES};
+    int shattered = 0;
+    int rises = 0;
+    for (const auto type : types)
+    {
+        for (uint32_t seed = 1; seed <= 10; seed++)
+        {
+            std::unique_ptr<PanelTable> table(CreateTable(type, seed));
+            std::unique_ptr<PanelTable> other(CreateTable(type, seed + 1000));
+            TestRandom input(seed * 7919);
+
+            for (int frame = 0; frame < 2000 && !table->is_gameover(); frame++)
+            {
+                if (input.next(60) == 0)
+                {
+                    const int width = 1 + input.next(6);
+                    table->add_garbage(input.next(7 - width), width, 1 + input.next(3));
+                }
+                if (input.next(3) == 0)
+                    table->swap(input.next(table->height()), input.next(table->width() - 1));
+
+                const int lines = table->get_lines();
+                const int spans = table->get_garbage().size();
+                int height = 0;
+                for (const auto& span : table->get_garbage())
+                    height += span.height;
+
+                MatchInfo info = table->update();
+                if (info.matched())
+                    table->freeze(info.combo * 5);
+                CheckGarbage(*table);
+                rises += table->get_lines() != lines;
+                for (const auto& span : table->get_garbage())
+                    height -= span.height;
+                shattered += spans == (int) table->get_garbage().size() && height > 0;
+
+                // The spans are part of the saved state.
+                PanelTableSnapshot snapshot;
+                BOOST_REQUIRE(table->save_state(snapshot));
+                BOOST_REQUIRE(other->load_state(snapshot));
+                BOOST_REQUIRE_EQUAL(table->hash(), other->hash());
+
+                // Skipping quiet frames is the same as updating with garbage on the board.
+                if (frame % 50 == 0)
+                {
+                    const int skipped = other->advance_until_event(20);
+                    for (int k = 0; k < skipped; k++)
+                        table->update();
+                    BOOST_REQUIRE_EQUAL(table->hash(), other->hash());
+                }
+            }
+        }
+    }
+    BOOST_CHECK(shattered > 0);
+    BOOST_CHECK(rises > 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestShatterKeepsFillTiming)
+{
+    int shattered = 0;
+    for (uint32_t seed = 1; seed <= 10; seed++)
+    {
+        PanelTable::Options opts;
+        opts.rows = 12;
+        opts.columns = 6;
+        opts.type = PanelTable::Type::VERSUS;
+        opts.moves = 0;
+        opts.settings = test_speed_settings;
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable table(opts);
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable again(opts);
+        table.set_speed(0x400);
+        again.set_speed(0x400);
+        TestRandom input(seed * 7919);
+
+        // Lines generated ahead on some frames or never don't change the panels garbage shatters into.
+        for (int frame = 0; frame < 2000 && !table.is_gameover(); frame++)
+        {
+            if (input.next(60) == 0)
+            {
+                const int width = 1 + input.next(6);
+                const int x = input.next(7 - width);
+                const int height = 1 + input.next(3);
+                table.add_garbage(x, width, height);
+                again.add_garbage(x, width, height);
+            }
+            if (input.next(3) == 0)
+            {
+                const int i = input.next(table.height());
+                const int j = input.next(table.width() - 1);
+                table.swap(i, j);
+                again.swap(i, j);
+            }
+            if (input.next(3) == 0)
+                table.fill_lines();
+
+            int height = 0;
+            for (const auto& span : table.get_garbage())
+                height += span.height;
+            const int spans = table.get_garbage().size();
+
+            table.update();
+            again.update();
+            BOOST_REQUIRE_EQUAL(table.hash(), again.hash());
+
+            for (const auto& span : table.get_garbage())
+                height -= span.height;
+            shattered += spans == (int) table.get_garbage().size() && height > 0;
+        }
+    }
+    BOOST_CHECK(shattered > 0);
+}
@@ -0,0 +1,353 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstdlib>
+#include <set>
+#include <vector>
+#include <panel_matcher.hpp>
+#include <panel_table.hpp>
+
+/** Board of panel types and matchable flags, matched by the original std::set based code. */
+struct ReferenceBoard
+{
+    ReferenceBoard(int r, int c) : rows(r), columns(c), types(r * c, Panel::Type::EMPTY), can_match(r * c, false) {}
+
+    Panel::Type value(int i, int j) const {return types[i * columns + j];}
+    bool matchable(int i, int j) const {return can_match[i * columns + j];}
+
+    bool vertical(int i, int j) const
+    {
+        if (i > rows - 3)
+            return false;
+        if (!matchable(i, j) || !matchable(i + 1, j) || !matchable(i + 2, j))
+            return false;
+        return value(i, j) == value(i + 1, j) && value(i, j) == value(i + 2, j);
+    }
+
+    bool horizontal(int i, int j) const
+    {
+        if (j > columns - 3)
+            return false;
+        if (!matchable(i, j) || !matchable(i, j + 1) || !matchable(i, j + 2))
+            return false;
+        return value(i, j) == value(i, j + 1) && value(i, j) == value(i, j + 2);
+    }
+
+    std::set<Point> check_horizontal_combo(int i, int j) const
+    {
+        std::set<Point> remove;
+        int moveon = 3;
+
+        remove.emplace(j, i);
+        remove.emplace(j + 1, i);
+        remove.emplace(j + 2, i);
+
+        for (int k = 3; k < columns - j - 1; k++)
+        {
+            if (!(j + k < columns && value(i, j) == value(i, j + k) && matchable(i, j + k)))
+                break;
+            moveon = k + 1;
+            remove.emplace(j + k, i);
+        }
+
+        for (int m = 0; m < moveon; m++)
+        {
+            for (int k = -2; k <= 1; k++)
+            {
+                if (k == 0)
+                    continue;
+                int l = k == -1 ? 1 : k + 1;
+                Panel::Type panel = value(i, j);
+                if (i + k >= 0 && i + l < rows && panel == value(i + k, j + m) && panel == value(i + l, j + m) && matchable(i + k, j + m) && matchable(i + l, j + m))
+                {
+                    remove.emplace(j + m, i + k);
+                    remove.emplace(j + m, i + l);
+                }
+            }
+        }
+        return remove;
+    }
+
+    std::set<Point> check_vertical_combo(int i, int j) const
+    {
+        std::set<Point> remove;
+        int moveon = 3;
+
+        remove.emplace(j, i);
+        remove.emplace(j, i + 1);
+        remove.emplace(j, i + 2);
+
+        for (int k = 3; k < rows - i - 1; k++)
+        {
+            if (!(i + k < rows && value(i, j) == value(i + k, j) && matchable(i + k, j)))
+                break;
+            moveon = k + 1;
+            remove.emplace(j, i + k);
+        }
+
+        for (int m = 0; m < moveon; m++)
+        {
+            for (int k = -2; k <= 1; k++)
+            {
+                if (k == 0)
+                    continue;
+                int l = k == -1 ? 1 : k + 1;
+                Panel::Type panel = value(i, j);
+                if (j + k >= 0 && j + l < columns && panel == value(i + m, j + k) && panel == value(i + m, j + l) && matchable(i + m, j + k) && matchable(i + m, j + l))
+                {
+                    remove.emplace(j + k, i + m);
+                    remove.emplace(j + l, i + m);
+                }
+            }
+        }
+        return remove;
+    }
+
+    /// Removal order and number of types matched exactly as PanelTable::update_matches used to compute it.
+    std::vector<Point> matches(int& types_matched) const
+    {
+        std::set<Point> remove;
+        for (int i = 0; i < rows; i++)
+        {
+            for (int j = 0; j < columns; j++)
+            {
+                if (horizontal(i, j))
+                {
+                    std::set<Point> horiz = check_horizontal_combo(i, j);
+                    remove.insert(horiz.begin(), horiz.end());
+                }
+                if (vertical(i, j))
+                {
+                    std::set<Point> vert = check_vertical_combo(i, j);
+                    remove.insert(vert.begin(), vert.end());
+                }
+            }
+        }
+
+        std::set<Panel::Type> types;
+        for (const auto& pt : remove)
+            types.insert(value(pt.y, pt.x));
+        types_matched = types.size();
+
+        return std::vector<Point>(remove.begin(), remove.end());
+    }
+
+    int rows;
+    int columns;
+    std::vector<Panel::Type> types;
+    std::vector<bool> can_match;
+};
+
+/// Removal order as PanelTable::update_matches visits the matcher's output.
+std::vector<Point> matcher_order(const PanelMatcher& matcher, int rows, int columns)
+{
+    std::vector<Point> order;
+    for (int i = rows - 1; i >= 0; i--)
+    {
+        for (int j = columns - 1; j >= 0; j--)
+        {
+            if (matcher.removed(i) & (PanelMatcher::RowMask(1) << j))
+                order.emplace_back(j, i);
+        }
+    }
+    return order;
+}
+
+void CheckAgainstReference(const ReferenceBoard& board)
+{
+    PanelMatcher matcher(board.rows);
+    for (int i = 0; i < board.rows; i++)
+        for (int j = 0; j < board.columns; j++)
+            matcher.add(i, j, board.value(i, j), board.matchable(i, j));
+
+    int expected_types;
+    std::vector<Point> expected = board.matches(expected_types);
+
+    int total = matcher.find();
+    std::vector<Point> actual = matcher_order(matcher, board.rows, board.columns);
+
+    BOOST_REQUIRE_EQUAL(total, (int) expected.size());
+    BOOST_REQUIRE_EQUAL(matcher.types_matched(), expected_types);
+    BOOST_REQUIRE(actual == expected);
+}
+
+BOOST_AUTO_TEST_CASE(TestMatcherCrossShape)
+{
+    ReferenceBoard board(12, 6);
+    const int data[] = {
+        0, 0, 1, 0, 0, 0,
+        0, 0, 1, 0, 0, 0,
+        1, 1, 1, 1, 1, 0,
+        0, 0, 1, 0, 0, 0,
+        0, 0, 2, 2, 2, 0,
+    };
+    for (unsigned int k = 0; k < sizeof(data) / sizeof(data[0]); k++)
+    {
+        board.types[k] = (Panel::Type) data[k];
+        board.can_match[k] = data[k] != 0;
+    }
+
+    PanelMatcher matcher(board.rows);
+    for (int i = 0; i < board.rows; i++)
+        for (int j = 0; j < board.columns; j++)
+            matcher.add(i, j, board.value(i, j), board.matchable(i, j));
+
+    BOOST_CHECK_EQUAL(matcher.find(), 11);
+    BOOST_CHECK_EQUAL(matcher.types_matched(), 2);
+    BOOST_CHECK_EQUAL(matcher.removed(2), 0x1F);
+    BOOST_CHECK_EQUAL(matcher.removed(4), 0x1C);
+    CheckAgainstReference(board);
+}
+
+BOOST_AUTO_TEST_CASE(TestMatcherUnmatchableBreaksRun)
+{
+    ReferenceBoard board(12, 6);
+    for (int j = 0; j < 6; j++)
+    {
+        board.types[11 * 6 + j] = Panel::Type::RED;
+        board.can_match[11 * 6 + j] = j != 3;
+    }
+
+    PanelMatcher matcher(board.rows);
+    for (int i = 0; i < board.rows; i++)
+        for (int j = 0; j < board.columns; j++)
+            matcher.add(i, j, board.value(i, j), board.matchable(i, j));
+
+    BOOST_CHECK_EQUAL(matcher.find(), 3);
+    BOOST_CHECK_EQUAL(matcher.removed(11), 0x7);
+    CheckAgainstReference(board);
+}
+
+BOOST_AUTO_TEST_CASE(TestMatcherDifferentialRandom)
+{
+    srand(0xBBB);
+    const int sizes[][2] = {{12, 6}, {11, 6}, {3, 3}, {16, 9}, {4, 32}};
+    for (const auto& size : sizes)
+    {
+        for (int trial = 0; trial < 5000; trial++)
+        {
+            ReferenceBoard board(size[0], size[1]);
+            // Few colors so that long runs, crosses and overlapping groups are common.
+            int colors = 1 + rand() % 4;
+            for (unsigned int k = 0; k < board.types.size(); k++)
+            {
+                int type = rand() % 12 == 0 ? Panel::Type::SPECIAL : rand() % (colors + 1);
+                board.types[k] = (Panel::Type) type;
+                board.can_match[k] = type != Panel::Type::EMPTY && type != Panel::Type::SPECIAL && rand() % 8 != 0;
+            }
+            CheckAgainstReference(board);
+        }
+    }
+}
+
+/// Takes every group from a matcher after find, checks that they split the removed panels into connected panels of one type.
+void CheckGroups(PanelMatcher& matcher, const ReferenceBoard& board)
+{
+    std::vector<int> group_of(board.rows * board.columns, -1);
+    std::vector<Panel::Type> group_types;
+    for (Panel::Type type = matcher.next_group(); type != Panel::Type::EMPTY; type = matcher.next_group())
+    {
+        const int group = group_types.size();
+        group_types.push_back(type);
+        for (int i = 0; i < board.rows; i++)
+        {
+            for (int j = 0; j < board.columns; j++)
+            {
+                if (!(matcher.group(i) >> j & 1))
+                    continue;
+                BOOST_REQUIRE(matcher.removed(i) >> j & 1);
+                BOOST_REQUIRE_EQUAL(group_of[i * board.columns + j], -1);
+                BOOST_REQUIRE_EQUAL(board.value(i, j), type);
+                group_of[i * board.columns + j] = group;
+            }
+        }
+    }
+
+    for (int i = 0; i < board.rows; i++)
+    {
+        for (int j = 0; j < board.columns; j++)
+        {
+            const int group = group_of[i * board.columns + j];
+            BOOST_REQUIRE_EQUAL(group != -1, (bool) (matcher.removed(i) >> j & 1));
+            // Removed neighbours of the same type are in the same group.
+            if (group != -1 && j + 1 < board.columns && group_of[i * board.columns + j + 1] != -1 && board.value(i, j + 1) == board.value(i, j))
+                BOOST_REQUIRE_EQUAL(group_of[i * board.columns + j + 1], group);
+            if (group != -1 && i + 1 < board.rows && group_of[(i + 1) * board.columns + j] != -1 && board.value(i + 1, j) == board.value(i, j))
+                BOOST_REQUIRE_EQUAL(group_of[(i + 1) * board.columns + j], group);
+        }
+    }
+
+    // Every group is connected, at least 3 panels each connected to another.
+    for (unsigned int group = 0; group < group_types.size(); group++)
+    {
+        int count = 0;
+        for (int k = 0; k < board.rows * board.columns; k++)
+            count += group_of[k] == (int) group;
+        BOOST_REQUIRE_GE(count, 3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestMatcherGroups)
+{
+    ReferenceBoard board(12, 6);
+    const int data[] = {
+        0, 0, 1, 0, 0, 0,
+        0, 0, 1, 0, 0, 0,
+        1, 1, 1, 1, 1, 0,
+        0, 0, 1, 0, 0, 0,
+        0, 0, 2, 2, 2, 0,
+        1, 1, 1, 0, 0, 0,
+    };
+    for (unsigned int k = 0; k < sizeof(data) / sizeof(data[0]); k++)
+    {
+        board.types[k] = (Panel::Type) data[k];
+        board.can_match[k] = data[k] != 0;
+    }
+
+    PanelMatcher matcher(board.rows);
+    for (int i = 0; i < board.rows; i++)
+        for (int j = 0; j < board.columns; j++)
+            matcher.add(i, j, board.value(i, j), board.matchable(i, j));
+    BOOST_REQUIRE_EQUAL(matcher.find(), 14);
+
+    // The cross and the separate run of the same type are different groups.
+    BOOST_CHECK_EQUAL(matcher.next_group(), Panel::Type::RED);
+    BOOST_CHECK_EQUAL(matcher.group(0), 0x4);
+    BOOST_CHECK_EQUAL(matcher.group(2), 0x1F);
+    BOOST_CHECK_EQUAL(matcher.group(5), 0);
+    BOOST_CHECK_EQUAL(matcher.next_group(), Panel::Type::RED);
+    BOOST_CHECK_EQUAL(matcher.group(2), 0);
+    BOOST_CHECK_EQUAL(matcher.group(5), 0x7);
+    BOOST_CHECK_EQUAL(matcher.next_group(), Panel::Type::GREEN);
+    BOOST_CHECK_EQUAL(matcher.group(4), 0x1C);
+    BOOST_CHECK_EQUAL(matcher.next_group(), Panel::Type::EMPTY);
+
+    matcher.find();
+    CheckGroups(matcher, board);
+}
+
+BOOST_AUTO_TEST_CASE(TestMatcherGroupsRandom)
+{
+    srand(0xB10C);
+    const int sizes[][2] = {{12, 6}, {16, 9}, {4, 32}};
+    for (const auto& size : sizes)
+    {
+        for (int trial = 0; trial < 2000; trial++)
+        {
+            ReferenceBoard board(size[0], size[1]);
+            int colors = 1 + rand() % 3;
+            for (unsigned int k = 0; k < board.types.size(); k++)
+            {
+                board.types[k] = (Panel::Type) (rand() % (colors + 1));
+                board.can_match[k] = board.types[k] != Panel::Type::EMPTY && rand() % 8 != 0;
+            }
+
+            PanelMatcher matcher(board.rows);
+            for (int i = 0; i < board.rows; i++)
+                for (int j = 0; j < board.columns; j++)
+                    matcher.add(i, j, board.value(i, j), board.matchable(i, j));
+            matcher.find();
+            CheckGroups(matcher, board);
+        }
+    }
+}
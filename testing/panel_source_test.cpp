@@ -0,0 +1,426 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <algorithm>
+#include <vector>
+#include <game_common.hpp>
+#include <panel_random.hpp>
+#include <panel_source.hpp>
+#include <panel_table.hpp>
+
+std::vector<Panel::Type> Lines(PanelSource& source, int columns, int count)
+{
+    std::vector<Panel::Type> lines;
+    std::vector<Panel::Type> line(columns);
+    for (int k = 0; k < count; k++)
+    {
+        source.line(line);
+        lines.insert(lines.end(), line.begin(), line.end());
+    }
+    return lines;
+}
+
+/** Counts the panels drawn to check that generating is bounded. */
+class CountingPanelSource : public RandomPanelSource
+{
+public:
+    CountingPanelSource(int rows, int columns, int colors, uint32_t seed) : RandomPanelSource(rows, columns, colors, seed) {}
+    Panel::Type panel() override
+    {
+        drawn++;
+        return RandomPanelSource::panel();
+    }
+    Panel::Type panel_except(uint32_t excluded) override
+    {
+        redrawn++;
+        return RandomPanelSource::panel_except(excluded);
+    }
+    Panel::Type redraw(uint32_t excluded) override
+    {
+        redrawn++;
+        return RandomPanelSource::redraw(excluded);
+    }
+    int drawn = 0;
+    int redrawn = 0;
+};
+
+/** Only has the default panel_except. */
+class FewColorsPanelSource : public PanelSource
+{
+public:
+    FewColorsPanelSource(int rows, int columns, uint32_t seed) : PanelSource(rows, columns), random(seed) {}
+    std::vector<int> board_layout() override
+    {
+        std::vector<int> layout(columns);
+        for (auto& height : layout)
+            height = random.next(rows);
+        return layout;
+    }
+    Panel::Type panel() override {return (Panel::Type) random.range(1, 3);}
+    PanelRandom random;
+};
+
+/** Only ever gives one type, so the default panel_except has nothing else to choose. */
+class OneColorPanelSource : public PanelSource
+{
+public:
+    OneColorPanelSource(int rows, int columns) : PanelSource(rows, columns) {}
+    std::vector<int> board_layout() override {return std::vector<int>(columns, rows / 2);}
+    Panel::Type panel() override {return Panel::Type::RED;}
+};
+
+bool Matchable(const PanelTable& table, int i, int j)
+{
+    return table.get(i, j).get_value() != Panel::Type::EMPTY && table.get(i, j).get_value() != Panel::Type::SPECIAL;
+}
+
+bool Same(const PanelTable& table, int i, int j, int i2, int j2, int i3, int j3)
+{
+    return Matchable(table, i, j) && table.get(i, j).get_value() == table.get(i2, j2).get_value() &&
+        table.get(i, j).get_value() == table.get(i3, j3).get_value();
+}
+
+void CheckNoMatches(const PanelTable& table)
+{
+    const int rows = table.height();
+    const int columns = table.width();
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < columns; j++)
+        {
+            BOOST_REQUIRE(i + 2 >= rows || !Same(table, i, j, i + 1, j, i + 2, j));
+            BOOST_REQUIRE(j + 2 >= columns || !Same(table, i, j, i, j + 1, i, j + 2));
+        }
+    }
+}
+
+void CheckNextHasNoMatches(const PanelTable& table)
+{
+    const int rows = table.height();
+    const int columns = table.width();
+    const auto& next = table.get_next();
+    for (int j = 0; j < columns; j++)
+    {
+        BOOST_REQUIRE(next[j].get_value() != Panel::Type::EMPTY);
+        BOOST_REQUIRE(j + 2 >= columns || next[j].get_value() != next[j + 1].get_value() || next[j].get_value() != next[j + 2].get_value());
+        BOOST_REQUIRE(!Matchable(table, rows - 1, j) || !Matchable(table, rows - 2, j) || next[j].get_value() != table.get(rows - 1, j).get_value() ||
+            next[j].get_value() != table.get(rows - 2, j).get_value());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestRandomSequenceIsStable)
+{
+    // Replays store seeds, so these must never change.
+    const uint32_t expected[][4] = {
+        {0xDEC9045D, 0x9A089D75, 0xAB77D362, 0xC3E16405},
+        {0x650941BA, 0x54D30301, 0x25D2F321, 0x3FABDCA9},
+    };
+    for (uint32_t seed = 0; seed < 2; seed++)
+    {
+        PanelRandom random(seed);
+        for (int k = 0; k < 4; k++)
+            BOOST_CHECK_EQUAL(random.next(), expected[seed][k]);
+
+        random.set_seed(seed);
+        BOOST_CHECK_EQUAL(random.next(), expected[seed][0]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestRandomStaysInRange)
+{
+    PanelRandom random(0xBBB);
+    const int maxes[] = {1, 2, 5, 6, 46, 1000};
+    for (const int max : maxes)
+    {
+        std::vector<int> seen(max, 0);
+        for (int k = 0; k < max * 100; k++)
+        {
+            const int value = random.next(max);
+            BOOST_REQUIRE(value >= 0 && value < max);
+            seen[value]++;
+        }
+        // Every value comes up about as often as the others.
+        for (const int count : seen)
+            BOOST_CHECK(count > 50 && count < 150);
+    }
+
+    for (int k = 0; k < 1000; k++)
+    {
+        const int value = random.range(1, 6);
+        BOOST_REQUIRE(value >= 1 && value <= 6);
+    }
+
+    int values[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    random.shuffle(values, 8);
+    std::sort(values, values + 8);
+    for (int k = 0; k < 8; k++)
+        BOOST_CHECK_EQUAL(values[k], k);
+}
+
+BOOST_AUTO_TEST_CASE(TestSourcesAreIndependent)
+{
+    RandomPanelSource first(12, 6, 6, 1234);
+    RandomPanelSource second(12, 6, 6, 1234);
+    RandomPanelSource other(12, 6, 6, 1235);
+    BOOST_CHECK_EQUAL(first.get_seed(), 1234);
+
+    // Drawing from other sources in between changes nothing.
+    std::vector<Panel::Type> board = first.board();
+    std::vector<Panel::Type> lines = Lines(first, 6, 100);
+    other.board();
+    std::vector<Panel::Type> other_board = other.board();
+    Lines(other, 6, 50);
+    BOOST_CHECK(second.board() == board);
+    Lines(other, 6, 50);
+    BOOST_CHECK(Lines(second, 6, 100) == lines);
+    BOOST_CHECK(other_board != board);
+
+    for (const auto type : lines)
+        BOOST_REQUIRE(type >= Panel::Type::RED && type < Panel::Type::RED + 6);
+}
+
+BOOST_AUTO_TEST_CASE(TestBoardLayoutFillsBoard)
+{
+    const int sizes[][2] = {{12, 6}, {11, 6}, {24, 12}, {7, 65}};
+    for (const auto& size : sizes)
+    {
+        const int rows = size[0];
+        const int columns = size[1];
+        const int max = rows == 12 && columns == 6 ? 7 : rows * 7 / 12;
+        const int total = rows == 12 && columns == 6 ? 30 : std::min(rows * columns * 5 / 12, max * columns);
+        for (uint32_t seed = 1; seed <= 50; seed++)
+        {
+            RandomPanelSource source(rows, columns, 5, seed);
+            std::vector<int> layout = source.board_layout();
+            BOOST_REQUIRE_EQUAL((int) layout.size(), columns);
+            int sum = 0;
+            for (const int height : layout)
+            {
+                BOOST_REQUIRE(height >= 0 && height <= max);
+                sum += height;
+            }
+            BOOST_REQUIRE_EQUAL(sum, total);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSeedRegeneratesGame)
+{
+    for (uint32_t seed = 1; seed <= 20; seed++)
+    {
+        PanelTable::Options opts;
+        opts.rows = 12;
+        opts.columns = 6;
+        opts.type = PanelTable::Type::ENDLESS;
+        opts.moves = 0;
+        opts.settings = easy_speed_settings;
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable table(opts);
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable again(opts);
+        table.set_speed(0x800);
+        again.set_speed(0x800);
+
+        BOOST_REQUIRE_EQUAL(table.hash(), again.hash());
+        for (int frame = 0; frame < 2000; frame++)
+        {
+            table.update();
+            again.update();
+        }
+        BOOST_REQUIRE(table.get_lines() > 0);
+        BOOST_REQUIRE_EQUAL(table.hash(), again.hash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFillTimingKeepsGame)
+{
+    for (uint32_t seed = 1; seed <= 20; seed++)
+    {
+        PanelTable::Options opts;
+        // Tall with few colors so many lines are taken and many panels replaced.
+        opts.rows = 100;
+        opts.columns = 6;
+        opts.type = PanelTable::Type::ENDLESS;
+        opts.moves = 0;
+        opts.settings = easy_speed_settings;
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 3, seed);
+        PanelTable table(opts);
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 3, seed);
+        PanelTable again(opts);
+        table.set_speed(0x1000);
+        again.set_speed(0x1000);
+
+        // Lines generated ahead on some frames or never don't change the game.
+        PanelRandom when(seed);
+        for (int frame = 0; frame < 5000 && !table.is_gameover(); frame++)
+        {
+            if (when.next(3) == 0)
+                table.fill_lines();
+            table.update();
+            again.update();
+            BOOST_REQUIRE_EQUAL(table.hash(), again.hash());
+        }
+        BOOST_REQUIRE(table.get_lines() > 30);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestGeneratedBoardsHaveNoMatches)
+{
+    // Few colors and wide boards make the most 3 in a rows to fix.
+    const int sizes[][2] = {{12, 6}, {24, 64}, {64, 8}};
+    for (const auto& size : sizes)
+    {
+        for (int colors = 3; colors <= 6; colors += 3)
+        {
+            for (uint32_t seed = 1; seed <= 20; seed++)
+            {
+                PanelTable::Options opts;
+                opts.rows = size[0];
+                opts.columns = size[1];
+                opts.type = PanelTable::Type::ENDLESS;
+                opts.moves = 0;
+                opts.settings = easy_speed_settings;
+                CountingPanelSource* source = new CountingPanelSource(opts.rows, opts.columns, colors, seed);
+                opts.source = source;
+                PanelTable table(opts);
+                table.set_record_changes(true);
+                table.set_speed(0x1000);
+
+                // Each panel is drawn once and fixed at most once.
+                CheckNoMatches(table);
+                CheckNextHasNoMatches(table);
+                BOOST_REQUIRE(source->redrawn <= source->drawn);
+
+                int lines = 0;
+                for (int frame = 0; frame < 400 && !table.is_gameover(); frame++)
+                {
+                    source->drawn = source->redrawn = 0;
+                    table.update();
+                    if (!table.get_changes().generated)
+                        continue;
+                    lines++;
+                    CheckNextHasNoMatches(table);
+                    BOOST_REQUIRE_EQUAL(source->drawn, opts.columns);
+                    BOOST_REQUIRE(source->redrawn <= opts.columns);
+                }
+                BOOST_REQUIRE(lines > 0);
+            }
+        }
+    }
+
+    // A source with only the default panel_except gets the same guarantees.
+    for (uint32_t seed = 1; seed <= 50; seed++)
+    {
+        PanelTable::Options opts;
+        opts.rows = 12;
+        opts.columns = 16;
+        opts.type = PanelTable::Type::ENDLESS;
+        opts.moves = 0;
+        opts.settings = easy_speed_settings;
+        opts.source = new FewColorsPanelSource(opts.rows, opts.columns, seed);
+        PanelTable table(opts);
+        CheckNoMatches(table);
+        CheckNextHasNoMatches(table);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestPanelExceptGivesUp)
+{
+    OneColorPanelSource source(12, 6);
+    BOOST_CHECK_EQUAL(source.panel_except(1u << Panel::Type::GREEN), Panel::Type::RED);
+    // With only excluded types to give the default implementation stops drawing and the match is made.
+    BOOST_CHECK_EQUAL(source.panel_except(1u << Panel::Type::RED), Panel::Type::RED);
+
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = easy_speed_settings;
+    opts.source = new OneColorPanelSource(opts.rows, opts.columns);
+    PanelTable table(opts);
+    BOOST_CHECK_EQUAL(table.get(opts.rows - 1, 0).get_value(), Panel::Type::RED);
+}
+
+BOOST_AUTO_TEST_CASE(TestQueueKeepsSequence)
+{
+    const int columns = 16;
+    RandomPanelSource source(12, columns, 3, 99);
+    RandomPanelSource queued(12, columns, 3, 99);
+    std::vector<Panel::Type> line(columns);
+    std::vector<Panel::Type> queued_line(columns);
+
+    BOOST_CHECK_EQUAL(queued.queued(), 0);
+    queued.fill();
+    BOOST_CHECK_EQUAL(queued.queued(), PanelSource::QUEUE_LINES);
+
+    PanelRandom when(5);
+    for (int k = 0; k < 200; k++)
+    {
+        // The preview is what gets taken.
+        std::vector<Panel::Type> preview;
+        if (queued.queued() > 0)
+            preview.assign(queued.preview(0), queued.preview(0) + columns);
+
+        const int left = queued.queued();
+        source.take(line);
+        queued.take(queued_line);
+        BOOST_REQUIRE(line == queued_line);
+        BOOST_REQUIRE(preview.empty() || preview == queued_line);
+        BOOST_REQUIRE_EQUAL(queued.queued(), std::max(left - 1, 0));
+
+        for (int j = 2; j < columns; j++)
+            BOOST_REQUIRE(line[j] != line[j - 1] || line[j] != line[j - 2]);
+
+        // Lines are only generated once half of them were taken.
+        if (when.next(3) == 0)
+        {
+            const int before = queued.queued();
+            queued.fill();
+            BOOST_REQUIRE_EQUAL(queued.queued(), before >= PanelSource::QUEUE_LINES / 2 ? before : PanelSource::QUEUE_LINES);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestTableTakesPreviewedLines)
+{
+    PanelTable::Options opts;
+    // Tall enough to take many lines before the board tops out.
+    opts.rows = 100;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = easy_speed_settings;
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 7);
+    PanelTable table(opts);
+    table.set_record_changes(true);
+    table.set_speed(0x1000);
+
+    int taken = 0;
+    int replaced = 0;
+    for (int frame = 0; frame < 10000 && !table.is_gameover(); frame++)
+    {
+        table.fill_lines();
+        BOOST_REQUIRE(table.get_source().queued() > 0);
+        std::vector<Panel::Type> preview(table.get_source().preview(0), table.get_source().preview(0) + opts.columns);
+
+        table.update();
+        if (!table.get_changes().generated)
+            continue;
+
+        // The line comes from the preview unless a panel would have made 3 in a row with the board.
+        taken++;
+        const auto& next = table.get_next();
+        for (int j = 0; j < opts.columns; j++)
+        {
+            if (next[j].get_value() == preview[j])
+                continue;
+            replaced++;
+            BOOST_REQUIRE(Matchable(table, opts.rows - 1, j) && Matchable(table, opts.rows - 2, j));
+            BOOST_REQUIRE_EQUAL(table.get(opts.rows - 1, j).get_value(), preview[j]);
+            BOOST_REQUIRE_EQUAL(table.get(opts.rows - 2, j).get_value(), preview[j]);
+        }
+    }
+    BOOST_CHECK(taken > 30);
+    BOOST_CHECK(replaced < taken * opts.columns / 10);
+}
@@ -0,0 +1,344 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <memory>
+#include <vector>
+#include <panel_table.hpp>
+#include "test_tables.hpp"
+
+class EmptyBoardSource : public PanelSource
+{
+public:
+    EmptyBoardSource(int rows, int columns) : PanelSource(rows, columns) {}
+    ~EmptyBoardSource() override {}
+    std::vector<int> board_layout() override {return std::vector<int>(columns, 0);}
+    Panel::Type panel() override {return Panel::Type::RED;}
+};
+
+/** Empty puzzle board where the state of every panel can be set up before an update. */
+struct StateBoard
+{
+    StateBoard()
+    {
+        PanelTable::Options opts;
+        opts.rows = 12;
+        opts.columns = 6;
+        opts.type = PanelTable::Type::MOVES;
+        opts.moves = 100;
+        opts.settings = test_speed_settings;
+        opts.source = new EmptyBoardSource(opts.rows, opts.columns);
+        table.reset(new PanelTable(opts));
+        table->save_state(snapshot);
+        for (auto& panel : snapshot.panels)
+            panel = PanelSnapshot {Panel::Type::EMPTY, Panel::State::IDLE, 0, 0, 0};
+    }
+
+    void set(int i, int j, Panel::Type type, Panel::State state, int countdown = 0, bool chain = false)
+    {
+        PanelSnapshot& panel = snapshot.panels[i * 6 + j];
+        panel.types = type;
+        panel.flags = state | (chain ? 0x10 : 0);
+        panel.countdown = countdown;
+    }
+
+    void set_match(int i, int j, int match_time, int remove_time)
+    {
+        snapshot.panels[i * 6 + j].match_time = match_time;
+        snapshot.panels[i * 6 + j].remove_time = remove_time;
+    }
+
+    /// Fills the rows from i to the bottom with idle panels.
+    void ground(int i)
+    {
+        for (; i < 12; i++)
+            for (int j = 0; j < 6; j++)
+                set(i, j, (Panel::Type) (1 + (i + j) % 2 + 2 * (i % 2)), Panel::State::IDLE);
+    }
+
+    MatchInfo load_and_update()
+    {
+        BOOST_REQUIRE(table->load_state(snapshot));
+        return table->update();
+    }
+
+    const Panel& get(int i, int j) const {return table->get(i, j);}
+
+    std::unique_ptr<PanelTable> table;
+    PanelTableSnapshot snapshot;
+};
+
+BOOST_AUTO_TEST_CASE(TestSwapCountsDownThenSwapped)
+{
+    StateBoard board;
+    board.ground(6);
+    board.set(5, 0, Panel::Type::RED, Panel::State::LEFT_SWAP, 2);
+    board.set(5, 1, Panel::Type::BLUE, Panel::State::RIGHT_SWAP, 2);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::LEFT_SWAP);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 1);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::RIGHT_SWAP);
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::SWAPPED);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::SWAPPED);
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::IDLE);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::IDLE);
+}
+
+BOOST_AUTO_TEST_CASE(TestSwappedOverHoleStartsFalling)
+{
+    StateBoard board;
+    board.ground(7);
+    board.set(5, 0, Panel::Type::RED, Panel::State::SWAPPED);
+    board.load_and_update();
+
+    const Panel& panel = board.get(5, 0);
+    BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::PENDING_FALL);
+    BOOST_CHECK_EQUAL(panel.get_countdown(), test_speed_settings.pending_fall + test_speed_settings.falling);
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(panel.get_countdown(), test_speed_settings.pending_fall + test_speed_settings.falling - 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingMovesDown)
+{
+    StateBoard board;
+    board.ground(7);
+    board.set(5, 0, Panel::Type::RED, Panel::State::FALLING, 1, true);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_value(), Panel::Type::EMPTY);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::IDLE);
+    BOOST_CHECK(!board.get(5, 0).get_chain());
+    BOOST_CHECK_EQUAL(board.get(6, 0).get_value(), Panel::Type::RED);
+    BOOST_CHECK_EQUAL(board.get(6, 0).get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(board.get(6, 0).get_countdown(), test_speed_settings.falling);
+    BOOST_CHECK(board.get(6, 0).get_chain());
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingCountsDown)
+{
+    StateBoard board;
+    board.ground(7);
+    board.set(5, 0, Panel::Type::RED, Panel::State::FALLING, 3);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingSlipsOntoFallingPanel)
+{
+    StateBoard board;
+    board.ground(8);
+    board.set(5, 0, Panel::Type::RED, Panel::State::FALLING, 1);
+    board.set(6, 0, Panel::Type::BLUE, Panel::State::FALLING, 5);
+    board.load_and_update();
+
+    // The panel below is updated first.
+    BOOST_CHECK_EQUAL(board.get(6, 0).get_countdown(), 4);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(TestLandingBounce)
+{
+    StateBoard board;
+    board.ground(6);
+    board.set(5, 0, Panel::Type::RED, Panel::State::FALLING, 1, true);
+    board.load_and_update();
+
+    const Panel& panel = board.get(5, 0);
+    BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::END_FALL);
+    BOOST_CHECK(panel.get_chain());
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::IDLE_FELL);
+    BOOST_CHECK_EQUAL(panel.get_countdown(), test_speed_settings.idle_fell);
+    BOOST_CHECK(!panel.get_chain());
+
+    for (int frame = 1; frame < test_speed_settings.idle_fell; frame++)
+    {
+        board.table->update();
+        BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::IDLE_FELL);
+    }
+    board.table->update();
+    BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::IDLE);
+}
+
+BOOST_AUTO_TEST_CASE(TestFellIdleFallsAgain)
+{
+    StateBoard board;
+    board.ground(7);
+    board.set(5, 0, Panel::Type::RED, Panel::State::IDLE_FELL, 5);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::PENDING_FALL);
+}
+
+BOOST_AUTO_TEST_CASE(TestMatchSequence)
+{
+    StateBoard board;
+    board.ground(6);
+    board.set(5, 0, Panel::Type::RED, Panel::State::PENDING_MATCH, 1);
+    board.set_match(5, 0, 3, 5);
+    board.set(5, 1, Panel::Type::RED, Panel::State::PENDING_MATCH, 1);
+    board.set_match(5, 1, 5, 5);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 3);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_countdown(), 5);
+
+    // Matched panels count down together.
+    board.table->update();
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 1);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_countdown(), 3);
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::REMOVED);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 2);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_value(), Panel::Type::RED);
+
+    board.table->update();
+    board.table->update();
+    // The last panel removed goes straight to END_MATCH.
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::END_MATCH);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_value(), Panel::Type::EMPTY);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::END_MATCH);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_value(), Panel::Type::EMPTY);
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::IDLE);
+    BOOST_CHECK_EQUAL(board.get(5, 1).get_state(), Panel::State::IDLE);
+}
+
+BOOST_AUTO_TEST_CASE(TestPanelAboveMatchEndFallsWithChain)
+{
+    StateBoard board;
+    board.ground(6);
+    board.set(5, 0, Panel::Type::RED, Panel::State::REMOVED, 1, true);
+    board.set(4, 0, Panel::Type::BLUE, Panel::State::IDLE);
+    board.load_and_update();
+
+    // Panels are updated from the bottom so the panel above sees the END_MATCH.
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::END_MATCH);
+    BOOST_CHECK_EQUAL(board.get(4, 0).get_state(), Panel::State::PENDING_FALL);
+    BOOST_CHECK(board.get(4, 0).get_chain());
+
+    board.table->update();
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::IDLE);
+    BOOST_CHECK(!board.get(5, 0).get_chain());
+    BOOST_CHECK(board.get(4, 0).get_chain());
+}
+
+BOOST_AUTO_TEST_CASE(TestSupportedIdlePanelsStayIdle)
+{
+    StateBoard board;
+    board.ground(6);
+    board.set(5, 2, Panel::Type::GREEN, Panel::State::IDLE);
+    MatchInfo info = board.load_and_update();
+
+    BOOST_CHECK(!info.matched());
+    BOOST_CHECK_EQUAL(board.get(5, 2).get_state(), Panel::State::IDLE);
+    BOOST_CHECK(board.table->all_idle());
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingStackMovesTogether)
+{
+    StateBoard board;
+    board.ground(8);
+    for (int i = 2; i < 6; i++)
+        board.set(i, 0, (Panel::Type) (1 + i % 2), Panel::State::FALLING, 1, i % 2 == 1);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(2, 0).get_value(), Panel::Type::EMPTY);
+    BOOST_CHECK_EQUAL(board.get(2, 0).get_state(), Panel::State::IDLE);
+    BOOST_CHECK(!board.get(2, 0).get_chain());
+    for (int i = 3; i < 7; i++)
+    {
+        const Panel& panel = board.get(i, 0);
+        BOOST_CHECK_EQUAL(panel.get_value(), (Panel::Type) (1 + (i - 1) % 2));
+        BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::FALLING);
+        BOOST_CHECK_EQUAL(panel.get_countdown(), test_speed_settings.falling);
+        BOOST_CHECK_EQUAL(panel.get_chain(), (i - 1) % 2 == 1);
+    }
+
+    board.table->update();
+    board.table->update();
+    for (int i = 4; i < 8; i++)
+    {
+        const Panel& panel = board.get(i, 0);
+        BOOST_CHECK_EQUAL(panel.get_value(), (Panel::Type) (1 + i % 2));
+        BOOST_CHECK_EQUAL(panel.get_state(), Panel::State::END_FALL);
+        BOOST_CHECK_EQUAL(panel.get_chain(), i % 2 == 1);
+    }
+    BOOST_CHECK_EQUAL(board.table->column_height(0), 8);
+
+    board.table->update();
+    for (int i = 4; i < 8; i++)
+    {
+        BOOST_CHECK_EQUAL(board.get(i, 0).get_state(), Panel::State::IDLE_FELL);
+        BOOST_CHECK(!board.get(i, 0).get_chain());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingStackSlipsOntoFallingPanels)
+{
+    StateBoard board;
+    board.ground(8);
+    board.set(3, 0, Panel::Type::RED, Panel::State::FALLING, 1);
+    board.set(4, 0, Panel::Type::GREEN, Panel::State::FALLING, 1);
+    board.set(5, 0, Panel::Type::BLUE, Panel::State::PENDING_FALL, 4);
+    board.load_and_update();
+
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(board.get(5, 0).get_countdown(), 3);
+    for (int i = 3; i < 5; i++)
+    {
+        BOOST_CHECK_EQUAL(board.get(i, 0).get_state(), Panel::State::FALLING);
+        BOOST_CHECK_EQUAL(board.get(i, 0).get_countdown(), 3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestMatchGroups)
+{
+    StateBoard board;
+    board.ground(8);
+    board.set(7, 0, Panel::Type::RED, Panel::State::IDLE);
+    board.set(7, 1, Panel::Type::RED, Panel::State::IDLE);
+    board.set(7, 2, Panel::Type::RED, Panel::State::FALLING, 1, true);
+    board.set(7, 3, Panel::Type::BLUE, Panel::State::IDLE);
+    board.set(7, 4, Panel::Type::BLUE, Panel::State::IDLE);
+    board.set(7, 5, Panel::Type::BLUE, Panel::State::LEFT_SWAP, 1);
+    MatchInfo info = board.load_and_update();
+
+    BOOST_CHECK(info.fall_match);
+    BOOST_CHECK_EQUAL(info.combo, 6);
+    const MatchGroups& groups = board.table->get_match_groups();
+    BOOST_REQUIRE_EQUAL(groups.groups.size(), 2);
+    BOOST_REQUIRE_EQUAL(groups.cells.size(), 6);
+
+    const MatchGroup& red = groups.groups[0];
+    BOOST_CHECK_EQUAL(red.type, Panel::Type::RED);
+    BOOST_CHECK(red.chain);
+    BOOST_CHECK_EQUAL(red.count, 3);
+    for (int k = 0; k < red.count; k++)
+        BOOST_CHECK(groups.cells[red.first + k] == Point(k, 7));
+
+    const MatchGroup& blue = groups.groups[1];
+    BOOST_CHECK_EQUAL(blue.type, Panel::Type::BLUE);
+    BOOST_CHECK(!blue.chain);
+    BOOST_CHECK_EQUAL(blue.count, 3);
+    BOOST_CHECK(groups.cells[blue.first] == Point(3, 7));
+
+    // Only the update that matched fills the groups.
+    board.table->update();
+    BOOST_CHECK(board.table->get_match_groups().empty());
+}
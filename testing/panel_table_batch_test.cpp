@@ -0,0 +1,163 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <panel_table.hpp>
+#include <panel_table_batch.hpp>
+#include "test_tables.hpp"
+
+/// Did the batch and the table report the same match, and where it was if there was one.
+bool SameMatch(const MatchInfo& a, const MatchInfo& b)
+{
+    return SameInfo(a, b) && (a.combo == 0 || (a.x == b.x && a.y == b.y));
+}
+
+/// Does board of the batch hold the same simulation state as the table.
+bool SameBoard(const PanelTableBatch& batch, int board, const PanelTable& table)
+{
+    if (table.height() <= SNAPSHOT_MAX_ROWS && table.width() <= SNAPSHOT_MAX_COLUMNS)
+    {
+        PanelTableSnapshot first;
+        PanelTableSnapshot second;
+        std::memset(&first, 0, sizeof(first));
+        std::memset(&second, 0, sizeof(second));
+        return batch.save_state(board, first) && table.save_state(second) && std::memcmp(&first, &second, sizeof(first)) == 0;
+    }
+
+    // Too big for a snapshot, the panels and the counters are compared.
+    const int panels = table.height() * table.width();
+    for (int index = 0; index < panels + table.width(); index++)
+    {
+        const Panel& panel = index < panels ? table.get_panels()[index] : table.get_next()[index - panels];
+        PanelSnapshot expected;
+        panel.save(expected);
+        const PanelSnapshot actual = batch.panel(board, index);
+        if (std::memcmp(&expected, &actual, sizeof(expected)) != 0)
+            return false;
+    }
+    return batch.get_state(board) == table.get_state() && batch.get_rise(board) == table.get_rise() &&
+        batch.get_rise_counter(board) == table.get_rise_counter() && batch.get_timeout(board) == table.get_timeout() &&
+        batch.get_chain(board) == table.get_chain() && batch.get_clink(board) == table.get_clink() &&
+        batch.get_moves(board) == table.get_moves() && batch.get_lines(board) == table.get_lines();
+}
+
+/** Plays frames frames of type on boards boards of rows x columns, in a batch running kernel and on a table for each board,
+  * with the same random swaps, quick rises and freezes on both. Checks they match every frame, returns the matches seen
+  * and adds the games that ended to gameovers. */
+int PlayBatch(PanelTableBatch::Kernel kernel, PanelTable::Type type, int boards, int frames, int& gameovers, int rows = 12, int columns = 6)
+{
+    PanelTable::Options opts;
+    std::vector<std::unique_ptr<PanelTable>> tables;
+    std::vector<PanelSource*> sources;
+    std::vector<TestRandom> inputs;
+    for (int k = 0; k < boards; k++)
+    {
+        // Tall columns of few colors so panels fall and chain often.
+        TestPanelSource* source;
+        opts = TestTableOptions(type, source, k + 1, rows, columns);
+        source->heights = rows * 2 / 3;
+        source->colors = 4;
+        tables.emplace_back(new PanelTable(opts));
+        tables.back()->set_speed(0x100 << (k % 5));
+
+        TestPanelSource* copy = new TestPanelSource(rows, columns, k + 1);
+        copy->heights = source->heights;
+        copy->colors = source->colors;
+        sources.push_back(copy);
+        inputs.emplace_back(k * 7919 + 1);
+    }
+
+    BOOST_REQUIRE(PanelTableBatch::valid(opts));
+    PanelTableBatch batch(opts, sources);
+    BOOST_REQUIRE(batch.set_kernel(kernel));
+    for (int k = 0; k < boards; k++)
+    {
+        batch.set_speed(k, 0x100 << (k % 5));
+        BOOST_REQUIRE(SameBoard(batch, k, *tables[k]));
+    }
+
+    int matches = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (int k = 0; k < boards; k++)
+        {
+            // Every fourth board is left to rise until the game is over.
+            if (k % 4 != 3 && inputs[k].next(4) == 0)
+            {
+                const int i = inputs[k].next(rows);
+                const int j = inputs[k].next(columns - 1);
+                tables[k]->swap(i, j);
+                batch.swap(k, i, j);
+            }
+            if (inputs[k].next(50) == 0)
+            {
+                tables[k]->quick_rise();
+                batch.quick_rise(k);
+            }
+        }
+
+        const std::vector<MatchInfo>& infos = batch.update();
+        for (int k = 0; k < boards; k++)
+        {
+            const MatchInfo info = tables[k]->update();
+            BOOST_REQUIRE_MESSAGE(SameMatch(infos[k], info), "board " << k << " frame " << frame);
+            if (info.matched())
+            {
+                tables[k]->freeze(info.combo * 10 + info.chain * 20);
+                batch.freeze(k, info.combo * 10 + info.chain * 20);
+                matches++;
+            }
+            BOOST_REQUIRE_MESSAGE(SameBoard(batch, k, *tables[k]), "board " << k << " frame " << frame);
+        }
+    }
+    for (int k = 0; k < boards; k++)
+        gameovers += tables[k]->is_gameover();
+    return matches;
+}
+
+/// Kernels this build and processor run.
+std::vector<PanelTableBatch::Kernel> Kernels()
+{
+    std::vector<PanelTableBatch::Kernel> kernels;
+    for (const auto kernel : {PanelTableBatch::SCALAR, PanelTableBatch::SSE2, PanelTableBatch::AVX2})
+        if (PanelTableBatch::supported(kernel))
+            kernels.push_back(kernel);
+    return kernels;
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchMatchesTables)
+{
+    BOOST_REQUIRE(PanelTableBatch::supported(PanelTableBatch::SCALAR));
+    for (const auto kernel : Kernels())
+    {
+        int gameovers = 0;
+        for (const auto type : {PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES})
+        {
+            // Two blocks of boards and part of a third, whose other boards are left empty.
+            BOOST_CHECK(PlayBatch(kernel, type, 37, 2000, gameovers) > 0);
+        }
+        BOOST_CHECK(gameovers > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchMatchesBigTables)
+{
+    for (const auto kernel : Kernels())
+    {
+        // Too big for a snapshot, each panel is compared.
+        int gameovers = 0;
+        BOOST_CHECK(PlayBatch(kernel, PanelTable::Type::ENDLESS, 5, 1500, gameovers, 24, 8) > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchRejectsLongCountdowns)
+{
+    TestPanelSource* source;
+    PanelTable::Options opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 1);
+    BOOST_CHECK(PanelTableBatch::valid(opts));
+    opts.settings.subsequent_removed = 1000;
+    BOOST_CHECK(!PanelTableBatch::valid(opts));
+    delete source;
+}
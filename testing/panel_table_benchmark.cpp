@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <game_common.hpp>
+#include <panel_table.hpp>
+#include <panel_table_batch.hpp>
+#include <panel_table_pool.hpp>
+#include "test_tables.hpp"
+
+/// Panels of game seed for a benchmark board, columns are up to 2 / 3 full so games last.
+TestPanelSource* BenchmarkSource(int rows, int columns, uint32_t seed)
+{
+    TestPanelSource* source = new TestPanelSource(rows, columns, seed);
+    source->heights = rows * 2 / 3;
+    return source;
+}
+
+/// Plays games until frames have been simulated, returns frames per second.
+double Run(const PanelSpeedSettings& settings, int frames, bool generic)
+{
+    TestRandom input(0xBBB);
+    std::unique_ptr<PanelTable> table;
+    int game = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (!table || table->is_gameover())
+        {
+            PanelTable::Options opts;
+            opts.rows = 12;
+            opts.columns = 6;
+            opts.type = PanelTable::Type::ENDLESS;
+            opts.moves = 0;
+            opts.settings = settings;
+            opts.source = BenchmarkSource(opts.rows, opts.columns, ++game);
+            table.reset(new PanelTable(opts));
+            table->set_speed(0x400);
+            table->set_generic_engine(generic);
+        }
+
+        if (input.next(4) == 0)
+            table->swap(input.next(table->height()), input.next(table->width() - 1));
+        MatchInfo info = table->update();
+        if (info.matched())
+            table->freeze(info.combo * 5 + info.chain * 10);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return frames / elapsed.count();
+}
+
+/// Every panel on a full board is matched at once so most of the time is spent in the panel state machine.
+double RunClear(const PanelSpeedSettings& settings, int frames, bool generic)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::MOVES;
+    opts.moves = 1000;
+    opts.settings = settings;
+    opts.source = BenchmarkSource(opts.rows, opts.columns, 1);
+    PanelTable table(opts);
+    table.set_generic_engine(generic);
+
+    PanelTableSnapshot snapshot;
+    table.save_state(snapshot);
+    const int total = opts.rows * opts.columns;
+    for (int k = 0; k < total; k++)
+    {
+        PanelSnapshot& panel = snapshot.panels[k];
+        panel.types = 1 + k % 5;
+        panel.flags = Panel::State::PENDING_MATCH;
+        panel.match_time = settings.first_removed + (total - 1 - k) * settings.subsequent_removed;
+        panel.remove_time = settings.first_removed + (total - 1) * settings.subsequent_removed;
+        panel.countdown = settings.pending_match;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table.all_idle())
+            table.load_state(snapshot);
+        table.update();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return frames / elapsed.count();
+}
+
+/// Half of the board falls onto the bottom row whenever the board is idle.
+double RunFall(const PanelSpeedSettings& settings, int frames, bool generic)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::MOVES;
+    opts.moves = 1000;
+    opts.settings = settings;
+    opts.source = BenchmarkSource(opts.rows, opts.columns, 1);
+    PanelTable table(opts);
+    table.set_generic_engine(generic);
+
+    PanelTableSnapshot snapshot;
+    table.save_state(snapshot);
+    for (int k = 0; k < opts.rows * opts.columns; k++)
+    {
+        // No matches after the panels land.
+        const int i = k / opts.columns;
+        const uint8_t type = 1 + (i * 2 + k % opts.columns) % 5;
+        PanelSnapshot& panel = snapshot.panels[k];
+        if (i < opts.rows / 2)
+            panel = PanelSnapshot {type, Panel::State::FALLING, 1, 0, 0};
+        else if (i == opts.rows - 1)
+            panel = PanelSnapshot {type, Panel::State::IDLE, 0, 0, 0};
+        else
+            panel = PanelSnapshot {Panel::Type::EMPTY, Panel::State::IDLE, 0, 0, 0};
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table.all_idle())
+            table.load_state(snapshot);
+        table.update();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return frames / elapsed.count();
+}
+
+/** The top half of a board of rows x columns falls onto its bottom row whenever the board is idle, with falling stacks moved as
+  * segments or a panel at a time. Returns nanoseconds per frame, only update is timed. */
+double RunTallFall(int rows, int columns, int frames, bool segments)
+{
+    PanelTable::Options opts;
+    opts.rows = rows;
+    opts.columns = columns;
+    opts.type = PanelTable::Type::MOVES;
+    opts.moves = 1000;
+    opts.settings = normal_speed_settings;
+    opts.source = BenchmarkSource(opts.rows, opts.columns, 1);
+    PanelTable table(opts);
+    table.set_falling_segments(segments);
+
+    // A snapshot only holds a 12 x 6 board so the panels are loaded one at a time.
+    std::vector<PanelSnapshot> board(rows * columns);
+    for (int k = 0; k < rows * columns; k++)
+    {
+        // No matches after the panels land.
+        const int i = k / columns;
+        const uint8_t type = 1 + (i * 2 + k % columns) % 5;
+        PanelSnapshot& panel = board[k];
+        if (i < rows / 2)
+            panel = PanelSnapshot {type, Panel::State::FALLING, 1, 0, 0};
+        else if (i == rows - 1)
+            panel = PanelSnapshot {type, Panel::State::IDLE, 0, 0, 0};
+        else
+            panel = PanelSnapshot {Panel::Type::EMPTY, Panel::State::IDLE, 0, 0, 0};
+    }
+
+    std::chrono::duration<double> elapsed(0);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table.all_idle())
+        {
+            for (int k = 0; k < rows * columns; k++)
+                table.get(k / columns, k % columns).load(board[k]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        table.update();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    return elapsed.count() * 1e9 / frames;
+}
+
+/// Five full width garbage blocks two rows high fall in from above the board whenever the board is idle.
+double RunGarbage(const PanelSpeedSettings& settings, int frames, bool generic)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::MOVES;
+    opts.moves = 1000;
+    opts.settings = settings;
+    opts.source = BenchmarkSource(opts.rows, opts.columns, 1);
+    PanelTable table(opts);
+    table.set_generic_engine(generic);
+
+    PanelTableSnapshot snapshot;
+    table.save_state(snapshot);
+    for (int k = 0; k < opts.rows * opts.columns; k++)
+    {
+        const uint8_t type = k >= (opts.rows - 1) * opts.columns ? 1 + k % 3 : Panel::Type::EMPTY;
+        snapshot.panels[k] = PanelSnapshot {type, Panel::State::IDLE, 0, 0, 0};
+    }
+    table.load_state(snapshot);
+    for (int k = 0; k < 5; k++)
+        table.add_garbage(0, opts.columns, 2);
+    table.save_state(snapshot);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table.all_idle())
+            table.load_state(snapshot);
+        table.update();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return frames / elapsed.count();
+}
+
+/// Evaluates every swap on the states of an endless game, returns microseconds per evaluation.
+double RunEvaluateSwaps(int frames)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = easy_speed_settings;
+    opts.source = BenchmarkSource(opts.rows, opts.columns, 1);
+    std::unique_ptr<PanelTable> table(new PanelTable(opts));
+    table->set_speed(0x400);
+    TestRandom input(0xBBB);
+    SwapEvaluation evaluation;
+    const int repeat = 16;
+
+    std::chrono::duration<double> elapsed(0);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (table->is_gameover())
+        {
+            opts.source = BenchmarkSource(opts.rows, opts.columns, frame);
+            table.reset(new PanelTable(opts));
+            table->set_speed(0x400);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < repeat; k++)
+            table->evaluate_swaps(evaluation);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        if (input.next(4) == 0)
+            table->swap(input.next(table->height()), input.next(table->width() - 1));
+        table->update();
+    }
+
+    return elapsed.count() * 1e6 / (frames * repeat);
+}
+
+/// Plays endless games on a board of any size with swaps in proportion to its area, returns nanoseconds per panel per frame.
+double RunSize(int rows, int columns, int frames)
+{
+    TestRandom input(0xBBB);
+    std::unique_ptr<PanelTable> table;
+    const int swaps = std::max(rows * columns / 72, 1);
+    int game = 0;
+
+    std::chrono::duration<double> elapsed(0);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (!table || table->is_gameover())
+        {
+            PanelTable::Options opts;
+            opts.rows = rows;
+            opts.columns = columns;
+            opts.type = PanelTable::Type::ENDLESS;
+            opts.moves = 0;
+            opts.settings = normal_speed_settings;
+            opts.source = BenchmarkSource(opts.rows, opts.columns, ++game);
+            table.reset(new PanelTable(opts));
+            table->set_speed(0x400);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < swaps; k++)
+        {
+            if (input.next(4) == 0)
+                table->swap(input.next(table->height()), input.next(table->width() - 1));
+        }
+        MatchInfo info = table->update();
+        if (info.matched())
+            table->freeze(info.combo * 5 + info.chain * 10);
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    return elapsed.count() * 1e9 / ((double) frames * table->height() * table->width());
+}
+
+/** Plays boards endless games for frames frames with a table for each board, or in a batch running kernel if it is not negative.
+  * Both get the same swaps and freezes, returns board frames per second. */
+double RunBatch(int boards, int frames, int kernel)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = normal_speed_settings;
+    std::vector<std::unique_ptr<PanelTable>> tables;
+    std::vector<PanelSource*> sources;
+    for (int k = 0; k < boards; k++)
+    {
+        opts.source = BenchmarkSource(opts.rows, opts.columns, k + 1);
+        if (kernel < 0)
+        {
+            tables.emplace_back(new PanelTable(opts));
+            tables.back()->set_speed(0x400);
+        }
+        else
+        {
+            sources.push_back(opts.source);
+        }
+    }
+    std::unique_ptr<PanelTableBatch> batch;
+    if (kernel >= 0)
+    {
+        batch.reset(new PanelTableBatch(opts, sources));
+        batch->set_kernel((PanelTableBatch::Kernel) kernel);
+        for (int k = 0; k < boards; k++)
+            batch->set_speed(k, 0x400);
+    }
+
+    TestRandom input(0xBBB);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (int k = 0; k < boards; k++)
+        {
+            if (input.next(4) != 0)
+                continue;
+            const int i = input.next(opts.rows);
+            const int j = input.next(opts.columns - 1);
+            if (batch)
+                batch->swap(k, i, j);
+            else
+                tables[k]->swap(i, j);
+        }
+        if (batch)
+        {
+            const std::vector<MatchInfo>& infos = batch->update();
+            for (int k = 0; k < boards; k++)
+            {
+                if (infos[k].matched())
+                    batch->freeze(k, infos[k].combo * 5 + infos[k].chain * 10);
+            }
+        }
+        else
+        {
+            for (const auto& table : tables)
+            {
+                MatchInfo info = table->update();
+                if (info.matched())
+                    table->freeze(info.combo * 5 + info.chain * 10);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return (double) boards * frames / elapsed.count();
+}
+
+/// How RunNewGames gets the table for each game.
+enum NewGame
+{
+    CONSTRUCT,
+    POOL,
+    RESET,
+};
+
+/// Starts games on a board of rows x columns and plays a few frames of each, returns tables started per second.
+/// Only starting the games is timed.
+double RunNewGames(int rows, int columns, NewGame how, int games)
+{
+    TestRandom input(0xBBB);
+    PanelTablePool pool;
+    std::unique_ptr<PanelTable> table;
+    PanelTable::Options opts;
+    opts.rows = rows;
+    opts.columns = columns;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = normal_speed_settings;
+
+    std::chrono::duration<double> elapsed(0);
+    for (int game = 0; game < games; game++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (how == CONSTRUCT)
+        {
+            opts.source = BenchmarkSource(rows, columns, game);
+            table.reset(new PanelTable(opts));
+        }
+        else if (how == POOL)
+        {
+            pool.release(std::move(table));
+            opts.source = BenchmarkSource(rows, columns, game);
+            table = pool.acquire(opts);
+        }
+        else
+        {
+            // The source keeps going from one game to the next.
+            opts.source = table ? nullptr : BenchmarkSource(rows, columns, game);
+            if (table)
+                table->reset(opts);
+            else
+                table.reset(new PanelTable(opts));
+        }
+        table->set_speed(0x400);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        for (int frame = 0; frame < 20; frame++)
+        {
+            table->swap(input.next(table->height()), input.next(table->width() - 1));
+            table->update();
+        }
+    }
+
+    return games / elapsed.count();
+}
+
+/// Best of a few runs of a scenario with each engine to reduce noise, the runs alternate so both see the same load.
+void Best(double (*run)(const PanelSpeedSettings&, int, bool), const PanelSpeedSettings& settings, int frames, double& generic, double& fixed)
+{
+    generic = 0;
+    fixed = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        generic = std::max(generic, run(settings, frames, true));
+        fixed = std::max(fixed, run(settings, frames, false));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : 1000000;
+    const struct {const char* name; PanelSpeedSettings settings;} difficulties[] = {
+        {"easy", easy_speed_settings},
+        {"normal", normal_speed_settings},
+        {"hard", hard_speed_settings},
+    };
+
+    const struct {const char* name; double (*run)(const PanelSpeedSettings&, int, bool);} scenarios[] = {
+        {"endless", Run},
+        {"clear", RunClear},
+        {"fall", RunFall},
+        {"garbage", RunGarbage},
+    };
+
+    /* These numbers come from the host build this Makefile produces. Nothing here runs on the 3DS, and the results,
+       e.g. the table driven panel states making the clear scenario about 2.3x faster, are not known to carry over
+       to the ARM11, which has a smaller cache and no out of order execution to hide the branches. */
+    printf("host build, not measured on ARM11\n");
+    /* Each 12 x 6 scenario is played by the engine specialised for the board and settings of its difficulty and again by the
+       engine for boards of any size. */
+    printf("%-16s %16s %16s %8s\n", "", "generic frames/s", "fixed frames/s", "fixed x");
+    for (const auto& scenario : scenarios)
+    {
+        for (const auto& difficulty : difficulties)
+        {
+            double generic, fixed;
+            Best(scenario.run, difficulty.settings, frames, generic, fixed);
+            printf("%-7s %-8s %16.0f %16.0f %8.2f\n", scenario.name, difficulty.name, generic, fixed, fixed / generic);
+        }
+    }
+
+    /* The cost per panel stays flat if the cost of a frame grows linearly with the board.
+       Every frame walks each panel array of the board once, so the work is linear, but the time per panel also depends on
+       where those arrays live. A board keeps a few dozen bytes per panel, so boards up to about 2048 panels fit in a
+       48 KiB L1 and the larger ones run from L2. On the host build (Xeon, 48 KiB L1d, 2 MiB L2) the time per panel
+       stayed within 0.8x to 1.4x of 6 x 12 up to 2304 panels, reached 1.6x at 4096 and 1.9x to 2.2x from 8192 to
+       16384 panels. The growth is the move out of L1, not extra work per panel. */
+    const struct {int columns; int rows;} sizes[] = {{6, 12}, {8, 16}, {12, 24}, {16, 32}, {16, 64}, {24, 96}, {32, 64},
+        {32, 128}, {48, 192}, {64, 128}, {64, 256}};
+    printf("%-16s %8s %16s %10s\n", "columns x rows", "panels", "ns/panel/frame", "x 6 x 12");
+    double base = 0;
+    for (const auto& size : sizes)
+    {
+        const int size_frames = std::max(frames / 10 * 72 / (size.rows * size.columns), 100);
+        double best = 1e9;
+        for (int i = 0; i < 3; i++)
+            best = std::min(best, RunSize(size.rows, size.columns, size_frames));
+        if (base == 0)
+            base = best;
+        printf("%3d x %-10d %8d %16.2f %10.2f\n", size.columns, size.rows, size.rows * size.columns, best, best / base);
+    }
+
+    printf("%-16s %16s %16s %16s\n", "new games", "construct tbl/s", "pool tbl/s", "reset tbl/s");
+    const struct {int columns; int rows;} game_sizes[] = {{6, 12}, {32, 128}};
+    for (const auto& size : game_sizes)
+    {
+        const int games = std::max(frames / 100 * 72 / (size.rows * size.columns), 100);
+        double rates[3] = {0, 0, 0};
+        for (int i = 0; i < 3; i++)
+        {
+            for (int how = CONSTRUCT; how <= RESET; how++)
+                rates[how] = std::max(rates[how], RunNewGames(size.rows, size.columns, (NewGame) how, games));
+        }
+        printf("%3d x %-10d %16.0f %16.0f %16.0f\n", size.columns, size.rows, rates[CONSTRUCT], rates[POOL], rates[RESET]);
+    }
+
+    /* A falling stack moved as a segment costs the same each frame however tall it is, panel by panel it costs its height.
+       On the host build segments took 1.3x less time per frame on 6 x 12, 3.4x on 16 x 64 and 6.4x on 32 x 128, what is left
+       is the scan of the columns for active panels and the landings, which are written out and updated a panel at a time. */
+    printf("%-16s %16s %16s %10s\n", "tall fall", "panels ns/frame", "segments ns/frame", "segments x");
+    const struct {int columns; int rows;} fall_sizes[] = {{6, 12}, {16, 64}, {32, 128}};
+    for (const auto& size : fall_sizes)
+    {
+        const int fall_frames = std::max(frames / 10 * 72 / (size.rows * size.columns), 100);
+        double cells = 1e9, segments = 1e9;
+        for (int i = 0; i < 3; i++)
+        {
+            cells = std::min(cells, RunTallFall(size.rows, size.columns, fall_frames, false));
+            segments = std::min(segments, RunTallFall(size.rows, size.columns, fall_frames, true));
+        }
+        printf("%3d x %-10d %16.0f %16.0f %10.2f\n", size.columns, size.rows, cells, segments, cells / segments);
+    }
+
+    /* Endless games on 12 x 6 with a swap every 4 frames per board, played by a table for each board and by a PanelTableBatch.
+       On the host build the AVX2 kernel played 1.6x the board frames per second of the tables with 16 boards and 2.4x with
+       1024, where the tables no longer fit the cache. SSE2 played 1.1x and 1.6x, the scalar kernel 0.4x and 0.6x as a board
+       at a time it pays for the branch free state machine with nothing to share it. A kernel skips a cell when it is idle or
+       only counting down on all of its boards, with AVX2 about 3 cells in 4, the others cost the whole state machine.
+       Finding the matches and the work done a board at a time are most of what is left. */
+    printf("%-16s %16s %16s %16s %16s\n", "lockstep boards", "tables frames/s", "scalar frames/s", "sse2 frames/s", "avx2 frames/s");
+    const int batch_boards[] = {16, 1024};
+    for (const int boards : batch_boards)
+    {
+        const int batch_frames = std::max(frames / boards, 100);
+        double rates[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 3; i++)
+        {
+            for (int kernel = -1; kernel <= PanelTableBatch::AVX2; kernel++)
+            {
+                if (kernel < 0 || PanelTableBatch::supported((PanelTableBatch::Kernel) kernel))
+                    rates[kernel + 1] = std::max(rates[kernel + 1], RunBatch(boards, batch_frames, kernel));
+            }
+        }
+        printf("%-16d %16.0f %16.0f %16.0f %16.0f\n", boards, rates[0], rates[1], rates[2], rates[3]);
+    }
+
+    double evaluate = 1e9;
+    for (int i = 0; i < 5; i++)
+        evaluate = std::min(evaluate, RunEvaluateSwaps(frames / 100));
+    printf("evaluate_swaps %.2f us\n", evaluate);
+
+    return 0;
+}
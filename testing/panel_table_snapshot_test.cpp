@@ -0,0 +1,160 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include <panel_table.hpp>
+#include "test_tables.hpp"
+
+BOOST_AUTO_TEST_CASE(TestSnapshotIsPlainData)
+{
+    BOOST_CHECK(std::is_trivially_copyable<PanelTableSnapshot>::value);
+    BOOST_CHECK(sizeof(PanelTableSnapshot) <= 1024);
+}
+
+BOOST_AUTO_TEST_CASE(TestSnapshotRejectsOtherDimensions)
+{
+    PanelTable::Options opts;
+    opts.rows = 11;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = test_speed_settings;
+    opts.source = new TestPanelSource(opts.rows, opts.columns, 1);
+    PanelTable small(opts);
+
+    TestPanelSource* source;
+    std::unique_ptr<PanelTable> table(CreateTable(PanelTable::Type::ENDLESS, source, 1, 0x200));
+
+    PanelTableSnapshot snapshot;
+    BOOST_REQUIRE(table->save_state(snapshot));
+    BOOST_CHECK(!small.load_state(snapshot));
+}
+
+BOOST_AUTO_TEST_CASE(TestBoardLimits)
+{
+    TestPanelSource* source;
+    const PanelTable::Options standard = TestTableOptions(PanelTable::Type::ENDLESS, source, 1);
+    PanelTable::Options opts = standard;
+    BOOST_CHECK(PanelTable::valid(opts));
+
+    // A board wider than a matcher row or taller than a cell index holds is refused.
+    opts.columns = MAX_TABLE_COLUMNS + 1;
+    BOOST_CHECK(!PanelTable::valid(opts));
+    opts.columns = 6;
+    opts.rows = MAX_TABLE_ROWS + 1;
+    BOOST_CHECK(!PanelTable::valid(opts));
+
+    // The largest board plays.
+    opts.columns = MAX_TABLE_COLUMNS;
+    opts.rows = MAX_TABLE_ROWS;
+    BOOST_REQUIRE(PanelTable::valid(opts));
+    TestPanelSource* big_source = new TestPanelSource(opts.rows, opts.columns, 1);
+    opts.source = big_source;
+    PanelTable big(opts);
+    BOOST_CHECK_EQUAL(big.width(), MAX_TABLE_COLUMNS);
+    BOOST_CHECK_EQUAL(big.height(), MAX_TABLE_ROWS);
+    TestRandom input(1);
+    for (int frame = 0; frame < 600; frame++)
+    {
+        for (int k = 0; k < 16; k++)
+            big.swap(input.next(big.height()), input.next(big.width() - 1));
+        big.update();
+    }
+    BOOST_CHECK(!big.is_gameover());
+
+    // The board is too big to be saved, and reset refuses a board too big to hold.
+    PanelTableSnapshot snapshot;
+    BOOST_CHECK(!big.save_state(snapshot));
+    opts.source = nullptr;
+    opts.rows = MAX_TABLE_ROWS + 1;
+    BOOST_CHECK(!big.reset(opts));
+    BOOST_CHECK_EQUAL(big.height(), MAX_TABLE_ROWS);
+
+    // Removing every panel at once would overflow the match times.
+    opts = standard;
+    opts.settings.subsequent_removed = INT32_MAX / 64;
+    BOOST_CHECK(!PanelTable::valid(opts));
+
+    // Match times that only fit a table can't be saved.
+    opts.settings.subsequent_removed = INT16_MAX / 8;
+    BOOST_REQUIRE(PanelTable::valid(opts));
+    opts.source = new TestPanelSource(opts.rows, opts.columns, 1);
+    PanelTable slow(opts);
+    BOOST_CHECK(!slow.save_state(snapshot));
+    delete source;
+}
+
+BOOST_AUTO_TEST_CASE(TestRestoreReplaysIdentically)
+{
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES}, 40, 0x200, [](TestGame& game)
+    {
+        Play(*game.table, game.input, 200 + game.seed * 13);
+
+        PanelTableSnapshot snapshot;
+        BOOST_REQUIRE(game.table->save_state(snapshot));
+        const TestRandom saved_input = game.input;
+
+        std::vector<std::vector<int>> expected = Play(*game.table, game.input, 1500);
+
+        // Rollback the same table.
+        BOOST_REQUIRE(game.table->load_state(snapshot));
+        TestRandom input = saved_input;
+        BOOST_REQUIRE(Play(*game.table, input, 1500) == expected);
+
+        // Restore into a different table.
+        std::unique_ptr<PanelTable> other(CreateTable(game.type, game.seed + 1000, 0x200));
+        BOOST_REQUIRE(other->load_state(snapshot));
+        input = saved_input;
+        BOOST_REQUIRE(Play(*other, input, 1500) == expected);
+
+        // Snapshot of a restored table is the same bytes.
+        PanelTableSnapshot copy;
+        std::memset(&copy, 0, sizeof(copy));
+        PanelTableSnapshot original;
+        std::memset(&original, 0, sizeof(original));
+        BOOST_REQUIRE(other->load_state(snapshot));
+        other->save_state(copy);
+        game.table->load_state(snapshot);
+        game.table->save_state(original);
+        BOOST_CHECK(std::memcmp(&copy, &original, sizeof(copy)) == 0);
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestRestoreReplaysQueuedLines)
+{
+    // The lines generated ahead and both sequences of the source are saved with the table.
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = test_speed_settings;
+    for (uint32_t seed = 1234; seed < 1244; seed++)
+    {
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable table(opts);
+        table.set_speed(0x400);
+        TestRandom input(seed);
+        for (int frame = 0; frame < 200; frame++)
+            Play(table, input, 1, frame % 3 != 0);
+
+        PanelTableSnapshot snapshot;
+        BOOST_REQUIRE(table.save_state(snapshot));
+        const TestRandom saved_input = input;
+        const int lines = table.get_lines();
+        std::vector<std::vector<int>> expected = Play(table, input, 1500, true);
+        BOOST_REQUIRE_GT(table.get_lines(), lines);
+
+        BOOST_REQUIRE(table.load_state(snapshot));
+        input = saved_input;
+        BOOST_REQUIRE(Play(table, input, 1500, true) == expected);
+
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed + 1000);
+        PanelTable other(opts);
+        BOOST_REQUIRE(other.load_state(snapshot));
+        input = saved_input;
+        BOOST_REQUIRE(Play(other, input, 1500, true) == expected);
+    }
+}
@@ -0,0 +1,297 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <panel_table.hpp>
+#include "test_tables.hpp"
+
+/// Puzzle table with columns of 4 to 11 panels of 4 colors so most swaps match something.
+PanelTable* CreateTable(uint32_t seed)
+{
+    TestPanelSource* source;
+    PanelTable::Options opts = TestTableOptions(PanelTable::Type::MOVES, source, seed);
+    source->min_height = 4;
+    source->colors = 4;
+    return new PanelTable(opts);
+}
+
+/// Makes the swap on a copy of the table and returns the panels matched when it ends, -1 if the swap was refused.
+int PlaySwap(const PanelTable& table, PanelTable& copy, int i, int j)
+{
+    PanelTableSnapshot snapshot;
+    table.save_state(snapshot);
+    copy.load_state(snapshot);
+
+    copy.swap(i, j);
+    if (copy.get_moves() == table.get_moves())
+        return -1;
+
+    int cleared = 0;
+    for (int frame = 0; frame < test_speed_settings.swap; frame++)
+        cleared += copy.update().combo;
+    return cleared;
+}
+
+BOOST_AUTO_TEST_CASE(TestEvaluateSwapsMatchesPlayedSwaps)
+{
+    SwapEvaluation evaluation;
+    for (uint32_t seed = 1; seed <= 30; seed++)
+    {
+        std::unique_ptr<PanelTable> table(CreateTable(seed));
+        std::unique_ptr<PanelTable> copy(CreateTable(seed + 1000));
+        TestRandom input(seed * 7919);
+
+        for (int move = 0; move < 20 && !table->is_gameover() && !table->is_win(); move++)
+        {
+            // Evaluating does not change the table.
+            PanelTableSnapshot before;
+            PanelTableSnapshot after;
+            std::memset(&before, 0, sizeof(before));
+            std::memset(&after, 0, sizeof(after));
+            table->save_state(before);
+            const uint64_t hash = table->hash();
+            table->evaluate_swaps(evaluation);
+            table->save_state(after);
+            BOOST_REQUIRE(std::memcmp(&before, &after, sizeof(before)) == 0);
+            BOOST_REQUIRE_EQUAL(table->hash(), hash);
+
+            // Nothing else on an idle board changes while a swap happens so the result is exact.
+            const bool idle = table->all_idle();
+            for (int i = 0; i < table->height(); i++)
+            {
+                for (int j = 0; j < table->width() - 1; j++)
+                {
+                    const SwapEvaluation::Swap& swap = evaluation.get(i, j);
+                    const int cleared = PlaySwap(*table, *copy, i, j);
+                    BOOST_REQUIRE_EQUAL(swap.legal, cleared != -1);
+                    if (idle && swap.legal)
+                    {
+                        BOOST_REQUIRE_EQUAL(swap.cleared, cleared);
+                        BOOST_REQUIRE(!swap.chain);
+                    }
+                }
+            }
+
+            table->swap(input.next(table->height()), input.next(table->width() - 1));
+            for (int frame = input.next(3) == 0 ? 1 : 200; frame > 0 && !table->all_idle(); frame--)
+                table->update();
+            table->update();
+        }
+    }
+}
+
+/// Table with a red panel falling with the chain flag onto the ground in column 0 that lands after countdown frames.
+/// Swapping 7, 2 lines up 3 reds with it.
+PanelTable* CreateChainTable(int countdown)
+{
+    PanelTable* table = CreateTable(1);
+    PanelTableSnapshot snapshot;
+    table->save_state(snapshot);
+    for (int k = 0; k < 12 * 6; k++)
+    {
+        // Ground with no matches below row 8.
+        const int i = k / 6;
+        const uint8_t type = i >= 8 ? 1 + (i + k % 6) % 2 + 2 * (i % 2) : Panel::Type::EMPTY;
+        snapshot.panels[k] = PanelSnapshot {type, Panel::State::IDLE, 0, 0, 0};
+    }
+    snapshot.panels[7 * 6 + 0] = PanelSnapshot {Panel::Type::RED, Panel::State::FALLING | 0x10, (int16_t) countdown, 0, 0};
+    snapshot.panels[7 * 6 + 1] = PanelSnapshot {Panel::Type::RED, Panel::State::IDLE, 0, 0, 0};
+    snapshot.panels[7 * 6 + 2] = PanelSnapshot {Panel::Type::BLUE, Panel::State::IDLE, 0, 0, 0};
+    snapshot.panels[7 * 6 + 3] = PanelSnapshot {Panel::Type::RED, Panel::State::IDLE, 0, 0, 0};
+    BOOST_REQUIRE(table->load_state(snapshot));
+    return table;
+}
+
+/// Makes the swap and returns what matched on the frame it ends.
+MatchInfo EndSwap(PanelTable& table, int i, int j)
+{
+    table.swap(i, j);
+    MatchInfo info;
+    for (int frame = 0; frame < test_speed_settings.swap; frame++)
+    {
+        BOOST_REQUIRE(!info.matched());
+        info = table.update();
+    }
+    return info;
+}
+
+BOOST_AUTO_TEST_CASE(TestEvaluateSwapsChain)
+{
+    SwapEvaluation evaluation;
+    const int swap = test_speed_settings.swap;
+
+    // The red panel lands with the chain flag on the frame the swap ends so the match continues the chain.
+    std::unique_ptr<PanelTable> table(CreateChainTable(swap));
+    table->evaluate_swaps(evaluation);
+    BOOST_CHECK(evaluation.get(7, 2).legal);
+    BOOST_CHECK_EQUAL(evaluation.get(7, 2).cleared, 3);
+    BOOST_CHECK(evaluation.get(7, 2).chain);
+    BOOST_CHECK_EQUAL(evaluation.get(7, 1).cleared, 0);
+    // Swapping a panel over the hole makes it fall instead of matching.
+    BOOST_CHECK(evaluation.get(6, 0).legal);
+    BOOST_CHECK_EQUAL(evaluation.get(6, 0).cleared, 0);
+    MatchInfo info = EndSwap(*table, 7, 2);
+    BOOST_CHECK_EQUAL(info.combo, 3);
+    BOOST_CHECK(info.fall_match);
+
+    // Landed before the swap ends, including on the frame it is made, the panel has lost the chain flag by then.
+    for (int landed = 0; landed < swap; landed++)
+    {
+        table.reset(CreateChainTable(landed == 0 ? 1 : swap - landed));
+        if (landed == 0)
+        {
+            BOOST_REQUIRE(!table->update().matched());
+            BOOST_REQUIRE_EQUAL(table->get(7, 0).get_state(), Panel::State::END_FALL);
+            BOOST_REQUIRE(table->get(7, 0).get_chain());
+        }
+        table->evaluate_swaps(evaluation);
+        BOOST_CHECK_EQUAL(evaluation.get(7, 2).cleared, 3);
+        BOOST_CHECK(!evaluation.get(7, 2).chain);
+        info = EndSwap(*table, 7, 2);
+        BOOST_CHECK_EQUAL(info.combo, 3);
+        BOOST_CHECK(!info.fall_match);
+    }
+
+    // Still falling when the swap ends, it matches a frame later.
+    table.reset(CreateChainTable(swap + 1));
+    table->evaluate_swaps(evaluation);
+    BOOST_CHECK_EQUAL(evaluation.get(7, 2).cleared, 0);
+    BOOST_CHECK(!evaluation.get(7, 2).chain);
+    BOOST_CHECK(!EndSwap(*table, 7, 2).matched());
+
+    table->set_moves(0);
+    table->evaluate_swaps(evaluation);
+    BOOST_CHECK(!evaluation.get(7, 2).legal);
+}
+
+/// Snapshot of the table mirrored left to right.
+PanelTableSnapshot Mirror(const PanelTable& table)
+{
+    PanelTableSnapshot snapshot;
+    PanelTableSnapshot mirror;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    table.save_state(snapshot);
+    mirror = snapshot;
+    const int columns = snapshot.columns;
+    for (int k = 0; k < (snapshot.rows + 1) * columns; k++)
+    {
+        const int mirrored = k - k % columns + columns - 1 - k % columns;
+        PanelSnapshot panel = k < snapshot.rows * columns ? snapshot.panels[k] : snapshot.next[k % columns];
+        const int state = panel.flags & 0xF;
+        if (state == Panel::State::LEFT_SWAP || state == Panel::State::RIGHT_SWAP)
+            panel.flags ^= Panel::State::LEFT_SWAP ^ Panel::State::RIGHT_SWAP;
+        if (k < snapshot.rows * columns)
+            mirror.panels[mirrored] = panel;
+        else
+            mirror.next[mirrored % columns] = panel;
+    }
+    return mirror;
+}
+
+BOOST_AUTO_TEST_CASE(TestCanonicalHashMirror)
+{
+    for (uint32_t seed = 1; seed <= 20; seed++)
+    {
+        std::unique_ptr<PanelTable> table(CreateTable(seed));
+        std::unique_ptr<PanelTable> mirror(CreateTable(seed + 1000));
+        TestRandom input(seed * 7919);
+
+        // Including while panels are swapping, falling and matching.
+        for (int frame = 0; frame < 300; frame++)
+        {
+            BOOST_REQUIRE(mirror->load_state(Mirror(*table)));
+            BOOST_REQUIRE_EQUAL(table->canonical_hash(), mirror->canonical_hash());
+            BOOST_REQUIRE_NE(table->hash(), mirror->hash());
+
+            if (input.next(8) == 0)
+                table->swap(input.next(table->height()), input.next(table->width() - 1));
+            table->update();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestLegalSwaps)
+{
+    SwapEvaluation evaluation;
+    std::vector<Point> swaps;
+    for (uint32_t seed = 1; seed <= 20; seed++)
+    {
+        std::unique_ptr<PanelTable> table(CreateTable(seed));
+        TestRandom input(seed * 7919);
+
+        for (int frame = 0; frame < 300; frame++)
+        {
+            // Every legal swap of two different types once, in order.
+            table->evaluate_swaps(evaluation);
+            table->legal_swaps(swaps);
+            std::vector<Point> expected;
+            for (int i = 0; i < table->height(); i++)
+            {
+                for (int j = 0; j < table->width() - 1; j++)
+                {
+                    if (evaluation.get(i, j).legal && table->value(i, j) != table->value(i, j + 1))
+                        expected.emplace_back(j, i);
+                }
+            }
+            BOOST_REQUIRE(swaps == expected);
+
+            if (input.next(8) == 0)
+                table->swap(input.next(table->height()), input.next(table->width() - 1));
+            table->update();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSwapOutsideBoard)
+{
+    std::unique_ptr<PanelTable> table(CreateTable(1));
+    const uint64_t hash = table->hash();
+    const int moves = table->get_moves();
+    const Point outside[] = {{-1, 0}, {0, -1}, {table->width() - 1, 0}, {0, table->height()}, {1000, 1000}, {-1000, -1000}};
+    for (const auto& p : outside)
+        table->swap(p.y, p.x);
+    BOOST_CHECK_EQUAL(table->hash(), hash);
+    BOOST_CHECK_EQUAL(table->get_moves(), moves);
+}
+
+BOOST_AUTO_TEST_CASE(TestLegalSwapsSymmetric)
+{
+    std::unique_ptr<PanelTable> table(CreateTable(1));
+    PanelTableSnapshot snapshot;
+    table->save_state(snapshot);
+    for (int k = 0; k < 12 * 6; k++)
+    {
+        // Rows of R B Y Y B R from row 8 down, no matches.
+        const int i = k / 6;
+        const int j = std::min(k % 6, 5 - k % 6);
+        const uint8_t type = i >= 8 ? 1 + (j + i) % 3 : Panel::Type::EMPTY;
+        snapshot.panels[k] = PanelSnapshot {type, Panel::State::IDLE, 0, 0, 0};
+    }
+    BOOST_REQUIRE(table->load_state(snapshot));
+    BOOST_REQUIRE_EQUAL(table->hash(), table->canonical_hash());
+
+    std::vector<Point> swaps;
+    table->legal_swaps(swaps);
+    // The middle pair is the same type in every row, the right half mirrors the left.
+    std::vector<Point> expected;
+    for (int i = 8; i < 12; i++)
+    {
+        expected.emplace_back(0, i);
+        expected.emplace_back(1, i);
+    }
+    BOOST_CHECK(swaps == expected);
+
+    // Breaking the symmetry brings back the right half.
+    table->swap(11, 0);
+    for (int frame = 0; frame < 20; frame++)
+        table->update();
+    table->legal_swaps(swaps);
+    BOOST_CHECK_EQUAL(swaps.size(), 16u);
+
+    table->set_moves(0);
+    table->legal_swaps(swaps);
+    BOOST_CHECK(swaps.empty());
+}
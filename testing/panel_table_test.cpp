@@ -1,32 +1,65 @@
 #define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
 #include <boost/test/auto_unit_test.hpp>
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <vector>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <board_traits.hpp>
 #include <panel_table.hpp>
+#include <panel_table_pool.hpp>
+#include "baseline_game.hpp"
+#include "test_tables.hpp"
 
-PanelSpeedSettings speed_settings = {1, 1, 1, 1, 1, 1, false};
+PanelSpeedSettings speed_settings = {1, 1, 1, 1, 1, 1, 0};
 
-void set_data(PanelTable& table, const int* data)
+/** Leaves the board empty, the test loads the panels. */
+class EmptyBoardSource : public PanelSource
+{
+public:
+    EmptyBoardSource(int rows, int columns) : PanelSource(rows, columns) {}
+    ~EmptyBoardSource() override {}
+    std::vector<int> board_layout() override {return std::vector<int>(columns, 0);}
+    Panel::Type panel() override {return Panel::Type::RED;}
+};
+
+/** Puzzle table with 100 moves holding the panels of data, the last row of data is the next set of panels.
+  * A swapping board ends its swap on the first update, which checks it for matches. */
+PanelTable* CreateTable(int rows, int columns, const int* data, bool swapping = false)
 {
-    for (unsigned int i = 0; i < table.panels.size(); i++)
-        table.panels[i].value = (Panel::Type) data[i];
+    PanelTable::Options opts;
+    opts.rows = rows;
+    opts.columns = columns;
+    opts.type = PanelTable::Type::MOVES;
+    opts.moves = 100;
+    opts.settings = speed_settings;
+    opts.source = new EmptyBoardSource(rows, columns);
+    PanelTable* table = new PanelTable(opts);
+
+    PanelTableSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    BOOST_REQUIRE(table->save_state(snapshot));
+    const Panel::State state = swapping ? Panel::State::LEFT_SWAP : Panel::State::IDLE;
+    for (int i = 0; i < rows * columns; i++)
+        snapshot.panels[i] = PanelSnapshot {(uint8_t) data[i], (uint8_t) (data[i] ? state : Panel::State::IDLE), (int16_t) (data[i] && swapping), 0, 0};
+    for (int j = 0; j < columns; j++)
+        snapshot.next[j].types = data[rows * columns + j];
+    BOOST_REQUIRE(table->load_state(snapshot));
+    return table;
 }
 
 MatchInfo Update(PanelTable& table)
 {
-    MatchInfo ret = table.update(1, 4, false);
-    //printf("%s\n", ret.str().c_str());
-    //PrintPanelTable(table);
-    return ret;
+    return table.update();
 }
 
 BOOST_AUTO_TEST_CASE(TestFall)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -42,10 +75,8 @@ BOOST_AUTO_TEST_CASE(TestFall)
         1, 0, 0, 0, 0, 0,
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data));
+    PanelTable& table = *created;
 
     table.swap(8, 0);
     BOOST_TEST_CHECKPOINT("Swapping (8,0) and (8,1)");
@@ -55,47 +86,47 @@ BOOST_AUTO_TEST_CASE(TestFall)
 
 
     // Swapping normal->swap
-    BOOST_CHECK_EQUAL(swapee.state, Panel::State::LEFT_SWAP);
-    BOOST_CHECK_EQUAL(swaper.state, Panel::State::RIGHT_SWAP);
+    BOOST_CHECK_EQUAL(swapee.get_state(), Panel::State::LEFT_SWAP);
+    BOOST_CHECK_EQUAL(swaper.get_state(), Panel::State::RIGHT_SWAP);
     Update(table);
 
     BOOST_TEST_CHECKPOINT("Swapped (8,0) and (8,1)");
-    BOOST_CHECK_EQUAL(swapee.state, Panel::State::SWAPPED);
-    BOOST_CHECK_EQUAL(swaper.state, Panel::State::PENDING_FALL);
+    BOOST_CHECK_EQUAL(swapee.get_state(), Panel::State::SWAPPED);
+    BOOST_CHECK_EQUAL(swaper.get_state(), Panel::State::PENDING_FALL);
     Update(table);
 
     BOOST_TEST_CHECKPOINT("Fall (8,1)");
     // swapped -> idle
-    BOOST_CHECK_EQUAL(swapee.state, Panel::State::IDLE);
-    // swapped -> pending fall
-    BOOST_CHECK_EQUAL(swaper.state, Panel::State::PENDING_FALL);
+    BOOST_CHECK_EQUAL(swapee.get_state(), Panel::State::IDLE);
+    // pending fall -> falling
+    BOOST_CHECK_EQUAL(swaper.get_state(), Panel::State::FALLING);
 
-    BOOST_CHECK_EQUAL(swapee.value, Panel::Type::EMPTY);
-    BOOST_CHECK_EQUAL(swaper.value, (Panel::Type) 2);
+    BOOST_CHECK_EQUAL(swapee.get_value(), Panel::Type::EMPTY);
+    BOOST_CHECK_EQUAL(swaper.get_value(), (Panel::Type) 2);
     Update(table);
 
-    // pending fall -> falling
-    BOOST_TEST_CHECKPOINT("Idle (8,1)");
-    BOOST_CHECK_EQUAL(swaper.state, Panel::State::IDLE);
-
-    // normal -> falling
+    // The falling panel moves down a row each frame, leaving an idle empty space.
     BOOST_TEST_CHECKPOINT("Falling (9,1)");
+    BOOST_CHECK_EQUAL(swaper.get_state(), Panel::State::IDLE);
+    BOOST_CHECK_EQUAL(swaper.get_value(), Panel::Type::EMPTY);
     Panel& lower = table.get(9, 1);
-    BOOST_CHECK_EQUAL(lower.state, Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(lower.get_state(), Panel::State::FALLING);
+    BOOST_CHECK_EQUAL(lower.get_value(), (Panel::Type) 2);
 
     Update(table);
-    // fall end -> normal (swaper)
-    BOOST_CHECK_EQUAL(lower.state, Panel::State::IDLE);
+    BOOST_CHECK_EQUAL(lower.get_state(), Panel::State::IDLE);
+    Panel& lower2 = table.get(10, 1);
+    BOOST_CHECK_EQUAL(lower2.get_state(), Panel::State::FALLING);
 
+    // falling -> fall end, landed on the bottom row
     Update(table);
-    Panel& lower2 = table.get(10, 1);
-    BOOST_CHECK_EQUAL(lower2.state, Panel::State::END_FALL);
+    BOOST_CHECK_EQUAL(lower2.get_state(), Panel::State::END_FALL);
 
     Update(table);
-    BOOST_CHECK_EQUAL(lower2.state, Panel::State::IDLE_FELL);
+    BOOST_CHECK_EQUAL(lower2.get_state(), Panel::State::IDLE_FELL);
 
     Update(table);
-    BOOST_CHECK_EQUAL(lower2.state, Panel::State::IDLE);
+    BOOST_CHECK_EQUAL(lower2.get_state(), Panel::State::IDLE);
 
     const int expected[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -116,7 +147,7 @@ BOOST_AUTO_TEST_CASE(TestFall)
     {
         for (int j = 0; j < table.width(); j++)
         {
-            BOOST_CHECK_EQUAL(table.get(i, j).value, expected[j + i * table.width()]);
+            BOOST_CHECK_EQUAL(table.value(i, j), expected[j + i * table.width()]);
         }
     }
 }
@@ -125,7 +156,6 @@ BOOST_AUTO_TEST_CASE(TestStackDown)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -141,10 +171,8 @@ BOOST_AUTO_TEST_CASE(TestStackDown)
         0, 0, 0, 0, 0, 0,
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data));
+    PanelTable& table = *created;
 
     table.swap(9, 0);
 
@@ -162,12 +190,6 @@ BOOST_AUTO_TEST_CASE(TestStackDown)
     for (int i = 0; i < 50; i++)
     {
         Update(table);
-        /*for (int i = 0; i < 72; i++)
-        {
-            printf("%d(%d) ", (int)table.panels[i].value, table.panels[i].state);
-            if (i % 6 == 5) printf("\n");
-        }
-        //printf("\n\n");*/
     }
     const int expected[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -188,17 +210,15 @@ BOOST_AUTO_TEST_CASE(TestStackDown)
     {
         for (int j = 0; j < table.width(); j++)
         {
-            BOOST_CHECK_EQUAL(table.get(i, j).value, expected[j + i * table.width()]);
+            BOOST_CHECK_EQUAL(table.value(i, j), expected[j + i * table.width()]);
         }
     }
 }
 
 BOOST_AUTO_TEST_CASE(TestUpdateMatches)
 {
-    std::unique_ptr<PanelTable> panel_table;
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -214,40 +234,39 @@ BOOST_AUTO_TEST_CASE(TestUpdateMatches)
         1, 1, 1, 0, 1, 1,
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data, true));
+    PanelTable& table = *created;
 
-    table.update_matches();
+    Update(table);
 
     Panel& p1 = table.get(10, 0);
     Panel& p2 = table.get(10, 1);
     Panel& p3 = table.get(10, 2);
 
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::PENDING_MATCH);
 
     Update(table);
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::MATCHED);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::MATCHED);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::MATCHED);
 
     Update(table);
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::REMOVED);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::MATCHED);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::REMOVED);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::MATCHED);
 
     Update(table);
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::REMOVED);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::REMOVED);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::MATCHED);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::REMOVED);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::REMOVED);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::MATCHED);
 
+    // Removing the last panel of the match ends it for all of them.
     Update(table);
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::REMOVED);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::REMOVED);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::REMOVED);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::END_MATCH);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::END_MATCH);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::END_MATCH);
 
     Update(table);
     const int expected[data_size] = {
@@ -269,7 +288,7 @@ BOOST_AUTO_TEST_CASE(TestUpdateMatches)
     {
         for (int j = 0; j < table.width(); j++)
         {
-            BOOST_CHECK_EQUAL(table.get(i, j).value, expected[j + i * table.width()]);
+            BOOST_CHECK_EQUAL(table.value(i, j), expected[j + i * table.width()]);
         }
     }
 }
@@ -280,7 +299,6 @@ BOOST_AUTO_TEST_CASE(TestChains)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -297,12 +315,10 @@ BOOST_AUTO_TEST_CASE(TestChains)
 
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data, true));
+    PanelTable& table = *created;
 
-    MatchInfo a = table.update_matches();
+    MatchInfo a = Update(table);
 
     BOOST_CHECK_EQUAL(a.combo, 3);
     BOOST_CHECK_EQUAL(a.clink, 0);
@@ -316,8 +332,9 @@ BOOST_AUTO_TEST_CASE(TestChains)
     BOOST_CHECK_EQUAL(a.chain, 0);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(!a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 0);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 0);
+    // The match counts towards a clink while it is being removed.
+    BOOST_CHECK_EQUAL(table.get_clink(), 1);
 
     Update(table);
     Update(table);
@@ -330,14 +347,14 @@ BOOST_AUTO_TEST_CASE(TestChains)
     Update(table); // fall
     a = Update(table); // match
     Panel& p = table.get(8, 2);
-    BOOST_CHECK(p.chain);
+    BOOST_CHECK(p.get_chain());
     BOOST_CHECK_EQUAL(a.combo, 3);
     BOOST_CHECK_EQUAL(a.clink, 0);
     BOOST_CHECK_EQUAL(a.chain, 2);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 1);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 1);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 
     Update(table);
     Update(table);
@@ -353,8 +370,8 @@ BOOST_AUTO_TEST_CASE(TestChains)
     BOOST_CHECK_EQUAL(a.chain, 3);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 2);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 2);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 
     Update(table); // matched
     Update(table);
@@ -373,8 +390,8 @@ BOOST_AUTO_TEST_CASE(TestChains)
     BOOST_CHECK_EQUAL(a.chain, 4);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 3);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 3);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 
     Update(table); // matched
     Update(table);
@@ -391,8 +408,8 @@ BOOST_AUTO_TEST_CASE(TestChains)
     BOOST_CHECK_EQUAL(a.chain, 5);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 4);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 4);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 
     Update(table); // matched
     Update(table);
@@ -410,15 +427,14 @@ BOOST_AUTO_TEST_CASE(TestChains)
     BOOST_CHECK_EQUAL(a.chain, 0);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(!a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 0);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 0);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 }
 
 BOOST_AUTO_TEST_CASE(TestGapNoMatch)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -435,25 +451,22 @@ BOOST_AUTO_TEST_CASE(TestGapNoMatch)
 
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data, true));
+    PanelTable& table = *created;
 
-    table.update_matches();
+    Update(table);
 
     Panel& p1 = table.get(10, 2);
     Panel& p2 = table.get(9, 2);
     Panel& p3 = table.get(8, 2);
 
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::PENDING_MATCH);
 
     Update(table); // matched
     Update(table); // removed, matched, matched
     Update(table); // removed, removed, matched
-    Update(table); // removed, removed, removed
     Update(table); // end_match
     Update(table); // idle
     table.swap(9, 2);
@@ -484,7 +497,7 @@ BOOST_AUTO_TEST_CASE(TestGapNoMatch)
     {
         for (int j = 0; j < table.width(); j++)
         {
-            BOOST_CHECK_EQUAL(table.get(i, j).value, expected[j + i * table.width()]);
+            BOOST_CHECK_EQUAL(table.value(i, j), expected[j + i * table.width()]);
         }
     }
 }
@@ -494,7 +507,6 @@ BOOST_AUTO_TEST_CASE(TestSkillChainSlip)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -511,25 +523,22 @@ BOOST_AUTO_TEST_CASE(TestSkillChainSlip)
 
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data, true));
+    PanelTable& table = *created;
 
-    table.update_matches();
+    Update(table);
 
     Panel& p1 = table.get(10, 2);
     Panel& p2 = table.get(9, 2);
     Panel& p3 = table.get(8, 2);
 
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::PENDING_MATCH);
 
     Update(table); // matched
     Update(table); // removed, matched, matched
     Update(table); // removed, removed, matched
-    Update(table); // removed, removed, removed
     Update(table); // end_match
     Update(table); // idle
     table.swap(9, 2);
@@ -543,15 +552,14 @@ BOOST_AUTO_TEST_CASE(TestSkillChainSlip)
     BOOST_CHECK_EQUAL(a.chain, 2);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 1);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 1);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
 }
 
 BOOST_AUTO_TEST_CASE(TestSkillChainSlip2)
 {
     const int columns = 6;
     const int rows = 11;
-    const int colors = 6;
     const int data_size = columns * (rows + 1);
     const int data[data_size] = {
         0, 0, 0, 0, 0, 0,
@@ -568,27 +576,25 @@ BOOST_AUTO_TEST_CASE(TestSkillChainSlip2)
 
         8, 8, 8, 8, 8, 8,
     };
-    PanelTable table(rows, columns, colors, speed_settings);
-    set_data(table, data);
-    table.type = PanelTable::Type::PUZZLE;
-    table.moves = 100;
+    std::unique_ptr<PanelTable> created(CreateTable(rows, columns, data, true));
+    PanelTable& table = *created;
 
-    table.update_matches();
+    Update(table);
 
     Panel& p1 = table.get(10, 2);
     Panel& p2 = table.get(9, 2);
     Panel& p3 = table.get(8, 2);
 
-    BOOST_CHECK_EQUAL(p1.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p2.state, Panel::State::PENDING_MATCH);
-    BOOST_CHECK_EQUAL(p3.state, Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p1.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p2.get_state(), Panel::State::PENDING_MATCH);
+    BOOST_CHECK_EQUAL(p3.get_state(), Panel::State::PENDING_MATCH);
 
     Update(table); // matched
     Update(table); // removed, matched, matched
     Update(table); // removed, removed, matched
-    Update(table); // removed, removed, removed
     Update(table); // end_match
     Update(table); // idle
+    Update(table); // falling
     table.swap(10, 2);
     Update(table); // swapped / fall end
 
@@ -598,6 +604,757 @@ BOOST_AUTO_TEST_CASE(TestSkillChainSlip2)
     BOOST_CHECK_EQUAL(a.chain, 2);
     BOOST_CHECK(!a.swap_match);
     BOOST_CHECK(a.fall_match);
-    BOOST_CHECK_EQUAL(table.chain, 1);
-    BOOST_CHECK_EQUAL(table.clink, 0);
+    BOOST_CHECK_EQUAL(table.get_chain(), 1);
+    BOOST_CHECK_EQUAL(table.get_clink(), 0);
+}
+
+/** A game record_baseline_games recorded from the PanelTable of the first commit. */
+struct BaselineGame
+{
+    int type;
+    int rows;
+    int columns;
+    int heights;
+    int speed;
+    int frames;
+    uint32_t seed;
+    /// Board the table made
+    std::vector<Panel::Type> board;
+    /// Every set of next panels the table made in order
+    std::vector<std::vector<Panel::Type>> lines;
+    /// Digests of the game after a number of frames
+    std::vector<std::pair<int, uint64_t>> digests;
+    /// Frames played before the game ended
+    int played;
+};
+
+/// Reads the games of a fixture, tests run from the testing directory.
+std::vector<BaselineGame> ReadBaselineGames(const std::string& path)
+{
+    std::vector<BaselineGame> games;
+    std::ifstream file(path);
+    BOOST_REQUIRE_MESSAGE(file, "missing fixture " << path);
+
+    std::string tag;
+    while (file >> tag)
+    {
+        if (tag == "game")
+        {
+            games.emplace_back();
+            BaselineGame& game = games.back();
+            file >> game.type >> game.rows >> game.columns >> game.heights >> game.speed >> game.frames >> game.seed;
+            continue;
+        }
+
+        BOOST_REQUIRE(!games.empty());
+        BaselineGame& game = games.back();
+        int value;
+        if (tag == "board" || tag == "line")
+        {
+            std::vector<Panel::Type> types(tag == "board" ? game.rows * game.columns : game.columns);
+            for (auto& type : types)
+            {
+                file >> value;
+                type = (Panel::Type) value;
+            }
+            if (tag == "board")
+                game.board = types;
+            else
+                game.lines.push_back(types);
+        }
+        else if (tag == "digest")
+        {
+            std::string digest;
+            file >> value >> digest;
+            game.digests.emplace_back(value, std::stoull(digest, nullptr, 16));
+        }
+        else if (tag == "end")
+        {
+            file >> game.played;
+        }
+        else
+        {
+            BOOST_FAIL("bad fixture tag " << tag);
+        }
+        BOOST_REQUIRE(file);
+    }
+    return games;
+}
+
+/** Gives the table the board and the lines of a recorded game, which were made without drawing any other panel. */
+class FixtureSource : public PanelSource
+{
+public:
+    FixtureSource(const BaselineGame& recorded) : PanelSource(recorded.rows, recorded.columns), game(recorded) {}
+    ~FixtureSource() override {}
+    std::vector<Panel::Type> board() override {return game.board;}
+    Panel::Type panel() override {draws++; return Panel::Type::RED;}
+    Panel::Type panel_except(uint32_t /*excluded*/) override {draws++; return Panel::Type::RED;}
+    void line(std::vector<Panel::Type>& next) override
+    {
+        // Past the recorded lines the table only asks for lines ahead, they alternate two types.
+        for (int j = 0; j < columns; j++)
+            next[j] = taken < game.lines.size() ? game.lines[taken][j] : (Panel::Type) (1 + j % 2);
+        taken++;
+    }
+
+    const BaselineGame& game;
+    /// Lines given to the table
+    unsigned int taken = 0;
+    /// Panels drawn outside of the recording
+    int draws = 0;
+};
+
+/// Adds the table after a frame to digest as record_baseline_games does, reading it from a snapshot.
+void DigestSnapshot(const PanelTable& table, const MatchInfo& info, GameDigest& digest)
+{
+    PanelTableSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    BOOST_REQUIRE(table.save_state(snapshot));
+
+    const int size = table.height() * table.width();
+    for (int i = 0; i < size + table.width(); i++)
+    {
+        const PanelSnapshot& panel = i < size ? snapshot.panels[i] : snapshot.next[i - size];
+        DigestPanel(digest, panel.types & 0xF, panel.types >> 4, panel.flags & 0xF, panel.flags & 0x10, panel.flags & 0x20, panel.countdown,
+                    panel.match_time, panel.remove_time);
+    }
+    DigestTable(digest, snapshot.state, snapshot.stopped, snapshot.moves, snapshot.rise_counter, snapshot.rise, snapshot.speed,
+                snapshot.timeout, snapshot.clink, snapshot.chain, snapshot.lines);
+    DigestMatch(digest, info);
+}
+
+/** Plays every game of the fixture at path again with the same input, checking each digest recorded from the first PanelTable
+  * and that the game ends on the same frame with the recorded lines. Returns the games. */
+std::vector<BaselineGame> PlayBaselineGames(const std::string& path)
+{
+    std::vector<BaselineGame> games = ReadBaselineGames(path);
+    for (const auto& game : games)
+    {
+        FixtureSource* source = new FixtureSource(game);
+        PanelTable::Options opts;
+        opts.rows = game.rows;
+        opts.columns = game.columns;
+        opts.type = (PanelTable::Type) game.type;
+        opts.moves = 1000;
+        opts.settings = BASELINE_SPEED_SETTINGS;
+        opts.source = source;
+        PanelTable table(opts);
+        table.set_speed(game.speed);
+        BaselineRandom input(game.seed * 7919);
+
+        GameDigest digest;
+        DigestSnapshot(table, MatchInfo(), digest);
+        auto recorded = game.digests.begin();
+        int played = 0;
+        while (true)
+        {
+            if (recorded != game.digests.end() && recorded->first == played)
+            {
+                BOOST_REQUIRE_MESSAGE(digest.value == recorded->second, path << " type " << game.type << " seed " << game.seed <<
+                                      " differs from the baseline within the " << BASELINE_DIGEST_FRAMES << " frames before frame " << played);
+                ++recorded;
+            }
+            if (played >= game.frames || table.is_gameover())
+                break;
+
+            const MatchInfo info = PlayBaselineFrame(table, input);
+            played++;
+            DigestSnapshot(table, info, digest);
+        }
+
+        BOOST_CHECK_EQUAL(played, game.played);
+        BOOST_CHECK(recorded == game.digests.end());
+        BOOST_CHECK_EQUAL(source->taken, game.lines.size());
+        BOOST_CHECK_EQUAL(source->draws, 0);
+    }
+    return games;
+}
+
+BOOST_AUTO_TEST_CASE(TestBoardShapesMatchBaseline)
+{
+    // Panel views find their neighbours from the index, so boards of every width are played.
+    BOOST_CHECK_EQUAL(PlayBaselineGames("fixtures/board_shapes.txt").size(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(TestActivePanelsMatchBaseline)
+{
+    // Tall boards so swaps start falls and chains up whole columns, only the active panels are updated.
+    BOOST_CHECK_EQUAL(PlayBaselineGames("fixtures/tall_stacks.txt").size(), 30);
+}
+
+BOOST_AUTO_TEST_CASE(TestRingWrapMatchesBaseline)
+{
+    // The ring buffer of types holds the rows and the next set of panels, the games rise more lines than it holds.
+    for (const auto& game : PlayBaselineGames("fixtures/ring_wrap.txt"))
+        BOOST_CHECK_GT(game.lines.size(), 12 + 1 + 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestSpecialisedEngineMatchesGeneric)
+{
+    // 12x6 boards with a preset use an engine with the size and settings compiled in, it must play as the generic one does.
+    for (const auto& settings : {EasySpeed::settings(), NormalSpeed::settings(), HardSpeed::settings()})
+    {
+        for (const auto type : {PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES})
+        {
+            for (uint32_t seed = 1; seed <= 4; seed++)
+            {
+                TestPanelSource* source;
+                PanelTable::Options opts = TestTableOptions(type, source, seed);
+                opts.settings = settings;
+                PanelTable fixed(opts);
+                opts = TestTableOptions(type, source, seed);
+                opts.settings = settings;
+                PanelTable generic(opts);
+                generic.set_generic_engine(true);
+                BOOST_REQUIRE(fixed.is_specialised());
+                BOOST_REQUIRE(!generic.is_specialised());
+                fixed.set_speed(0x400);
+                generic.set_speed(0x400);
+
+                TestRandom fixed_input(seed * 7919);
+                TestRandom generic_input(seed * 7919);
+                for (int frame = 0; frame < 3000 && !fixed.is_gameover(); frame++)
+                {
+                    BOOST_REQUIRE(Play(fixed, fixed_input, 1) == Play(generic, generic_input, 1));
+                    BOOST_REQUIRE(SameState(fixed, generic));
+                    BOOST_REQUIRE_EQUAL(fixed.hash(), generic.hash());
+                }
+                BOOST_CHECK(generic.is_gameover() == fixed.is_gameover());
+            }
+        }
+    }
+
+    // Every other size or settings falls back to the generic engine.
+    TestPanelSource* source;
+    PanelTable::Options opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 1, 11, 6);
+    opts.settings = EasySpeed::settings();
+    BOOST_CHECK(!PanelTable(opts).is_specialised());
+    opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 1, 12, 5);
+    opts.settings = EasySpeed::settings();
+    BOOST_CHECK(!PanelTable(opts).is_specialised());
+    opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 1);
+    opts.settings.idle_fell++;
+    BOOST_CHECK(!PanelTable(opts).is_specialised());
+}
+
+/** Plays a frame of random input as Play does without reading the board, so falling segments are only written out when they land
+  * or a swap needs them. Garbage is dropped now and then if garbage is set. */
+MatchInfo PlayUnread(PanelTable& table, TestRandom& input, bool garbage)
+{
+    if (input.next(16) == 0)
+        table.swap(input.next(table.height()), input.next(table.width() - 1));
+    if (input.next(50) == 0)
+        table.quick_rise();
+    if (garbage && input.next(400) == 0)
+        table.add_garbage(0, table.width(), 1);
+    MatchInfo info = table.update();
+    if (info.matched())
+        table.freeze(info.combo * 10 + info.chain * 20);
+    return info;
+}
+
+BOOST_AUTO_TEST_CASE(TestFallingSegmentsMatchPanels)
+{
+    // Reading the board writes the segments out, so the boards are only compared every few frames.
+    long segment_frames = 0;
+    const struct {int rows; int columns;} sizes[] = {{12, 6}, {24, 8}, {40, 4}};
+    for (const auto& size : sizes)
+    {
+        for (const auto type : {PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES})
+        {
+            for (uint32_t seed = 1; seed <= 10; seed++)
+            {
+                // Tall stacks so clears drop them far.
+                TestPanelSource* source;
+                PanelTable::Options opts = TestTableOptions(type, source, seed, size.rows, size.columns);
+                source->heights = size.rows * 2 / 3;
+                PanelTable segments(opts);
+                opts = TestTableOptions(type, source, seed, size.rows, size.columns);
+                source->heights = size.rows * 2 / 3;
+                PanelTable panels(opts);
+                panels.set_falling_segments(false);
+                segments.set_speed(0x400);
+                panels.set_speed(0x400);
+
+                TestRandom segments_input(seed * 7919);
+                TestRandom panels_input(seed * 7919);
+                TestRandom checks(seed);
+                const bool garbage = type == PanelTable::Type::VERSUS;
+                int check = 0;
+                for (int frame = 0; frame < 3000 && !panels.is_gameover(); frame++)
+                {
+                    const MatchInfo info = PlayUnread(segments, segments_input, garbage);
+                    BOOST_REQUIRE(SameInfo(info, PlayUnread(panels, panels_input, garbage)));
+                    BOOST_REQUIRE_EQUAL(panels.falling_segments(), 0);
+                    segment_frames += segments.falling_segments();
+                    if (frame == check || panels.is_gameover())
+                    {
+                        BOOST_REQUIRE_MESSAGE(Signature(segments, info) == Signature(panels, info), "rows " << size.rows << " type " << type <<
+                                              " seed " << seed << " frame " << frame);
+                        BOOST_REQUIRE_EQUAL(segments.hash(), panels.hash());
+                        BOOST_REQUIRE(segments.get_garbage().size() == panels.get_garbage().size());
+                        check = frame + 1 + checks.next(30);
+                    }
+                }
+                BOOST_CHECK(segments.is_gameover() == panels.is_gameover());
+            }
+        }
+    }
+    // Stacks fell as segments for many frames between reads.
+    BOOST_CHECK_GT(segment_frames, 10000);
+}
+
+BOOST_AUTO_TEST_CASE(TestAdvanceMatchesUpdate)
+{
+    long stepped = 0;
+    long skipped = 0;
+    for (const int speed : {0x20, 0x200, 0x1000})
+    {
+        ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES}, 20, speed, [&](TestGame& game)
+        {
+            PanelTable& actual = *game.table;
+            std::unique_ptr<PanelTable> expected(CreateTable(game.type, game.seed, speed));
+            TestRandom& input = game.input;
+
+            for (int round = 0; round < 20 && !expected->is_gameover(); round++)
+            {
+                // A burst of input to start falls, swaps, matches and timeouts.
+                int burst = input.next(60);
+                for (int frame = 0; frame < burst; frame++)
+                {
+                    if (input.next(3) == 0)
+                    {
+                        int i = input.next(expected->height());
+                        int j = input.next(expected->width() - 1);
+                        expected->swap(i, j);
+                        actual.swap(i, j);
+                    }
+                    MatchInfo info = expected->update();
+                    BOOST_REQUIRE(SameInfo(info, actual.update()));
+                    if (info.matched())
+                    {
+                        expected->freeze(info.combo * 10 + info.chain * 20);
+                        actual.freeze(info.combo * 10 + info.chain * 20);
+                    }
+                }
+
+                // Then a stretch without input.
+                int remaining = input.next(400);
+                while (remaining > 0 && !expected->is_gameover())
+                {
+                    int frames = actual.advance_until_event(remaining);
+                    BOOST_REQUIRE(frames >= 0 && frames <= remaining);
+                    for (int frame = 0; frame < frames; frame++)
+                        BOOST_REQUIRE(!expected->update().matched());
+                    BOOST_REQUIRE(SameState(*expected, actual));
+                    skipped += frames;
+                    remaining -= frames;
+
+                    if (remaining > 0)
+                    {
+                        BOOST_REQUIRE(SameInfo(expected->update(), actual.update()));
+                        BOOST_REQUIRE(SameState(*expected, actual));
+                        stepped++;
+                        remaining--;
+                    }
+                }
+            }
+        });
+    }
+
+    BOOST_TEST_MESSAGE("Skipped " << skipped << " frames, stepped " << stepped << " frames");
+    BOOST_CHECK(skipped > stepped);
+}
+
+BOOST_AUTO_TEST_CASE(TestQuietFramesMatchAdvance)
+{
+    ForEachGame({PanelTable::Type::ENDLESS}, 20, 0x200, [](TestGame& game)
+    {
+        PlayFrames(game, 1000, [&](const std::vector<int>&)
+        {
+            // Counting the frames does not change the table.
+            const uint64_t hash = game.table->hash();
+            const int quiet = game.table->quiet_frames(100);
+            BOOST_REQUIRE_EQUAL(game.table->hash(), hash);
+            BOOST_REQUIRE_EQUAL(game.table->advance_until_event(100), quiet);
+        });
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestAdvanceStopsAtTimeout)
+{
+    std::unique_ptr<PanelTable> table(CreateTable(PanelTable::Type::ENDLESS, 3, 0x200));
+    // Let the initial board settle.
+    for (int frame = 0; frame < 100; frame++)
+        table->update();
+
+    table->freeze(50);
+    int frames = table->advance_until_event(1000);
+    BOOST_CHECK(frames <= 50);
+    BOOST_CHECK_EQUAL(table->get_timeout(), 50 - frames);
+    BOOST_CHECK_EQUAL(table->advance_until_event(0), 0);
+}
+
+/// Checks every aggregate against a scan of the board.
+void CheckAggregates(const PanelTable& table)
+{
+    bool idle = true;
+    bool second_row = false;
+    int first_filled = table.height();
+    for (int j = 0; j < table.width(); j++)
+    {
+        int height = 0;
+        for (int i = table.height() - 1; i >= 0; i--)
+        {
+            if (!table.empty(i, j))
+            {
+                height = table.height() - i;
+                first_filled = std::min(first_filled, i);
+                second_row = second_row || i == 1;
+            }
+            const Panel& panel = table.get(i, j);
+            idle = idle && panel.is_idle();
+        }
+        BOOST_REQUIRE_EQUAL(table.column_height(j), height);
+        BOOST_REQUIRE_EQUAL(table.danger_column(j), !table.empty(0, j));
+    }
+
+    BOOST_REQUIRE_EQUAL(table.first_filled_row(), first_filled);
+    BOOST_REQUIRE_EQUAL(table.danger(), first_filled == 0);
+    BOOST_REQUIRE_EQUAL(table.warning(), second_row);
+    BOOST_REQUIRE_EQUAL(table.all_idle(), idle);
+}
+
+BOOST_AUTO_TEST_CASE(TestAggregatesFollowBoard)
+{
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES}, 20, 0x800, [](TestGame& game)
+    {
+        PanelTable& table = *game.table;
+        CheckAggregates(table);
+        PlayFrames(game, 3000, [&](const std::vector<int>&) {CheckAggregates(table);});
+
+        PanelTableSnapshot snapshot;
+        table.save_state(snapshot);
+        table.clear();
+        CheckAggregates(table);
+        table.load_state(snapshot);
+        CheckAggregates(table);
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestAggregatesFollowLargeBoard)
+{
+    // More than 64 rows so the row sets take more than one word, and the widest board the row masks allow.
+    // The smallest boards have no panel below the bottom row and no panel to swap with.
+    const int sizes[][2] = {{100, 64}, {65, 7}, {200, 3}, {1, 6}, {12, 1}, {1, 1}, {2, 2}};
+    for (const auto& size : sizes)
+    {
+        TestPanelSource* source;
+        PanelTable::Options opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 0xCCC, size[0], size[1]);
+        source->heights = std::max(opts.rows * 2 / 3, 1);
+        PanelTable table(opts);
+        table.set_speed(0x800);
+        TestRandom input(0xCCC * 7919);
+
+        CheckAggregates(table);
+        for (int frame = 0; frame < 600 && !table.is_gameover(); frame++)
+        {
+            for (int k = 0; k < std::max(opts.rows * opts.columns / 72, 1) && table.width() > 1; k++)
+                table.swap(input.next(table.height()), input.next(table.width() - 1));
+            if (input.next(40) == 0)
+                table.quick_rise();
+            table.update();
+            CheckAggregates(table);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestHashFollowsState)
+{
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::MOVES}, 10, 0x200, [](TestGame& game)
+    {
+        std::unique_ptr<PanelTable> other(CreateTable(game.type, game.seed + 1000, 0x200));
+        uint64_t last = game.table->hash();
+        std::vector<int> last_signature;
+        PlayFrames(game, 1000, [&](std::vector<int> signature)
+        {
+            // The hash kept up to date every frame is the same as one built from the restored state.
+            PanelTableSnapshot snapshot;
+            BOOST_REQUIRE(game.table->save_state(snapshot));
+            BOOST_REQUIRE(other->load_state(snapshot));
+            BOOST_REQUIRE_EQUAL(game.table->hash(), other->hash());
+
+            signature.resize(signature.size() - 3);
+            if (signature != last_signature)
+                BOOST_REQUIRE(game.table->hash() != last);
+            last = game.table->hash();
+            last_signature = signature;
+        });
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestChangesCoverStateDiff)
+{
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::MOVES}, 10, 0x200, [](TestGame& game)
+    {
+        PanelTable& table = *game.table;
+        table.set_record_changes(true);
+        const int size = (table.height() + 1) * table.width();
+        int rises = 0;
+        int generations = 0;
+        int lines = table.get_lines();
+
+        PanelTableSnapshot before;
+        BOOST_REQUIRE(table.save_state(before));
+        PlayFrames(game, 1000, [&](const std::vector<int>&)
+        {
+            PanelTableSnapshot after;
+            BOOST_REQUIRE(table.save_state(after));
+
+            const ChangeSet& changes = table.get_changes();
+            BOOST_REQUIRE_EQUAL(changes.rose, table.get_lines() != lines);
+            std::vector<int> listed(size, 0);
+            for (int cell : changes.cells)
+                BOOST_REQUIRE_EQUAL(listed[cell]++, 0);
+
+            // Every panel moves when the board rises so the diff is only exact for the other frames.
+            rises += changes.rose;
+            generations += changes.generated;
+            if (!changes.rose)
+            {
+                for (int k = 0; k < size; k++)
+                {
+                    const PanelSnapshot& old_panel = k < size - table.width() ? before.panels[k] : before.next[k % table.width()];
+                    const PanelSnapshot& new_panel = k < size - table.width() ? after.panels[k] : after.next[k % table.width()];
+                    if ((old_panel.types & 0xF) != (new_panel.types & 0xF) || (old_panel.flags & 0xF) != (new_panel.flags & 0xF))
+                        BOOST_REQUIRE(listed[k]);
+                }
+            }
+            before = after;
+            lines = table.get_lines();
+        });
+        // The next set of panels is generated by the update after a rise.
+        BOOST_CHECK_EQUAL(rises > 0, game.type == PanelTable::Type::ENDLESS);
+        BOOST_CHECK(generations == rises || generations == rises - 1);
+    });
+
+    // Nothing is recorded unless asked.
+    std::unique_ptr<PanelTable> table(CreateTable(PanelTable::Type::ENDLESS, 1, 0x200));
+    TestRandom input(1);
+    Play(*table, input, 100);
+    BOOST_CHECK(table->get_changes().cells.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestMatchGroupsCoverMatch)
+{
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES}, 10, 0x200, [](TestGame& game)
+    {
+        const PanelTable& table = *game.table;
+        PlayFrames(game, 1000, [&](const std::vector<int>& signature)
+        {
+            // The groups split the panels the update matched, each of them was just matched and is of the group's type.
+            const MatchGroups& groups = table.get_match_groups();
+            const int combo = signature[signature.size() - 3];
+            BOOST_REQUIRE_EQUAL(groups.cells.size(), combo);
+            int cells = 0;
+            for (const auto& group : groups.groups)
+            {
+                BOOST_REQUIRE_EQUAL(group.first, cells);
+                BOOST_REQUIRE_GE(group.count, 3);
+                for (int k = group.first; k < group.first + group.count; k++)
+                {
+                    const Point& cell = groups.cells[k];
+                    BOOST_REQUIRE_EQUAL(table.value(cell.y, cell.x), group.type);
+                    BOOST_REQUIRE_EQUAL(table.get(cell.y, cell.x).get_state(), Panel::State::PENDING_MATCH);
+                }
+                cells += group.count;
+            }
+            BOOST_REQUIRE_EQUAL(cells, combo);
+        });
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestResetMatchesConstruction)
+{
+    // The board changes size between some games so the storage has to grow and shrink.
+    const int sizes[][2] = {{12, 6}, {12, 6}, {10, 8}, {70, 5}, {12, 6}};
+    ForEachGame({PanelTable::Type::ENDLESS, PanelTable::Type::VERSUS, PanelTable::Type::MOVES}, 10, 0x200, [&](TestGame& game)
+    {
+        PanelTable& table = *game.table;
+        const uint32_t seed = game.seed;
+        table.set_record_changes(seed % 2 == 0);
+
+        for (const auto& size : sizes)
+        {
+            // Leave the old game in the middle of things.
+            Play(table, game.input, 150 + seed * 7);
+
+            table.reset(TestTableOptions(game.type, game.source, seed + 100, size[0], size[1]));
+            table.set_speed(0x200);
+            TestPanelSource* fresh_source;
+            PanelTable fresh(TestTableOptions(game.type, fresh_source, seed + 100, size[0], size[1]));
+            fresh.set_speed(0x200);
+
+            BOOST_REQUIRE_EQUAL(table.height(), size[0]);
+            BOOST_REQUIRE_EQUAL(table.width(), size[1]);
+            BOOST_REQUIRE_EQUAL(table.hash(), fresh.hash());
+            BOOST_REQUIRE(table.get_changes().cells.empty());
+
+            // Recording stays on or off.
+            TestRandom fresh_input = game.input;
+            bool recorded = false;
+            for (int frame = 0; frame < 600; frame++)
+            {
+                BOOST_REQUIRE(Play(table, game.input, 1) == Play(fresh, fresh_input, 1));
+                recorded |= !table.get_changes().cells.empty();
+            }
+            BOOST_REQUIRE_EQUAL(table.hash(), fresh.hash());
+            BOOST_REQUIRE_EQUAL(recorded, seed % 2 == 0);
+        }
+
+        // Keeping the source continues its sequence.
+        TestPanelSource* fresh_source;
+        PanelTable::Options opts = TestTableOptions(game.type, fresh_source, seed);
+        PanelSourceSnapshot sequence;
+        BOOST_REQUIRE(game.source->save(sequence));
+        BOOST_REQUIRE(fresh_source->load(sequence));
+        PanelTable fresh(opts);
+        opts.source = nullptr;
+        table.reset(opts);
+        BOOST_CHECK_EQUAL(table.hash(), fresh.hash());
+    });
+}
+
+BOOST_AUTO_TEST_CASE(TestResetReseedsKeptSource)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = test_speed_settings;
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 1);
+    PanelTable table(opts);
+    TestRandom input(1);
+    Play(table, input, 300);
+
+    // A kept source must be for a board of the same size.
+    opts.source = nullptr;
+    opts.rows = 10;
+    const uint64_t hash = table.hash();
+    BOOST_CHECK(!table.reset(opts));
+    BOOST_CHECK(!table.reset(opts, 2));
+    BOOST_CHECK_EQUAL(table.height(), 12);
+    BOOST_CHECK_EQUAL(table.hash(), hash);
+
+    // Reseeding the kept source starts the same game as a new source with that seed.
+    opts.rows = 12;
+    BOOST_REQUIRE(table.reset(opts, 2));
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 2);
+    PanelTable fresh(opts);
+    TestRandom fresh_input = input;
+    BOOST_REQUIRE(Play(table, input, 600) == Play(fresh, fresh_input, 600));
+
+    // The pool only hands out a table keeping its source if it is for the same size.
+    PanelTablePool pool;
+    opts.source = nullptr;
+    BOOST_CHECK(!pool.acquire(opts, 3));
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 1);
+    pool.release(std::unique_ptr<PanelTable>(new PanelTable(opts)));
+    opts.source = nullptr;
+    opts.rows = 10;
+    BOOST_CHECK(!pool.acquire(opts, 3));
+    opts.rows = 12;
+    std::unique_ptr<PanelTable> pooled = pool.acquire(opts, 3);
+    BOOST_REQUIRE(pooled);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 3);
+    PanelTable third(opts);
+    BOOST_CHECK_EQUAL(pooled->hash(), third.hash());
+}
+
+BOOST_AUTO_TEST_CASE(TestPoolReusesTables)
+{
+    PanelTablePool pool;
+    TestPanelSource* source;
+    std::unique_ptr<PanelTable> table = pool.acquire(TestTableOptions(PanelTable::Type::ENDLESS, source, 1));
+    std::unique_ptr<PanelTable> wide = pool.acquire(TestTableOptions(PanelTable::Type::ENDLESS, source, 2, 12, 8));
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+
+    const PanelTable* first = table.get();
+    const PanelTable* second = wide.get();
+    TestRandom input(1);
+    Play(*table, input, 300);
+    pool.release(std::move(table));
+    pool.release(std::move(wide));
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+
+    // A table of the same size is preferred over the last one released.
+    table = pool.acquire(TestTableOptions(PanelTable::Type::MOVES, source, 3));
+    BOOST_CHECK(table.get() == first);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    TestPanelSource* fresh_source;
+    PanelTable fresh(TestTableOptions(PanelTable::Type::MOVES, fresh_source, 3));
+    BOOST_CHECK_EQUAL(table->hash(), fresh.hash());
+    BOOST_CHECK_EQUAL(table->get_state(), PanelTable::State::PUZZLE);
+
+    // Otherwise any table is reset to the size asked for.
+    std::unique_ptr<PanelTable> tall = pool.acquire(TestTableOptions(PanelTable::Type::ENDLESS, source, 4, 20, 6));
+    BOOST_CHECK(tall.get() == second);
+    BOOST_CHECK_EQUAL(tall->height(), 20);
+    BOOST_CHECK_EQUAL(tall->width(), 6);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestRejectedResetKeepsGame)
+{
+    PanelTable::Options opts;
+    opts.rows = 12;
+    opts.columns = 6;
+    opts.type = PanelTable::Type::ENDLESS;
+    opts.moves = 0;
+    opts.settings = test_speed_settings;
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 1);
+    PanelTable table(opts);
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 1);
+    PanelTable twin(opts);
+    TestRandom input(1);
+    TestRandom twin_input = input;
+    BOOST_REQUIRE(Play(table, input, 300) == Play(twin, twin_input, 300));
+
+    // A board too big is refused before the kept source is reseeded, so the game goes on as if reset was never called.
+    opts.source = nullptr;
+    opts.rows = MAX_TABLE_ROWS + 1;
+    BOOST_CHECK(!table.reset(opts, 2));
+    BOOST_CHECK_EQUAL(table.hash(), twin.hash());
+    BOOST_REQUIRE(Play(table, input, 600) == Play(twin, twin_input, 600));
+}
+
+BOOST_AUTO_TEST_CASE(TestPoolRefusesInvalidOptions)
+{
+    PanelTablePool pool;
+    TestPanelSource* source;
+    std::unique_ptr<PanelTable> table = pool.acquire(TestTableOptions(PanelTable::Type::ENDLESS, source, 1));
+    TestRandom input(1);
+    Play(*table, input, 300);
+    const PanelTable* released = table.get();
+    pool.release(std::move(table));
+
+    // No table comes back for a board too big, the released one stays in the pool with its game.
+    PanelTable::Options opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 2, MAX_TABLE_ROWS + 1, 6);
+    BOOST_CHECK(!pool.acquire(opts));
+    opts = TestTableOptions(PanelTable::Type::ENDLESS, source, 2, MAX_TABLE_ROWS + 1, 6);
+    BOOST_CHECK(!pool.acquire(opts, 3));
+    opts.source = nullptr;
+    BOOST_CHECK(!pool.acquire(opts, 3));
+    BOOST_REQUIRE_EQUAL(pool.size(), 1);
+
+    opts.rows = 12;
+    table = pool.acquire(opts);
+    BOOST_REQUIRE(table);
+    BOOST_CHECK(table.get() == released);
+
+    // With the table taken, an empty pool refuses too.
+    BOOST_CHECK(!pool.acquire(TestTableOptions(PanelTable::Type::ENDLESS, source, 2, 12, MAX_TABLE_COLUMNS + 1)));
 }
@@ -0,0 +1,71 @@
+#include "puzzle_solver.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <preset_configuration.hpp>
+
+/** Solves MOVES puzzles, printing the fewest swaps each one needs and every way to clear it with that many.
+  * Usage: puzzle_solve [-d max_moves] puzzle.bbb... */
+int main(int argc, char** argv)
+{
+    int max_moves = 1000000;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-d") == 0)
+    {
+        max_moves = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-d max_moves] puzzle.bbb...\n", argv[0]);
+        return 2;
+    }
+
+    int failed = 0;
+    PuzzleSolver solver;
+    for (int k = first; k < argc; k++)
+    {
+        PanelTable::Options opts;
+        if (!read_puzzle(argv[k], opts))
+        {
+            printf("%s: can't read puzzle\n", argv[k]);
+            failed++;
+            continue;
+        }
+        PanelTable table(opts);
+
+        const auto start = std::chrono::steady_clock::now();
+        const int moves = solver.solve(table, max_moves);
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (moves == PuzzleSolver::UNSAVABLE)
+        {
+            printf("%s: board too big to search\n", argv[k]);
+            failed++;
+            continue;
+        }
+        if (moves < 0)
+        {
+            printf("%s: no solution in %d moves, %ld positions, %.1f ms\n", argv[k], std::min(max_moves, opts.moves),
+                   solver.get_positions(), elapsed.count());
+            failed++;
+            continue;
+        }
+
+        const auto& solutions = solver.get_solutions();
+        printf("%s: %d of %d moves, %zu solutions, %ld positions, %.1f ms\n", argv[k], moves, opts.moves, solutions.size(),
+               solver.get_positions(), elapsed.count());
+        for (const auto& solution : solutions)
+        {
+            // Swaps are given as the row and column of the left panel.
+            printf("   ");
+            for (const Point& swap : solution)
+                printf(" (%d, %d)", swap.y, swap.x);
+            printf("\n");
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+#include "puzzle_solver.hpp"
+#include <algorithm>
+
+constexpr int PuzzleSolver::SETTLE_FRAMES;
+constexpr int PuzzleSolver::UNSAVABLE;
+
+/// Can every type on the board still be matched away, a type with only one or two panels left never can.
+static bool can_clear(const PanelTable& table)
+{
+    int counts[Panel::Type::SPECIAL + 1] = {0};
+    for (const auto& panel : table.get_panels())
+        counts[panel.get_value()]++;
+    for (int type = Panel::Type::RED; type < Panel::Type::SPECIAL; type++)
+    {
+        if (counts[type] > 0 && counts[type] < 3)
+            return false;
+    }
+    return true;
+}
+
+int PuzzleSolver::solve(PanelTable& table, int max_moves)
+{
+    solutions.clear();
+    path.clear();
+    unsolvable.clear();
+    positions = 0;
+
+    // Every position searched has the board of table, so if it can be saved they all can.
+    PanelTableSnapshot start;
+    if (!table.save_state(start))
+        return UNSAVABLE;
+    if (cleared(table))
+    {
+        solutions.push_back(path);
+        return 0;
+    }
+
+    const int moves = std::min(max_moves, table.get_moves());
+    swaps.resize(moves + 1);
+    for (int depth = 1; depth <= moves; depth++)
+    {
+        // Positions shown unsolvable stay that way, so what was learned at one depth prunes the next.
+        if (search(table, depth))
+            return depth;
+    }
+    return -1;
+}
+
+bool PuzzleSolver::search(PanelTable& table, int left)
+{
+    positions++;
+    const uint64_t key = table.canonical_hash();
+    const auto known = unsolvable.find(key);
+    if (known != unsolvable.end() && known->second >= left)
+        return false;
+
+    // solve checked that the board can be saved.
+    PanelTableSnapshot start;
+    table.save_state(start);
+    const bool symmetric = table.is_symmetric();
+    std::vector<Point>& legal = swaps[left];
+    table.legal_swaps(legal);
+
+    bool solved = false;
+    for (const Point& swap : legal)
+    {
+        const size_t found = solutions.size();
+        table.load_state(start);
+        table.swap(swap.y, swap.x);
+        settle(table);
+
+        path.push_back(swap);
+        if (cleared(table))
+            solutions.push_back(path);
+        else if (left > 1 && can_clear(table))
+            search(table, left - 1);
+        path.pop_back();
+
+        // legal_swaps leaves out the mirrored swaps of a symmetric board, they clear it in the mirrored ways.
+        const int mirrored = table.width() - 2 - swap.x;
+        if (symmetric && mirrored != swap.x)
+        {
+            const size_t end = solutions.size();
+            for (size_t k = found; k < end; k++)
+            {
+                Solution solution = solutions[k];
+                for (size_t m = path.size(); m < solution.size(); m++)
+                    solution[m].x = table.width() - 2 - solution[m].x;
+                solutions.push_back(solution);
+            }
+        }
+        solved |= solutions.size() != found;
+    }
+    table.load_state(start);
+
+    if (!solved)
+        unsolvable[key] = std::max(left, known != unsolvable.end() ? known->second : 0);
+    return solved;
+}
+
+void PuzzleSolver::settle(PanelTable& table)
+{
+    // Only the frames where something happens are simulated.
+    do
+    {
+        table.advance_until_event(SETTLE_FRAMES);
+        table.update();
+    } while (!table.all_idle());
+}
+
+bool PuzzleSolver::cleared(const PanelTable& table)
+{
+    return table.first_filled_row() == table.height();
+}
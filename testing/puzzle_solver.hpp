@@ -0,0 +1,55 @@
+#ifndef PUZZLE_SOLVER_HPP
+#define PUZZLE_SOLVER_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "panel_table.hpp"
+
+/**
+ * Finds the fewest swaps that clear a MOVES puzzle and every sequence of that many swaps that clears it.
+ * Swaps are made on a settled board, after each one the table is run until every panel is idle again.
+ * Searches with iterative deepening, remembering the positions already shown to need more swaps than were left.
+ */
+class PuzzleSolver
+{
+public:
+    /// Swaps in the order they are made, Point(j, i) swaps i, j with i, j + 1.
+    typedef std::vector<Point> Solution;
+
+    /// Most frames skipped at once while settling.
+    static constexpr int SETTLE_FRAMES = 1000;
+    /// Returned by solve for a table that can't be saved, positions are restored from snapshots while searching.
+    static constexpr int UNSAVABLE = -2;
+
+    /** Searches for the solutions of the puzzle table is in with at most max_moves swaps and no more than the moves it has left.
+      * Returns the fewest swaps that clear it, 0 with one empty solution if it is already clear, -1 if it can't be cleared
+      * or UNSAVABLE. The table is left as it was. */
+    int solve(PanelTable& table, int max_moves);
+
+    /// Every solution with the fewest swaps found by the last solve
+    const std::vector<Solution>& get_solutions() const {return solutions;}
+    /// Positions searched by the last solve
+    long get_positions() const {return positions;}
+
+    /// Runs table until a swap and everything it sets off are over.
+    static void settle(PanelTable& table);
+    /// Is the board of table empty
+    static bool cleared(const PanelTable& table);
+
+private:
+    /// Looks for solutions with left more swaps from the position table is in. Returns true if any were found.
+    bool search(PanelTable& table, int left);
+
+    std::vector<Solution> solutions;
+    /// Swaps made to reach the position being searched
+    Solution path;
+    /// Legal swaps of each position on the path, indexed by depth so searching does not allocate
+    std::vector<std::vector<Point>> swaps;
+    /// Canonical hash of a position to the most swaps it was shown it can't be cleared with
+    std::unordered_map<uint64_t, int> unsolvable;
+    long positions = 0;
+};
+
+#endif
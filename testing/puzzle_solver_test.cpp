@@ -0,0 +1,147 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <preset_configuration.hpp>
+#include "puzzle_solver.hpp"
+
+/// Puzzles shipped with the game from the testing directory, the easier stages so the test stays quick.
+/// Run puzzle_solve on romfs/puzzles/*/*/*.bbb to check them all.
+std::vector<std::string> PuzzleFiles()
+{
+    std::vector<std::string> files;
+    const char* stages[] = {"ta/stage-1/stage1", "ta/stage-2/stage2", "ta/stage-3/stage3", "ta/stage-4/stage4", "ta-ex/stage-e1/stageE1"};
+    for (const char* stage : stages)
+    {
+        for (int puzzle = 1; puzzle <= 10; puzzle++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "%s-%02d.bbb", stage, puzzle);
+            files.push_back(std::string("../romfs/puzzles/") + name);
+        }
+    }
+    return files;
+}
+
+std::unique_ptr<PanelTable> ReadPuzzle(const std::string& filename)
+{
+    PanelTable::Options opts;
+    if (!read_puzzle(filename, opts))
+        return nullptr;
+    return std::unique_ptr<PanelTable>(new PanelTable(opts));
+}
+
+/// Makes the swaps of solution on table the way the solver does, returns the swaps made before it was cleared.
+int Replay(PanelTable& table, const PuzzleSolver::Solution& solution)
+{
+    int swaps = 0;
+    for (const Point& swap : solution)
+    {
+        if (PuzzleSolver::cleared(table))
+            break;
+        table.swap(swap.y, swap.x);
+        PuzzleSolver::settle(table);
+        swaps++;
+    }
+    return PuzzleSolver::cleared(table) ? swaps : -1;
+}
+
+BOOST_AUTO_TEST_CASE(TestSolvesShippedPuzzles)
+{
+    PuzzleSolver solver;
+    for (const auto& filename : PuzzleFiles())
+    {
+        BOOST_TEST_CONTEXT(filename)
+        {
+            auto table = ReadPuzzle(filename);
+            BOOST_REQUIRE(table);
+
+            PanelTableSnapshot start;
+            table->save_state(start);
+            const uint64_t hash = table->hash();
+            const int moves = solver.solve(*table, table->get_moves());
+            BOOST_REQUIRE_GT(moves, 0);
+            BOOST_CHECK_LE(moves, table->get_moves());
+
+            // The table is left as it was.
+            BOOST_CHECK_EQUAL(table->hash(), hash);
+
+            auto solutions = solver.get_solutions();
+            BOOST_REQUIRE(!solutions.empty());
+            for (const auto& solution : solutions)
+            {
+                BOOST_REQUIRE_EQUAL((int) solution.size(), moves);
+                table->load_state(start);
+                BOOST_CHECK_EQUAL(Replay(*table, solution), moves);
+            }
+
+            std::sort(solutions.begin(), solutions.end());
+            BOOST_CHECK(std::adjacent_find(solutions.begin(), solutions.end()) == solutions.end());
+
+            // Searching one move less finds nothing.
+            table->load_state(start);
+            BOOST_CHECK_EQUAL(solver.solve(*table, moves - 1), -1);
+            BOOST_CHECK(solver.get_solutions().empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSettleIsQuiescent)
+{
+    auto table = ReadPuzzle("../romfs/puzzles/ta/stage-1/stage1-01.bbb");
+    BOOST_REQUIRE(table);
+
+    std::vector<Point> swaps;
+    table->legal_swaps(swaps);
+    BOOST_REQUIRE(!swaps.empty());
+
+    PanelTableSnapshot start;
+    table->save_state(start);
+    for (const Point& swap : swaps)
+    {
+        table->load_state(start);
+        table->swap(swap.y, swap.x);
+        PuzzleSolver::settle(*table);
+        BOOST_REQUIRE(table->all_idle());
+
+        // Nothing happens on the frames after a settled board.
+        std::vector<Panel::Type> types;
+        for (const auto& panel : table->get_panels())
+            types.push_back(panel.get_value());
+        for (int frame = 0; frame < 200; frame++)
+            table->update();
+        for (unsigned int k = 0; k < types.size(); k++)
+            BOOST_CHECK_EQUAL(table->get_panels()[k].get_value(), types[k]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestClearedPuzzleNeedsNoMoves)
+{
+    auto table = ReadPuzzle("../romfs/puzzles/ta/stage-1/stage1-01.bbb");
+    BOOST_REQUIRE(table);
+    table->clear();
+
+    PuzzleSolver solver;
+    BOOST_CHECK_EQUAL(solver.solve(*table, table->get_moves()), 0);
+    BOOST_REQUIRE_EQUAL(solver.get_solutions().size(), 1u);
+    BOOST_CHECK(solver.get_solutions()[0].empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestUnsavableBoardFails)
+{
+    PanelTable::Options opts;
+    BOOST_REQUIRE(read_puzzle("../romfs/puzzles/ta/stage-1/stage1-01.bbb", opts));
+    // A board bigger than a snapshot holds can't be searched.
+    opts.rows = SNAPSHOT_MAX_ROWS + 1;
+    delete opts.source;
+    opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, 1);
+    PanelTable table(opts);
+
+    PuzzleSolver solver;
+    BOOST_CHECK_EQUAL(solver.solve(table, table.get_moves()), PuzzleSolver::UNSAVABLE);
+    BOOST_CHECK(solver.get_solutions().empty());
+}
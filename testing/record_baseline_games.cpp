@@ -0,0 +1,115 @@
+/** Records games played on the PanelTable of the first commit for panel_table_test to play again on the current one.
+  * Built by make record_baseline_games against the sources of that commit, make fixtures writes the files in fixtures/.
+  *
+  * record_baseline_games type rows columns heights speed frames first_seed last_seed
+  *
+  * writes a game for each seed, its columns start with up to heights - 1 panels and it rises at speed for up to frames frames:
+  *
+  * game type rows columns heights speed frames seed
+  * board (rows * columns types of the board the table made)
+  * line (columns types, for each set of next panels the table made in order)
+  * digest played (digest in hex after played frames, every BASELINE_DIGEST_FRAMES frames and after the last one)
+  * end played
+  */
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Panel and PanelTable keep the state the digest needs private.
+#define private public
+#include <panel_table.hpp>
+#undef private
+
+#include "baseline_game.hpp"
+
+/** Panels of the board and the lines from a BaselineRandom. */
+class BaselineSource : public PanelSource
+{
+public:
+    BaselineSource(int rows, int columns, int board_heights, uint32_t seed) : PanelSource(rows, columns), heights(board_heights), random(seed) {}
+    ~BaselineSource() override {}
+    std::vector<int> board_layout() override
+    {
+        std::vector<int> layout(columns);
+        for (auto& height : layout)
+            height = random.next(heights);
+        return layout;
+    }
+    Panel::Type panel() override {return (Panel::Type) (random.next(BASELINE_COLORS) + 1);}
+
+private:
+    int heights;
+    BaselineRandom random;
+};
+
+void WriteTypes(const char* name, const std::vector<Panel>& panels)
+{
+    std::printf("%s", name);
+    for (const auto& panel : panels)
+        std::printf(" %d", panel.type);
+    std::printf("\n");
+}
+
+void WriteDigest(const PanelTable& table, const MatchInfo& info, GameDigest& digest)
+{
+    for (const auto* row : {&table.panels, &table.next})
+    {
+        for (const auto& panel : *row)
+            DigestPanel(digest, panel.type, panel.old, panel.state, panel.chain, panel.locked, panel.countdown, panel.match_time, panel.remove_time);
+    }
+    DigestTable(digest, table.state, table.stopped, table.moves, table.rise_counter, table.rise, table.speed, table.timeout, table.clink,
+                table.chain, table.lines);
+    DigestMatch(digest, info);
+}
+
+void RecordGame(PanelTable::Type type, int rows, int columns, int heights, int speed, int frames, uint32_t seed)
+{
+    PanelTable::Options opts;
+    opts.rows = rows;
+    opts.columns = columns;
+    opts.type = type;
+    opts.moves = 1000;
+    opts.settings = BASELINE_SPEED_SETTINGS;
+    opts.source = new BaselineSource(rows, columns, heights, seed);
+    PanelTable table(opts);
+    table.set_speed(speed);
+    BaselineRandom input(seed * 7919);
+
+    std::printf("game %d %d %d %d %d %d %u\n", type, rows, columns, heights, speed, frames, seed);
+    WriteTypes("board", table.panels);
+    if (!table.is_puzzle())
+        WriteTypes("line", table.next);
+
+    GameDigest digest;
+    WriteDigest(table, MatchInfo(), digest);
+    std::printf("digest 0 %016llx\n", (unsigned long long) digest.value);
+
+    int played = 0;
+    while (played < frames && !table.is_gameover())
+    {
+        const bool generate_next = table.is_generate_next();
+        const MatchInfo info = PlayBaselineFrame(table, input);
+        played++;
+
+        if (generate_next && !table.is_generate_next())
+            WriteTypes("line", table.next);
+        WriteDigest(table, info, digest);
+        if (played % BASELINE_DIGEST_FRAMES == 0 || played == frames || table.is_gameover())
+            std::printf("digest %d %016llx\n", played, (unsigned long long) digest.value);
+    }
+    std::printf("end %d\n", played);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 9)
+    {
+        std::fprintf(stderr, "Usage: %s type rows columns heights speed frames first_seed last_seed\n", argv[0]);
+        return 1;
+    }
+
+    const int args[] = {atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), atoi(argv[6])};
+    for (uint32_t seed = strtoul(argv[7], nullptr, 10); seed <= strtoul(argv[8], nullptr, 10); seed++)
+        RecordGame((PanelTable::Type) args[0], args[1], args[2], args[3], args[4], args[5], seed);
+    return 0;
+}
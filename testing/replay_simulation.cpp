@@ -242,11 +242,14 @@ ReplayPanelSource::ReplayPanelSource(const std::vector<Panel::Type>& _board, con
 {
 }
 
-std::vector<Panel::Type> ReplayPanelSource::line()
+void ReplayPanelSource::line(std::vector<Panel::Type>& line)
 {
-    std::vector<Panel::Type> line(columns, Panel::Type::EMPTY);
     if (index > (int)next.size())
-        return line;
+    {
+        for (int i = 0; i < columns; i++)
+            line[i] = Panel::Type::EMPTY;
+        return;
+    }
 
     for (int i = 0; i < columns; i++)
     {
@@ -254,8 +257,6 @@ std::vector<Panel::Type> ReplayPanelSource::line()
     }
 
     index += columns;
-
-    return line;
 }
 
 FrameReplaySimulation::FrameReplaySimulation(const FrameStateManager& frame_manager, const PanelSpeedSettings& settings, const std::map<uint32_t, uint32_t> frame_skip_vals) :
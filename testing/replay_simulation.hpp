@@ -18,7 +18,7 @@ public:
     ~ReplayPanelSource() override {}
     std::vector<Panel::Type> board() override {return table;}
     Panel::Type panel() override {return Panel::Type::EMPTY;}
-    std::vector<Panel::Type> line() override;
+    void line(std::vector<Panel::Type>& line) override;
     void reset() {index = 0;}
 private:
     std::vector<Panel::Type> table;
@@ -0,0 +1,423 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#include <boost/test/auto_unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <recorder.hpp>
+#include <session.hpp>
+#include "test_tables.hpp"
+
+SessionWriter session_writer(SESSION_FILENAME);
+
+/// Endless game with its recording, played some frames at a time.
+struct RecordedGame
+{
+    explicit RecordedGame(uint32_t game_seed) : seed(game_seed), table(CreateTable(PanelTable::Type::ENDLESS, game_seed, 0x400, 11)), input(game_seed)
+    {
+        recorder.settings(table->height(), table->width(), PanelTable::Type::ENDLESS, 1, 3);
+        std::vector<Panel::Type> initial;
+        for (const auto& panel : table->get_panels())
+            initial.push_back(panel.get_value());
+        recorder.set_initial(initial);
+    }
+
+    void play(int frames)
+    {
+        for (int k = 0; k < frames && !table->is_gameover(); k++, frame++)
+        {
+            const unsigned int trigger = input.next(4) == 0 ? 1 : 0;
+            if (trigger)
+                table->swap(input.next(table->height()), input.next(table->width() - 1));
+            table->update();
+            recorder.add_input(trigger, trigger);
+        }
+    }
+
+    /// Session of the game as it is, without the recording.
+    SessionImage image() const
+    {
+        SessionImage image;
+        image.mode = SessionImage::SCORE;
+        image.rows = table->height();
+        image.columns = table->width();
+        image.difficulty = 1;
+        image.start_level = 3;
+        image.time_mode = 2;
+        image.value = 50;
+        image.panel_gfx = "default";
+        image.score = 1234 + seed;
+        image.level = 5;
+        image.next = 17;
+        image.selector_x = 3;
+        image.selector_y = 9;
+        image.frame = frame;
+        image.time = 60000;
+        BOOST_REQUIRE(table->save_state(image.table));
+        // Each game has its own session recording.
+        image.seed = seed;
+        image.table.source.seed = seed;
+        return image;
+    }
+
+    uint32_t seed;
+    std::unique_ptr<PanelTable> table;
+    Recorder recorder;
+    TestRandom input;
+    int frame = 0;
+};
+
+/// Session of an endless game played for frames frames.
+SessionImage PlayGame(uint32_t seed, int frames)
+{
+    RecordedGame game(seed);
+    game.play(frames);
+    return game.image();
+}
+
+/// Recording of an endless game played for frames frames.
+Recorder PlayRecording(uint32_t seed, int frames)
+{
+    RecordedGame game(seed);
+    game.play(frames);
+    return game.recorder;
+}
+
+/// Bytes of the file at path, empty if there is none.
+std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::ostringstream bytes;
+    bytes << file.rdbuf();
+    return bytes.str();
+}
+
+/// Bytes Recorder::save writes for recorder.
+std::string SavedRecording(const Recorder& recorder)
+{
+    std::ostringstream bytes;
+    recorder.save(bytes);
+    return bytes.str();
+}
+
+BOOST_AUTO_TEST_CASE(TestSessionRoundTrip)
+{
+    const SessionImage image = PlayGame(7, 500);
+    std::string bytes;
+    write_session(image, bytes);
+
+    SessionImage loaded;
+    BOOST_REQUIRE(read_session(bytes, loaded));
+    BOOST_CHECK_EQUAL(loaded.mode, image.mode);
+    BOOST_CHECK_EQUAL(loaded.difficulty, image.difficulty);
+    BOOST_CHECK_EQUAL(loaded.start_level, image.start_level);
+    BOOST_CHECK_EQUAL(loaded.time_mode, image.time_mode);
+    BOOST_CHECK_EQUAL(loaded.value, image.value);
+    BOOST_CHECK_EQUAL(loaded.panel_gfx, image.panel_gfx);
+    BOOST_CHECK_EQUAL(loaded.score, image.score);
+    BOOST_CHECK_EQUAL(loaded.level, image.level);
+    BOOST_CHECK_EQUAL(loaded.next, image.next);
+    BOOST_CHECK_EQUAL(loaded.selector_x, image.selector_x);
+    BOOST_CHECK_EQUAL(loaded.selector_y, image.selector_y);
+    BOOST_CHECK_EQUAL(loaded.frame, image.frame);
+    BOOST_CHECK_EQUAL(loaded.time, image.time);
+
+    // The table picks up exactly where it was left.
+    std::unique_ptr<PanelTable> original(CreateTable(PanelTable::Type::ENDLESS, 7, 0x400, 11));
+    BOOST_REQUIRE(original->load_state(image.table));
+    std::unique_ptr<PanelTable> resumed(CreateTable(PanelTable::Type::ENDLESS, 99, 0x400, 11));
+    BOOST_REQUIRE(resumed->load_state(loaded.table));
+    BOOST_CHECK_EQUAL(resumed->hash(), original->hash());
+}
+
+BOOST_AUTO_TEST_CASE(TestRecordingSavesInParts)
+{
+    const Recorder recording = PlayRecording(5, 3000);
+    std::ostringstream whole;
+    recording.save(whole);
+    BOOST_REQUIRE_EQUAL(whole.str().size(), recording.save_size());
+
+    // Parts of any size put together are the whole save, and nothing is written past its end.
+    const size_t sizes[] = {1, 7, 64, 4096};
+    for (const size_t size : sizes)
+    {
+        std::ostringstream parts;
+        size_t offset = 0;
+        while (size_t written = recording.save_part(parts, offset, size))
+        {
+            BOOST_REQUIRE(written <= size);
+            offset += written;
+        }
+        BOOST_CHECK(parts.str() == whole.str());
+        BOOST_CHECK_EQUAL(recording.save_part(parts, offset + 100, size), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestRecordingAppendsInParts)
+{
+    // Appended a piece at a time with parts of any size, what was appended loads back to the whole recording.
+    const size_t sizes[] = {1, 7, 64, 4096};
+    for (const size_t size : sizes)
+    {
+        RecordedGame game(8);
+        std::stringstream file;
+        size_t total = 0;
+        for (int save = 0; save < 5; save++)
+        {
+            game.play(400);
+            const Recorder::AppendMark mark = game.recorder.mark();
+            const size_t append_size = game.recorder.append_size();
+            size_t offset = 0;
+            while (size_t written = game.recorder.append_part(file, offset, size))
+            {
+                BOOST_REQUIRE(written <= size);
+                offset += written;
+            }
+            BOOST_REQUIRE_EQUAL(offset, append_size);
+            game.recorder.appended(mark);
+            BOOST_CHECK_EQUAL(game.recorder.append_size(), 0);
+            total += append_size;
+        }
+        BOOST_REQUIRE_EQUAL(file.str().size(), total);
+
+        Recorder loaded;
+        BOOST_REQUIRE(loaded.load_appended(file, total));
+        BOOST_CHECK(SavedRecording(loaded) == SavedRecording(game.recorder));
+        BOOST_CHECK_EQUAL(loaded.append_size(), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSessionResumesPanelSource)
+{
+    for (uint32_t seed = 1; seed <= 5; seed++)
+    {
+        PanelTable::Options opts;
+        opts.rows = 11;
+        opts.columns = 6;
+        opts.type = PanelTable::Type::ENDLESS;
+        opts.moves = 0;
+        opts.settings = test_speed_settings;
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, seed);
+        PanelTable table(opts);
+        table.set_speed(0x1000);
+
+        // Left with lines generated ahead so the queue is part of what is saved.
+        TestRandom input(seed);
+        for (int frame = 0; frame < 500; frame++)
+        {
+            if (input.next(4) == 0)
+                table.swap(input.next(table.height()), input.next(table.width() - 1));
+            table.fill_lines();
+            table.update();
+        }
+        const int queued = table.get_source().queued();
+        BOOST_REQUIRE(queued > 0);
+
+        SessionImage image;
+        image.rows = table.height();
+        image.columns = table.width();
+        image.seed = seed;
+        BOOST_REQUIRE(table.save_state(image.table));
+        std::string bytes;
+        write_session(image, bytes);
+        SessionImage loaded;
+        BOOST_REQUIRE(read_session(bytes, loaded));
+        BOOST_CHECK_EQUAL(loaded.seed, seed);
+
+        // Resumed the way a game scene is, from a source seeded with the saved seed.
+        opts.source = new RandomPanelSource(opts.rows, opts.columns, 5, loaded.seed);
+        PanelTable resumed(opts);
+        resumed.set_speed(0x1000);
+        BOOST_REQUIRE(resumed.load_state(loaded.table));
+
+        const int lines = table.get_lines();
+        for (int frame = 0; frame < 5000 && !table.is_gameover(); frame++)
+        {
+            if (input.next(4) == 0)
+            {
+                const int i = input.next(table.height());
+                const int j = input.next(table.width() - 1);
+                table.swap(i, j);
+                resumed.swap(i, j);
+            }
+            table.update();
+            resumed.update();
+            BOOST_REQUIRE_EQUAL(table.hash(), resumed.hash());
+        }
+        // Past the queued lines into ones the resumed generators make.
+        BOOST_CHECK(table.get_lines() > lines + queued);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSessionRejectsDamagedBytes)
+{
+    std::string bytes;
+    write_session(PlayGame(3, 100), bytes);
+    SessionImage image;
+
+    for (size_t size = 0; size < bytes.size(); size += 97)
+        BOOST_CHECK(!read_session(bytes.substr(0, size), image));
+    BOOST_CHECK(!read_session(bytes + "x", image));
+
+    std::string version = bytes;
+    version[4]++;
+    BOOST_CHECK(!read_session(version, image));
+
+    // Sessions from before the seed was saved can't be resumed.
+    version[4] = 1;
+    BOOST_CHECK(!read_session(version, image));
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterReplacesSessionWhenComplete)
+{
+    const std::string path = "session_test.bin";
+    remove_session(path);
+    const SessionImage old_image = PlayGame(1, 200);
+    const SessionImage new_image = PlayGame(2, 300);
+
+    SessionWriter writer(path);
+    SessionImage loaded;
+    BOOST_CHECK(!load_session(path, loaded));
+    writer.begin(SessionImage(old_image), PlayRecording(1, 200));
+    BOOST_REQUIRE(writer.finish());
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, old_image.score);
+
+    // Until the last chunk is written a resume finds the old session.
+    writer.begin(SessionImage(new_image), PlayRecording(2, 300));
+    int steps = 0;
+    while (!writer.step(64))
+    {
+        BOOST_CHECK(writer.busy());
+        BOOST_REQUIRE(load_session(path, loaded));
+        BOOST_CHECK_EQUAL(loaded.score, old_image.score);
+        steps++;
+    }
+    BOOST_CHECK(steps > 1);
+    BOOST_CHECK(!writer.busy());
+    BOOST_CHECK(!writer.failed());
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, new_image.score);
+    // The old session's recording went with it.
+    BOOST_CHECK(ReadFile(session_recording_path(path, 1)).empty());
+    BOOST_CHECK(!ReadFile(session_recording_path(path, 2)).empty());
+
+    // A save stopped between removing the old session and the rename is found under the temporary name.
+    BOOST_REQUIRE(std::rename(path.c_str(), (path + ".tmp").c_str()) == 0);
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, new_image.score);
+
+    // Starting the next save keeps it until the next one is complete.
+    writer.begin(SessionImage(old_image), PlayRecording(1, 200));
+    while (!writer.step(64))
+    {
+        BOOST_REQUIRE(load_session(path, loaded));
+        BOOST_CHECK_EQUAL(loaded.score, new_image.score);
+    }
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, old_image.score);
+
+    writer.discard();
+    BOOST_CHECK(!load_session(path, loaded));
+    BOOST_CHECK(ReadFile(session_recording_path(path, 1)).empty());
+    BOOST_CHECK(ReadFile(session_recording_path(path, 2)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterAppendsRecording)
+{
+    const std::string path = "session_test.bin";
+    remove_session(path);
+    SessionWriter writer(path);
+    RecordedGame game(9);
+    size_t recording_size = 0;
+    size_t session_size = 0;
+
+    // Saved over and over as a game left and resumed many times is, each save appending what was recorded since the last one.
+    for (int save = 0; save < 8; save++)
+    {
+        game.play(1000);
+        SessionImage image = game.image();
+        image.recording_size = recording_size;
+        const Recorder::AppendMark mark = game.recorder.mark();
+        const size_t appended = game.recorder.append_size();
+        writer.begin(std::move(image), Recorder(game.recorder));
+        while (!writer.step(256))
+            continue;
+        BOOST_REQUIRE(!writer.failed());
+        recording_size += appended;
+        game.recorder.appended(mark);
+
+        // The session holds the table only, however long the game.
+        SessionImage loaded;
+        BOOST_REQUIRE(load_session(path, loaded));
+        BOOST_CHECK_EQUAL(loaded.recording_size, recording_size);
+        BOOST_CHECK_EQUAL(ReadFile(session_recording_path(path, 9)).size(), recording_size);
+        if (save > 0)
+            BOOST_CHECK_EQUAL(ReadFile(path).size(), session_size);
+        session_size = ReadFile(path).size();
+
+        // Resumed the way a game scene is, the recorder starts empty with the header already in the session recording.
+        if (save % 2 == 1)
+        {
+            Recorder::AppendMark header;
+            header.header = true;
+            game.recorder = Recorder();
+            game.recorder.appended(header);
+        }
+    }
+
+    // Once the game is over its whole recording is put back together for the replay.
+    game.play(500);
+    RecordedGame whole(9);
+    whole.play(game.frame);
+    BOOST_REQUIRE(load_session_recording(path, 9, recording_size, game.recorder));
+    BOOST_CHECK(SavedRecording(game.recorder) == SavedRecording(whole.recorder));
+
+    // A recording shorter than the session says can't be resumed.
+    {
+        const std::string bytes = ReadFile(session_recording_path(path, 9));
+        std::ofstream cut((session_recording_path(path, 9)).c_str(), std::ios::binary | std::ios::trunc);
+        cut.write(bytes.data(), bytes.size() - 1);
+    }
+    SessionImage loaded;
+    BOOST_CHECK(!load_session(path, loaded));
+
+    writer.discard();
+    std::remove(session_recording_path(path, 9).c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestWriterChecksOnlyHeaders)
+{
+    const std::string path = "session_test.bin";
+    remove_session(path);
+    std::string bytes;
+    write_session(PlayGame(4, 300), bytes);
+
+    // A first save cut short left part of a session under the temporary name, its header gives away that it is incomplete.
+    {
+        std::ofstream partial((path + ".tmp").c_str(), std::ios::binary);
+        partial.write(bytes.data(), bytes.size() / 2);
+    }
+    SessionImage loaded;
+    BOOST_CHECK(!load_session(path, loaded));
+    SessionWriter writer(path);
+    writer.begin(PlayGame(5, 100), PlayRecording(5, 100));
+    BOOST_CHECK(!load_session(path, loaded));
+    BOOST_REQUIRE(writer.finish());
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, 1234 + 5);
+
+    // A recording too big is not saved, the last session is kept.
+    Recorder big = PlayRecording(6, 100);
+    for (int k = 0; k < SESSION_MAX_RECORDING_SIZE / 12 + 1; k++)
+        big.add_input(k % 2, 0);
+    writer.begin(PlayGame(6, 100), std::move(big));
+    BOOST_CHECK(!writer.busy());
+    BOOST_CHECK(writer.failed());
+    BOOST_REQUIRE(load_session(path, loaded));
+    BOOST_CHECK_EQUAL(loaded.score, 1234 + 5);
+
+    writer.discard();
+}
@@ -0,0 +1,176 @@
+#ifndef TEST_TABLES_HPP
+#define TEST_TABLES_HPP
+
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+#include <panel_table.hpp>
+
+/// Speed settings of the easy preset, so tests don't need game_common.
+const PanelSpeedSettings test_speed_settings = {3, 11, 1, 46, 25, 9, FALL_ANIMATION_FRAMES};
+
+/** Small generator so a test can save and restore everything that drives a game. */
+struct TestRandom
+{
+    explicit TestRandom(uint32_t s) : seed(s) {}
+    int next(int max)
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % max;
+    }
+    uint32_t seed;
+};
+
+/** Panels from a TestRandom so a game only depends on the seed. The shape of the board can be changed before the table is made. */
+class TestPanelSource : public PanelSource
+{
+public:
+    TestPanelSource(int rows, int columns, uint32_t seed) : PanelSource(rows, columns), random(seed) {}
+    ~TestPanelSource() override {}
+    std::vector<int> board_layout() override
+    {
+        std::vector<int> layout(columns);
+        for (auto& height : layout)
+            height = min_height + random.next(heights);
+        return layout;
+    }
+    Panel::Type panel() override {return (Panel::Type) (random.next(colors) + 1);}
+
+    TestRandom random;
+    /// Columns start with min_height to min_height + heights - 1 panels
+    int min_height = 0;
+    int heights = 8;
+    /// Panels are RED up to the colors-th type
+    int colors = 5;
+
+protected:
+    void save_generator(PanelSourceSnapshot& snapshot) const override {snapshot.sequence = random.seed;}
+    void load_generator(const PanelSourceSnapshot& snapshot) override {random.seed = snapshot.sequence;}
+};
+
+/// Options for a game of type on a rows x columns board with test_speed_settings and 1000 moves, source is set to its new TestPanelSource.
+inline PanelTable::Options TestTableOptions(PanelTable::Type type, TestPanelSource*& source, uint32_t seed, int rows = 12, int columns = 6)
+{
+    PanelTable::Options opts;
+    opts.rows = rows;
+    opts.columns = columns;
+    opts.type = type;
+    opts.moves = 1000;
+    opts.settings = test_speed_settings;
+    opts.source = source = new TestPanelSource(rows, columns, seed);
+    return opts;
+}
+
+/// Table made from TestTableOptions rising at speed.
+inline PanelTable* CreateTable(PanelTable::Type type, TestPanelSource*& source, uint32_t seed, int speed, int rows = 12, int columns = 6)
+{
+    PanelTable* table = new PanelTable(TestTableOptions(type, source, seed, rows, columns));
+    table->set_speed(speed);
+    return table;
+}
+
+inline PanelTable* CreateTable(PanelTable::Type type, uint32_t seed, int speed, int rows = 12, int columns = 6)
+{
+    TestPanelSource* source;
+    return CreateTable(type, source, seed, speed, rows, columns);
+}
+
+/// Did two updates report the same match
+inline bool SameInfo(const MatchInfo& a, const MatchInfo& b)
+{
+    return a.combo == b.combo && a.chain == b.chain && a.clink == b.clink &&
+           a.swap_match == b.swap_match && a.fall_match == b.fall_match;
+}
+
+/// Do the tables hold the same simulation state, compared by their snapshots.
+inline bool SameState(const PanelTable& a, const PanelTable& b)
+{
+    PanelTableSnapshot first;
+    PanelTableSnapshot second;
+    std::memset(&first, 0, sizeof(first));
+    std::memset(&second, 0, sizeof(second));
+    return a.save_state(first) && b.save_state(second) && std::memcmp(&first, &second, sizeof(first)) == 0;
+}
+
+/// Everything a frame shows of the table and its match, to compare games frame by frame.
+inline std::vector<int> Signature(const PanelTable& table, const MatchInfo& info)
+{
+    std::vector<int> signature;
+    for (const auto& panel : table.get_panels())
+    {
+        signature.push_back(panel.get_value());
+        signature.push_back(panel.get_state());
+        signature.push_back(panel.get_countdown());
+        signature.push_back(panel.get_chain());
+    }
+    for (const auto& panel : table.get_next())
+        signature.push_back(panel.get_value());
+    signature.push_back(table.get_state());
+    signature.push_back(table.get_rise());
+    signature.push_back(table.get_rise_counter());
+    signature.push_back(table.get_timeout());
+    signature.push_back(table.get_chain());
+    signature.push_back(table.get_moves());
+    signature.push_back(table.get_lines());
+    signature.push_back(info.combo);
+    signature.push_back(info.chain);
+    signature.push_back(info.clink);
+    return signature;
+}
+
+/// Plays frames frames of random input, letting the source generate lines ahead every frame if fill is set as GameScene does.
+inline std::vector<std::vector<int>> Play(PanelTable& table, TestRandom& input, int frames, bool fill = false)
+{
+    std::vector<std::vector<int>> signatures;
+    for (int frame = 0; frame < frames && !table.is_gameover(); frame++)
+    {
+        if (fill)
+            table.fill_lines();
+        // A board one panel wide has nothing to swap.
+        if (table.width() > 1 && input.next(4) == 0)
+            table.swap(input.next(table.height()), input.next(table.width() - 1));
+        if (input.next(50) == 0)
+            table.quick_rise();
+        MatchInfo info = table.update();
+        if (info.matched())
+            table.freeze(info.combo * 10 + info.chain * 20);
+        signatures.push_back(Signature(table, info));
+    }
+    return signatures;
+}
+
+/** A game of the property tests, a table from CreateTable and the random input played on it both follow from the seed. */
+struct TestGame
+{
+    TestGame(PanelTable::Type game_type, uint32_t game_seed, int speed) : type(game_type), seed(game_seed),
+        table(CreateTable(game_type, source, game_seed, speed)), input(game_seed * 7919) {}
+
+    PanelTable::Type type;
+    uint32_t seed;
+    TestPanelSource* source;
+    std::unique_ptr<PanelTable> table;
+    TestRandom input;
+};
+
+/// Calls check with a new TestGame rising at speed for each of types and each seed from 1 to seeds.
+template <class Check> void ForEachGame(std::initializer_list<PanelTable::Type> types, uint32_t seeds, int speed, Check check)
+{
+    for (const auto type : types)
+    {
+        for (uint32_t seed = 1; seed <= seeds; seed++)
+        {
+            TestGame game(type, seed, speed);
+            check(game);
+        }
+    }
+}
+
+/// Plays up to frames frames of game one at a time as Play does, calling check with the Signature of each frame until the game is over.
+template <class Check> void PlayFrames(TestGame& game, int frames, Check check)
+{
+    for (int frame = 0; frame < frames && !game.table->is_gameover(); frame++)
+        check(Play(*game.table, game.input, 1).back());
+}
+
+#endif